@@ -0,0 +1,368 @@
+#include "scanner/scanner.hpp"
+#include "scanner/md5.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct TreeConfig {
+    size_t files = 20000;
+    size_t depth = 3;             // directory levels below the root
+    size_t fanout = 8;            // subdirectories per directory
+    uint64_t minSize = 256;       // file sizes are log-uniform in [minSize, maxSize]
+    uint64_t maxSize = 64 << 10;
+    double largeFraction = 0.0;   // share of files that get largeSize instead
+    uint64_t largeSize = 64ull << 20;
+    double hitRatio = 0.01;       // share of files listed in the base
+    size_t signatures = 100000;   // random signatures that match nothing
+    uint64_t seed = 1;
+};
+
+struct TreeStats {
+    size_t files = 0;
+    size_t directories = 0;
+    size_t hits = 0;
+    uint64_t bytes = 0;
+};
+
+void PrintUsage() {
+    std::cout << "Usage: scanner_bench [options]\n";
+    std::cout << "Generates a synthetic tree and base, scans the tree with every combination of\n";
+    std::cout << "thread count and read backend and writes the results as JSON.\n";
+    std::cout << "Options:\n";
+    std::cout << "  --root <dir>          Where the tree and base are generated (default: bench_data)\n";
+    std::cout << "  --files <n>           Number of files (default: 20000)\n";
+    std::cout << "  --depth <n>           Directory levels (default: 3)\n";
+    std::cout << "  --fanout <n>          Subdirectories per directory (default: 8)\n";
+    std::cout << "  --min-size <bytes>    Smallest file, sizes are log-uniform (default: 256)\n";
+    std::cout << "  --max-size <bytes>    Largest file (default: 65536)\n";
+    std::cout << "  --large-fraction <p>  Share of files of --large-size (default: 0)\n";
+    std::cout << "  --large-size <bytes>  Size of large files (default: 67108864)\n";
+    std::cout << "  --hit-ratio <p>       Share of files present in the base (default: 0.01)\n";
+    std::cout << "  --signatures <n>      Extra signatures that match nothing (default: 100000)\n";
+    std::cout << "  --seed <n>            Generator seed (default: 1)\n";
+    std::cout << "  --threads <list>      Comma separated thread counts (default: 1,<hardware>)\n";
+    std::cout << "  --readers <list>      Comma separated backends: stream,mmap,direct (default: all)\n";
+    std::cout << "  --repeat <n>          Runs per combination (default: 3)\n";
+    std::cout << "  --output <file.json>  Results file (default: stdout only)\n";
+    std::cout << "  --keep                Keep the generated tree\n";
+    std::cout << "  --help                Show this help message\n";
+}
+
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+const char* ReaderName(ReadBackend backend) {
+    switch (backend) {
+        case ReadBackend::Stream: return "stream";
+        case ReadBackend::Mmap: return "mmap";
+        case ReadBackend::Direct: return "direct";
+    }
+    return "unknown";
+}
+
+void FillRandom(std::mt19937_64& rng, std::vector<char>& buffer, size_t size) {
+    buffer.resize((size + 7) & ~size_t(7));
+    for (size_t i = 0; i < buffer.size(); i += 8) {
+        uint64_t value = rng();
+        std::copy(reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + 8,
+                  buffer.begin() + i);
+    }
+    buffer.resize(size);
+}
+
+// Builds the directory tree, spreads the files over all directories and
+// writes a CSV base with the digests of the "hit" files plus filler
+bool GenerateTree(const TreeConfig& config, const fs::path& root, TreeStats& stats) {
+    std::mt19937_64 rng(config.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const double logMin = std::log(double(std::max<uint64_t>(config.minSize, 1)));
+    const double logMax = std::log(double(std::max(config.maxSize, config.minSize)));
+
+    std::vector<fs::path> directories{root / "tree"};
+    for (size_t level = 0, begin = 0; level < config.depth; ++level) {
+        size_t end = directories.size();
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = 0; j < config.fanout; ++j) {
+                directories.push_back(directories[i] / ("d" + std::to_string(j)));
+            }
+        }
+        begin = end;
+    }
+    for (const auto& dir : directories) {
+        fs::create_directories(dir);
+    }
+    stats.directories = directories.size();
+
+    std::ofstream base(root / "base.csv", std::ios::binary);
+    std::vector<char> buffer;
+    for (size_t i = 0; i < config.files; ++i) {
+        uint64_t size = unit(rng) < config.largeFraction
+            ? config.largeSize
+            : static_cast<uint64_t>(std::exp(logMin + (logMax - logMin) * unit(rng)));
+        FillRandom(rng, buffer, size);
+
+        fs::path path = directories[i % directories.size()] / ("f" + std::to_string(i) + ".bin");
+        std::ofstream file(path, std::ios::binary);
+        file.write(buffer.data(), buffer.size());
+        if (!file) {
+            std::cerr << "Error: Could not write " << path.string() << std::endl;
+            return false;
+        }
+        stats.files++;
+        stats.bytes += size;
+
+        if (unit(rng) < config.hitRatio) {
+            MD5 md5;
+            md5.Update(buffer.data(), buffer.size());
+            base << MD5::ToHex(md5.Final()) << ";Bench.Hit\n";
+            stats.hits++;
+        }
+    }
+    for (size_t i = 0; i < config.signatures; ++i) {
+        MD5Digest digest;
+        FillRandom(rng, buffer, digest.size());
+        std::copy(buffer.begin(), buffer.end(), digest.begin());
+        base << MD5::ToHex(digest) << ";Bench.Filler\n";
+    }
+    return bool(base);
+}
+
+// Lets every run report its own peak instead of the process maximum
+void ResetPeakRss() {
+#ifdef __linux__
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+#endif
+}
+
+uint64_t PeakRssBytes() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+#endif
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    TreeConfig config;
+    fs::path root = "bench_data";
+    std::string outputPath;
+    std::vector<size_t> threadCounts;
+    std::vector<ReadBackend> readers{ReadBackend::Stream, ReadBackend::Mmap, ReadBackend::Direct};
+    size_t repeat = 3;
+    bool keep = false;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--root" && hasValue) {
+                root = argv[++i];
+            } else if (arg == "--files" && hasValue) {
+                config.files = std::stoul(argv[++i]);
+            } else if (arg == "--depth" && hasValue) {
+                config.depth = std::stoul(argv[++i]);
+            } else if (arg == "--fanout" && hasValue) {
+                config.fanout = std::max<size_t>(std::stoul(argv[++i]), 1);
+            } else if (arg == "--min-size" && hasValue) {
+                config.minSize = std::stoull(argv[++i]);
+            } else if (arg == "--max-size" && hasValue) {
+                config.maxSize = std::stoull(argv[++i]);
+            } else if (arg == "--large-fraction" && hasValue) {
+                config.largeFraction = std::stod(argv[++i]);
+            } else if (arg == "--large-size" && hasValue) {
+                config.largeSize = std::stoull(argv[++i]);
+            } else if (arg == "--hit-ratio" && hasValue) {
+                config.hitRatio = std::stod(argv[++i]);
+            } else if (arg == "--signatures" && hasValue) {
+                config.signatures = std::stoul(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                config.seed = std::stoull(argv[++i]);
+            } else if (arg == "--threads" && hasValue) {
+                for (const auto& item : SplitList(argv[++i])) {
+                    threadCounts.push_back(std::stoul(item));
+                }
+            } else if (arg == "--readers" && hasValue) {
+                readers.clear();
+                for (const auto& item : SplitList(argv[++i])) {
+                    if (item == "stream") {
+                        readers.push_back(ReadBackend::Stream);
+                    } else if (item == "mmap") {
+                        readers.push_back(ReadBackend::Mmap);
+                    } else if (item == "direct") {
+                        readers.push_back(ReadBackend::Direct);
+                    } else {
+                        std::cerr << "Unknown reader: " << item << std::endl;
+                        return 1;
+                    }
+                }
+            } else if (arg == "--repeat" && hasValue) {
+                repeat = std::max<size_t>(std::stoul(argv[++i]), 1);
+            } else if (arg == "--output" && hasValue) {
+                outputPath = argv[++i];
+            } else if (arg == "--keep") {
+                keep = true;
+            } else if (arg == "--help") {
+                PrintUsage();
+                return 0;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                PrintUsage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid argument value: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (threadCounts.empty()) {
+        threadCounts.push_back(1);
+        size_t hardware = std::thread::hardware_concurrency();
+        if (hardware > 1) {
+            threadCounts.push_back(hardware);
+        }
+    }
+
+    std::cerr << "Generating " << config.files << " files under " << root.string() << "..." << std::endl;
+    fs::remove_all(root);
+    TreeStats stats;
+    if (!GenerateTree(config, root, stats)) {
+        return 1;
+    }
+    const std::string basePath = (root / "base.csv").string();
+    const std::string compiledPath = (root / "base.db").string();
+    const std::string treePath = (root / "tree").string();
+    const std::string logPath = (root / "scan.log").string();
+
+    MalwareScanner scanner;
+    if (!scanner.LoadMalwareBase(basePath)) {
+        std::cerr << "Error: Could not load generated base" << std::endl;
+        return 1;
+    }
+    double csvLoadTime = scanner.GetLoadReport().loadTime;
+    scanner.SaveCompiledBase(compiledPath);
+    if (!scanner.LoadMalwareBase(compiledPath)) {
+        std::cerr << "Error: Could not load compiled base" << std::endl;
+        return 1;
+    }
+    double compiledLoadTime = scanner.GetLoadReport().loadTime;
+
+    std::ostringstream json;
+    json << "{\n  \"config\": {\"files\": " << stats.files
+         << ", \"directories\": " << stats.directories
+         << ", \"bytes\": " << stats.bytes
+         << ", \"hits\": " << stats.hits
+         << ", \"signatures\": " << stats.hits + config.signatures
+         << ", \"depth\": " << config.depth
+         << ", \"fanout\": " << config.fanout
+         << ", \"minSize\": " << config.minSize
+         << ", \"maxSize\": " << config.maxSize
+         << ", \"largeFraction\": " << config.largeFraction
+         << ", \"largeSize\": " << config.largeSize
+         << ", \"seed\": " << config.seed << "},\n";
+    json << "  \"baseLoad\": {\"csvSeconds\": " << csvLoadTime
+         << ", \"compiledSeconds\": " << compiledLoadTime << "},\n";
+    json << "  \"runs\": [";
+
+    std::cout << "threads reader  run   files/s       MB/s   seconds  peakRSS(MB)" << std::endl;
+    bool mismatch = false;
+    bool firstRun = true;
+    for (size_t threads : threadCounts) {
+        for (ReadBackend reader : readers) {
+            for (size_t run = 0; run < repeat; ++run) {
+                ScanOptions options;
+                options.threadCount = threads;
+                options.readBackend = reader;
+                options.collectMetrics = true;
+
+                ResetPeakRss();
+                ScanResult result = scanner.ScanDirectory(treePath, logPath, options);
+                uint64_t peakRss = PeakRssBytes();
+
+                double seconds = std::max(result.executionTime, 1e-9);
+                double filesPerSecond = result.totalFiles / seconds;
+                double megabytesPerSecond = stats.bytes / seconds / (1 << 20);
+                if (result.maliciousFiles != stats.hits || result.errorCount != 0) {
+                    std::cerr << "Warning: expected " << stats.hits << " hits, got "
+                              << result.maliciousFiles << " with " << result.errorCount
+                              << " errors" << std::endl;
+                    mismatch = true;
+                }
+
+                std::cout << std::setw(7) << threads << " " << std::setw(6) << ReaderName(reader)
+                          << " " << std::setw(4) << run
+                          << " " << std::setw(9) << std::fixed << std::setprecision(0) << filesPerSecond
+                          << " " << std::setw(10) << std::setprecision(1) << megabytesPerSecond
+                          << " " << std::setw(9) << std::setprecision(3) << seconds
+                          << " " << std::setw(12) << std::setprecision(1) << peakRss / double(1 << 20)
+                          << std::defaultfloat << std::endl;
+
+                json << (firstRun ? "\n" : ",\n")
+                     << "    {\"threads\": " << threads
+                     << ", \"reader\": \"" << ReaderName(reader) << "\""
+                     << ", \"run\": " << run
+                     << ", \"filesPerSecond\": " << filesPerSecond
+                     << ", \"megabytesPerSecond\": " << megabytesPerSecond
+                     << ", \"peakRssBytes\": " << peakRss
+                     << ", \"result\": " << ScanResultToJson(result) << "    }";
+                firstRun = false;
+            }
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (!outputPath.empty()) {
+        std::ofstream output(outputPath);
+        output << json.str();
+        if (!output) {
+            std::cerr << "Error: Could not write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    if (!keep) {
+        fs::remove_all(root);
+    }
+    return mismatch ? 2 : 0;
+}
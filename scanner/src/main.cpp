@@ -1,32 +1,413 @@
 #include "scanner/scanner.hpp"
+#include "scanner/scan_server.hpp"
+#include "scanner/scan_coordinator.hpp"
+#include "scanner/scan_filter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::atomic<bool> stopWatching{false};
+
+// Byte count with an optional K, M or G suffix (powers of 1024)
+uint64_t ParseBytes(const std::string& text) {
+    size_t end = 0;
+    uint64_t value = std::stoull(text, &end);
+    if (end < text.size()) {
+        switch (text[end]) {
+        case 'K': case 'k': return value << 10;
+        case 'M': case 'm': return value << 20;
+        case 'G': case 'g': return value << 30;
+        default: throw std::invalid_argument("bad size suffix: " + text);
+        }
+    }
+    return value;
+}
+
+void StopWatching(int) {
+    stopWatching = true;
+}
+
+#ifndef _WIN32
+ScanServer* activeServer = nullptr;
+
+void StopServer(int) {
+    if (activeServer) {
+        activeServer->Stop();
+    }
+}
+
+std::atomic<bool> reloadRequested{false};
+
+void RequestReload(int) {
+    reloadRequested = true;
+}
+
+// Reloads the base (and pattern base, if any) on SIGHUP while the daemon or
+// a watch runs. The new base is built on this thread; scans switch to it
+// once it is published.
+class BaseReloader {
+public:
+    BaseReloader(MalwareScanner& scanner, std::string basePath, std::string patternPath,
+                 size_t threadCount, const BaseFilterOptions& filter)
+        : scanner_(scanner), basePath_(std::move(basePath)), patternPath_(std::move(patternPath)),
+          threadCount_(threadCount), filter_(filter) {
+        std::signal(SIGHUP, RequestReload);
+        thread_ = std::thread([this] { Run(); });
+    }
+
+    ~BaseReloader() {
+        std::signal(SIGHUP, SIG_DFL);
+        stop_ = true;
+        thread_.join();
+    }
+
+private:
+    void Run() {
+        while (!stop_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (!reloadRequested.exchange(false)) {
+                continue;
+            }
+            if (scanner_.LoadMalwareBase(basePath_, threadCount_, filter_)) {
+                BaseLoadReport load = scanner_.GetLoadReport();
+                std::cout << "Reloaded " << load.signatures << " signatures in " << load.loadTime
+                          << " seconds" << std::endl;
+            } else {
+                std::cerr << "Error: Could not reload malware base from " << basePath_
+                          << ", keeping the previous one" << std::endl;
+            }
+            if (patternPath_.empty()) {
+                continue;
+            }
+            if (scanner_.LoadPatternBase(patternPath_)) {
+                std::cout << "Reloaded " << scanner_.GetPatternReport().signatures << " patterns" << std::endl;
+            } else {
+                std::cerr << "Error: Could not reload pattern base from " << patternPath_
+                          << ", keeping the previous one" << std::endl;
+            }
+        }
+    }
+
+    MalwareScanner& scanner_;
+    std::string basePath_;
+    std::string patternPath_;
+    size_t threadCount_;
+    BaseFilterOptions filter_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+// Scan options a spawned worker daemon takes over, with their value counts.
+// Logs, caches, checkpoints and metrics stay with the coordinator.
+const std::pair<const char*, int> WORKER_OPTIONS[] = {
+    {"--base", 1}, {"--patterns", 1}, {"--filter-bits", 1}, {"--threads", 1}, {"--adaptive", 0},
+    {"--max-read-rate", 1}, {"--max-cpu", 1}, {"--low-priority", 0}, {"--queue", 1}, {"--reader", 1},
+    {"--small-batch", 1}, {"--no-size-gate", 0}, {"--digests", 1}, {"--archive-depth", 1},
+    {"--serial-walk", 0}, {"--no-dedupe", 0}, {"--rules", 1}, {"--exclude", 1}, {"--include", 1},
+};
+
+// Directory only this user can enter (mkdtemp makes it 0700), removed with
+// everything in it
+class PrivateDirectory {
+public:
+    bool Create(const std::string& prefix) {
+        std::string pattern = (fs::temp_directory_path() / (prefix + "XXXXXX")).string();
+        if (!mkdtemp(&pattern[0])) {
+            return false;
+        }
+        path_ = pattern;
+        return true;
+    }
+
+    ~PrivateDirectory() {
+        if (!path_.empty()) {
+            std::error_code ec;
+            fs::remove_all(path_, ec);
+        }
+    }
+
+    const std::string& Path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+// Scans `scanPath` on daemons: the ones listening on `sockets` (comma
+// separated) and `spawn` started from this executable
+int RunCoordinator(int argc, char* argv[], const std::string& sockets, size_t spawn,
+                   const CoordinatorOptions& options, const std::string& scanPath, const std::string& logPath) {
+    // Sockets of spawned workers; another user must not be able to put
+    // a daemon of their own where the coordinator connects. Outlives the workers.
+    PrivateDirectory socketDirectory;
+    std::vector<std::unique_ptr<ShardTransport>> workers;
+    for (size_t pos = 0; pos < sockets.size();) {
+        size_t comma = std::min(sockets.find(',', pos), sockets.size());
+        if (comma > pos) {
+            workers.push_back(std::make_unique<SocketTransport>(sockets.substr(pos, comma - pos)));
+        }
+        pos = comma + 1;
+    }
+
+    if (spawn > 0) {
+        std::vector<std::string> args;
+        for (int i = 1; i < argc; ++i) {
+            for (const auto& option : WORKER_OPTIONS) {
+                if (option.first == std::string(argv[i]) && i + option.second < argc) {
+                    for (int k = 0; k <= option.second; ++k) {
+                        args.push_back(argv[i + k]);
+                    }
+                    i += option.second;
+                    break;
+                }
+            }
+        }
+        std::error_code ec;
+        fs::path self = fs::read_symlink("/proc/self/exe", ec);
+        std::string executable = ec ? fs::absolute(argv[0]).string() : self.string();
+        if (!socketDirectory.Create("scanner_workers_")) {
+            std::cerr << "Error: Could not create a directory for worker sockets" << std::endl;
+            return 1;
+        }
+        std::cout << "Starting " << spawn << " scan workers..." << std::endl;
+        for (size_t i = 0; i < spawn; ++i) {
+            std::string socket = (fs::path(socketDirectory.Path()) / ("worker_" + std::to_string(i) + ".sock")).string();
+            auto worker = std::make_unique<LocalWorkerProcess>(executable, args, socket);
+            if (!worker->Start()) {
+                std::cerr << "Error: Scan worker " << i << " did not start" << std::endl;
+                return 1;
+            }
+            workers.push_back(std::move(worker));
+        }
+    }
+
+    std::cout << "Starting coordinated scan of directory: " << scanPath << std::endl;
+    std::cout << "Workers: " << workers.size() << std::endl;
+    ScanCoordinator coordinator(std::move(workers), options);
+    ScanResult result = coordinator.Scan(scanPath, logPath);
+
+    std::cout << "\n=== Scan Results ===" << std::endl;
+    std::cout << "Total files processed: " << result.totalFiles << std::endl;
+    std::cout << "Malicious files found: " << result.maliciousFiles << std::endl;
+    std::cout << "Errors encountered: " << result.errorCount << std::endl;
+    if (result.filteredFiles > 0 || result.filteredDirectories > 0) {
+        std::cout << "Filtered while splitting: " << result.filteredFiles << " files, "
+                  << result.filteredDirectories << " directories" << std::endl;
+    }
+    for (const auto& worker : coordinator.Workers()) {
+        std::cout << "Worker " << worker.name << ": " << worker.shards << " shards, " << worker.files
+                  << " files, busy " << worker.busyTime << " seconds" << (worker.failed ? ", failed" : "")
+                  << std::endl;
+    }
+    std::cout << "Execution time: " << result.executionTime << " seconds" << std::endl;
+    if (result.maliciousFiles > 0) {
+        std::cout << "WARNING: Malicious files detected! Check log file for details." << std::endl;
+    }
+    return result.errorCount > 0 && result.totalFiles == 0 ? 1 : 0;
+}
+#endif
+
+} // namespace
 
 void PrintUsage() {
     std::cout << "Usage: scanner.exe --base <base.csv> --log <report.log> --path <directory>\n";
+    std::cout << "       scanner.exe --base <base.csv> --compile <base.db>\n";
+    std::cout << "       scanner.exe --base <base.csv> --daemon <socket>\n";
+    std::cout << "       scanner.exe --connect <socket> --path <path> | --file-list <list.txt>\n";
     std::cout << "Options:\n";
-    std::cout << "  --base    Path to malware base CSV file\n";
+    std::cout << "  --base    Path to malware base (CSV or compiled)\n";
+    std::cout << "  --patterns <file> Byte-pattern signatures (hexbytes;verdict lines) matched while files are hashed\n";
+    std::cout << "  --compile Write the base in compiled binary form and exit\n";
+    std::cout << "  --filter-bits <n> Bloom filter bits per signature for a CSV base, 0 - none\n";
+    std::cout << "                  (default: 16 for bases of 1M signatures and more)\n";
     std::cout << "  --log     Path to output log file\n";
     std::cout << "  --path    Path to directory to scan\n";
-    std::cout << "  --threads Number of threads (optional, default: auto)\n";
+    std::cout << "  --threads Number of threads; fixed unless --adaptive is given too\n";
+    std::cout << "            (default: adaptive, up to every hardware thread)\n";
+    std::cout << "  --adaptive      Tune the number of active threads from measured throughput\n";
+    std::cout << "  --max-read-rate <bytes> Read at most this many bytes per second (K, M, G suffixes)\n";
+    std::cout << "  --max-cpu <share> Use at most this share of all hardware threads, e.g. 0.25\n";
+    std::cout << "  --low-priority  Run scan threads at nice 19 with idle I/O priority (Linux)\n";
+    std::cout << "  --queue   Paths buffered between traversal and hashing (optional, default: 4096)\n";
+    std::cout << "  --reader  File read backend: stream, mmap or direct (optional, default: stream)\n";
+    std::cout << "  --small-batch <n> Files up to 16 KB read together, n per batch, 0 - one by one (default: 32)\n";
+    std::cout << "  --no-size-gate  Hash every file even if the base lists sizes\n";
+    std::cout << "  --digests <list> Digests computed per file, e.g. md5,sha256 (default: those the base lists)\n";
+    std::cout << "  --archive-depth <n> Also scan members of tar, gzip and zip files, n levels deep (a .tar.gz takes 2)\n";
+    std::cout << "  --serial-walk   Enumerate directories on one thread\n";
+    std::cout << "  --rules <file>  Include/exclude rules, one per line: exclude|include <glob>,\n";
+    std::cout << "                  exclude-ext|include-ext <ext,...>, min-size|max-size <bytes>,\n";
+    std::cout << "                  min-age|max-age <days>; excluded directories are not opened\n";
+    std::cout << "  --exclude <glob> / --include <glob> One more such rule (repeatable)\n";
+    std::cout << "  --watch         Keep scanning files as they are written under --path until interrupted (Linux)\n";
+    std::cout << "  --watch-settle-ms Quiet time after the last write before a file is scanned (default: 500)\n";
+    std::cout << "  --watch-initial   With --watch: scan the existing files first\n";
+    std::cout << "  --no-dedupe     Hash every hardlink and bind-mounted copy separately\n";
+    std::cout << "  --cache   Persistent scan cache file; unchanged files are not re-read\n";
+    std::cout << "  --cache-compact Drop cache entries of files not seen in this scan\n";
+    std::cout << "  --checkpoint <file> Save scan progress to this file every few seconds (removed when done)\n";
+    std::cout << "  --checkpoint-ms <n> Time between checkpoints (default: 5000)\n";
+    std::cout << "  --resume        Go on from the --checkpoint file left by a scan that did not finish\n";
+    std::cout << "  --log-flush-ms  Longest time a detection stays buffered, 0 - write at once (default: 100)\n";
+    std::cout << "  --log-sync      Sync the log to disk after every write\n";
+    std::cout << "  --metrics <file.json> Collect per-phase metrics and write them with the results\n";
+    std::cout << "  --daemon <socket>  Keep the base loaded and serve scan requests on a Unix socket\n";
+    std::cout << "  --connect <socket> Send the scan to a running daemon and print its replies\n";
+    std::cout << "  --file-list <file> With --connect: scan the files listed one per line\n";
+    std::cout << "  --workers <socket,...> Split --path over these daemons and merge their results into --log\n";
+    std::cout << "  --spawn-workers <n> Same with n daemons started from this executable (--base, --threads\n";
+    std::cout << "                  and the other scan options apply to each of them)\n";
+    std::cout << "  --shards-per-worker <n> Subtrees the scan is split into per worker (default: 8)\n";
+    std::cout << "  --shard-timeout-ms <n> A worker taking longer for one shard is dropped and the shard\n";
+    std::cout << "                  moves to another one, 0 - no limit (default: 1800000)\n";
     std::cout << "  --help    Show this help message\n";
+    std::cout << "\nWith --daemon or --watch, SIGHUP reloads --base without stopping scans.\n";
 }
 
 int main(int argc, char* argv[]) {
-    std::string basePath, logPath, scanPath;
-    size_t threadCount = 1; // Default to single-threaded for stability
+    std::string basePath, patternPath, logPath, scanPath, compilePath, metricsPath;
+    std::string daemonSocket, connectSocket, fileListPath;
+    std::string workerSockets;
+    std::string rulesPath;
+    std::vector<std::string> filterRules;
+    size_t spawnWorkers = 0;
+    CoordinatorOptions coordinator;
+    ScanOptions options;
+    BaseFilterOptions filter;
+    WatchOptions watchOptions;
+    bool watchMode = false;
+    // As many threads as pay off, up to all of them
+    options.threadCount = 0;
+    options.throttle.adaptive = true;
+    bool fixedThreads = false, adaptive = false;
 
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--base" && i + 1 < argc) {
             basePath = argv[++i];
+        } else if (arg == "--patterns" && i + 1 < argc) {
+            patternPath = argv[++i];
+        } else if (arg == "--compile" && i + 1 < argc) {
+            compilePath = argv[++i];
+        } else if (arg == "--filter-bits" && i + 1 < argc) {
+            filter.bitsPerKey = std::stoul(argv[++i]);
+            filter.minSignatures = 0;
         } else if (arg == "--log" && i + 1 < argc) {
             logPath = argv[++i];
         } else if (arg == "--path" && i + 1 < argc) {
             scanPath = argv[++i];
         } else if (arg == "--threads" && i + 1 < argc) {
-            threadCount = std::stoul(argv[++i]);
+            options.threadCount = std::stoul(argv[++i]);
+            fixedThreads = true;
+        } else if (arg == "--adaptive") {
+            adaptive = true;
+        } else if (arg == "--max-read-rate" && i + 1 < argc) {
+            options.throttle.maxBytesPerSecond = ParseBytes(argv[++i]);
+        } else if (arg == "--max-cpu" && i + 1 < argc) {
+            options.throttle.maxCpuShare = std::stod(argv[++i]);
+        } else if (arg == "--low-priority") {
+            options.throttle.lowPriority = true;
+        } else if (arg == "--queue" && i + 1 < argc) {
+            options.queueDepth = std::stoul(argv[++i]);
+        } else if (arg == "--reader" && i + 1 < argc) {
+            std::string reader = argv[++i];
+            if (reader == "stream") {
+                options.readBackend = ReadBackend::Stream;
+            } else if (reader == "mmap") {
+                options.readBackend = ReadBackend::Mmap;
+            } else if (reader == "direct") {
+                options.readBackend = ReadBackend::Direct;
+            } else {
+                std::cerr << "Unknown reader: " << reader << std::endl;
+                PrintUsage();
+                return 1;
+            }
+        } else if (arg == "--small-batch" && i + 1 < argc) {
+            options.smallFileBatch = std::stoul(argv[++i]);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            options.cachePath = argv[++i];
+        } else if (arg == "--cache-compact") {
+            options.compactCache = true;
+        } else if (arg == "--digests" && i + 1 < argc) {
+            std::string list = argv[++i];
+            options.digestTypes = 0;
+            for (size_t pos = 0; pos <= list.size();) {
+                size_t comma = std::min(list.find(',', pos), list.size());
+                std::string name = list.substr(pos, comma - pos);
+                DigestSet bit = 0;
+                for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+                    if (name == DigestTypeName(static_cast<DigestType>(t))) {
+                        bit = DigestBit(static_cast<DigestType>(t));
+                    }
+                }
+                if (bit == 0) {
+                    std::cerr << "Unknown digest: " << name << std::endl;
+                    PrintUsage();
+                    return 1;
+                }
+                options.digestTypes |= bit;
+                pos = comma + 1;
+            }
+        } else if (arg == "--archive-depth" && i + 1 < argc) {
+            options.archiveDepth = std::stoul(argv[++i]);
+        } else if (arg == "--no-size-gate") {
+            options.sizeGating = false;
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpointPath = argv[++i];
+        } else if (arg == "--checkpoint-ms" && i + 1 < argc) {
+            options.checkpointIntervalMs = std::stoul(argv[++i]);
+        } else if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg == "--log-flush-ms" && i + 1 < argc) {
+            options.logFlush.intervalMs = std::stoul(argv[++i]);
+        } else if (arg == "--log-sync") {
+            options.logFlush.syncEachBatch = true;
+        } else if (arg == "--daemon" && i + 1 < argc) {
+            daemonSocket = argv[++i];
+        } else if (arg == "--connect" && i + 1 < argc) {
+            connectSocket = argv[++i];
+        } else if (arg == "--file-list" && i + 1 < argc) {
+            fileListPath = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workerSockets = argv[++i];
+        } else if (arg == "--spawn-workers" && i + 1 < argc) {
+            spawnWorkers = std::stoul(argv[++i]);
+        } else if (arg == "--shards-per-worker" && i + 1 < argc) {
+            coordinator.shardsPerWorker = std::stoul(argv[++i]);
+        } else if (arg == "--shard-timeout-ms" && i + 1 < argc) {
+            coordinator.shardTimeoutMs = std::stoul(argv[++i]);
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metricsPath = argv[++i];
+            options.collectMetrics = true;
+        } else if (arg == "--serial-walk") {
+            options.parallelTraversal = false;
+        } else if (arg == "--watch") {
+            watchMode = true;
+        } else if (arg == "--watch-settle-ms" && i + 1 < argc) {
+            watchOptions.settleMs = std::stoul(argv[++i]);
+        } else if (arg == "--watch-initial") {
+            watchOptions.initialScan = true;
+        } else if (arg == "--no-dedupe") {
+            options.dedupeInodes = false;
+        } else if (arg == "--rules" && i + 1 < argc) {
+            rulesPath = argv[++i];
+        } else if ((arg == "--exclude" || arg == "--include") && i + 1 < argc) {
+            filterRules.push_back(arg.substr(2) + " " + argv[++i]);
         } else if (arg == "--help") {
             PrintUsage();
             return 0;
@@ -36,8 +417,86 @@ int main(int argc, char* argv[]) {
             return 1;
         }
     }
+    if (fixedThreads && !adaptive) {
+        options.throttle.adaptive = false;
+    }
+    if (options.resume && options.checkpointPath.empty()) {
+        std::cerr << "Error: --resume needs --checkpoint" << std::endl;
+        PrintUsage();
+        return 1;
+    }
+    if (!rulesPath.empty() || !filterRules.empty()) {
+        // Rules of the file first, so that its line numbers hold in errors
+        std::vector<std::string> rules;
+        if (!rulesPath.empty()) {
+            std::ifstream file(rulesPath);
+            if (!file) {
+                std::cerr << "Error: Could not read rules from " << rulesPath << std::endl;
+                return 1;
+            }
+            for (std::string line; std::getline(file, line);) {
+                rules.push_back(line);
+            }
+        }
+        rules.insert(rules.end(), filterRules.begin(), filterRules.end());
+        auto scanFilter = std::make_shared<ScanFilter>();
+        std::string error;
+        if (!scanFilter->Compile(rules, error)) {
+            std::cerr << "Error: Bad scan rule, " << error << std::endl;
+            return 1;
+        }
+        options.filter = scanFilter;
+        coordinator.filter = scanFilter;
+    }
+
+#ifndef _WIN32
+    if (!connectSocket.empty()) {
+        std::string request;
+        if (!fileListPath.empty()) {
+            std::ifstream list(fileListPath);
+            if (!list) {
+                std::cerr << "Error: Could not read file list " << fileListPath << std::endl;
+                return 1;
+            }
+            request = "FILES\n";
+            for (std::string line; std::getline(list, line);) {
+                if (!line.empty()) {
+                    request += line + "\n";
+                }
+            }
+            request += "\n";
+        } else if (!scanPath.empty()) {
+            request = "SCAN " + scanPath + "\n";
+        } else {
+            std::cerr << "Error: Missing required arguments" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+        if (!SendScanRequest(connectSocket, request, std::cout)) {
+            std::cerr << "Error: Scan request to " << connectSocket << " failed" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-    if (basePath.empty() || logPath.empty() || scanPath.empty()) {
+    if (!workerSockets.empty() || spawnWorkers > 0) {
+        if (logPath.empty() || scanPath.empty() || (spawnWorkers > 0 && basePath.empty())) {
+            std::cerr << "Error: Missing required arguments" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+        if (coordinator.filter && !coordinator.filter->PathIndependent()) {
+            std::cerr << "Error: Workers take only exclude rules without '/' besides extensions and limits"
+                      << std::endl;
+            return 1;
+        }
+        return RunCoordinator(argc, argv, workerSockets, spawnWorkers, coordinator, scanPath, logPath);
+    }
+#endif
+
+    bool daemonMode = !daemonSocket.empty();
+    if (basePath.empty() ||
+        (!daemonMode && compilePath.empty() && (logPath.empty() || scanPath.empty()))) {
         std::cerr << "Error: Missing required arguments" << std::endl;
         PrintUsage();
         return 1;
@@ -45,25 +504,144 @@ int main(int argc, char* argv[]) {
 
     MalwareScanner scanner;
     
-    if (!scanner.LoadMalwareBase(basePath)) {
+    if (!scanner.LoadMalwareBase(basePath, options.threadCount, filter)) {
         std::cerr << "Error: Could not load malware base from " << basePath << std::endl;
         return 1;
     }
 
+    BaseLoadReport load = scanner.GetLoadReport();
+    std::cout << "Loaded " << load.signatures << " signatures in " << load.loadTime << " seconds" << std::endl;
+    if (load.filterBytes > 0) {
+        std::cout << "Signature filter: " << load.filterBytes << " bytes" << std::endl;
+    }
+    if (load.malformedLines > 0) {
+        std::cerr << "Warning: skipped " << load.malformedLines << " malformed base lines" << std::endl;
+        for (const auto& sample : load.malformedSamples) {
+            std::cerr << "  " << sample << std::endl;
+        }
+    }
+
+    if (!patternPath.empty()) {
+        if (!scanner.LoadPatternBase(patternPath)) {
+            std::cerr << "Error: Could not load pattern base from " << patternPath << std::endl;
+            return 1;
+        }
+        BaseLoadReport patterns = scanner.GetPatternReport();
+        std::cout << "Loaded " << patterns.signatures << " byte patterns in " << patterns.loadTime
+                  << " seconds" << std::endl;
+        if (patterns.malformedLines > 0) {
+            std::cerr << "Warning: skipped " << patterns.malformedLines << " malformed pattern lines" << std::endl;
+            for (const auto& sample : patterns.malformedSamples) {
+                std::cerr << "  " << sample << std::endl;
+            }
+        }
+    }
+
+    if (!compilePath.empty()) {
+        if (!scanner.SaveCompiledBase(compilePath)) {
+            std::cerr << "Error: Could not write compiled base to " << compilePath << std::endl;
+            return 1;
+        }
+        std::cout << "Compiled base written to " << compilePath << std::endl;
+        if (scanPath.empty() && !daemonMode) {
+            return 0;
+        }
+    }
+
+#ifndef _WIN32
+    if (daemonMode) {
+        ScanServer server(scanner, options);
+        if (!server.Listen(daemonSocket)) {
+            return 1;
+        }
+        activeServer = &server;
+        std::signal(SIGINT, StopServer);
+        std::signal(SIGTERM, StopServer);
+        BaseReloader reloader(scanner, basePath, patternPath, options.threadCount, filter);
+        std::cout << "Serving scan requests on " << daemonSocket << std::endl;
+        server.Run();
+        activeServer = nullptr;
+        return 0;
+    }
+#endif
+
+    if (watchMode) {
+        options.onDetection = [](const std::string& filePath, const std::string& hash,
+                                 std::string_view verdict) {
+            std::cout << "FOUND " << filePath << ";" << hash << ";" << verdict << std::endl;
+        };
+        std::signal(SIGINT, StopWatching);
+        std::signal(SIGTERM, StopWatching);
+#ifndef _WIN32
+        BaseReloader reloader(scanner, basePath, patternPath, options.threadCount, filter);
+#endif
+        std::cout << "Watching directory: " << scanPath << std::endl;
+        ScanResult result = scanner.Watch(scanPath, logPath, options, watchOptions, stopWatching);
+        std::cout << "\n=== Watch Results ===" << std::endl;
+        std::cout << "Files scanned: " << result.totalFiles << std::endl;
+        std::cout << "Malicious files found: " << result.maliciousFiles << std::endl;
+        std::cout << "Errors encountered: " << result.errorCount << std::endl;
+        return result.errorCount > 0 && result.totalFiles == 0 ? 1 : 0;
+    }
+
     std::cout << "Starting scan of directory: " << scanPath << std::endl;
     std::cout << "Using malware base: " << basePath << std::endl;
     std::cout << "Log file: " << logPath << std::endl;
-    std::cout << "Threads: " << threadCount << std::endl;
+    if (options.throttle.adaptive) {
+        std::cout << "Threads: adaptive, up to " << (options.threadCount ? options.threadCount
+                                                     : std::max(1u, std::thread::hardware_concurrency()))
+                  << std::endl;
+    } else {
+        std::cout << "Threads: " << options.threadCount << std::endl;
+    }
     std::cout << "Scanning..." << std::endl;
 
     try {
-        ScanResult result = scanner.ScanDirectory(scanPath, logPath, threadCount);
+        ScanResult result = scanner.ScanDirectory(scanPath, logPath, options);
 
         std::cout << "\n=== Scan Results ===" << std::endl;
         std::cout << "Total files processed: " << result.totalFiles << std::endl;
         std::cout << "Malicious files found: " << result.maliciousFiles << std::endl;
         std::cout << "Errors encountered: " << result.errorCount << std::endl;
+        if (!options.cachePath.empty()) {
+            std::cout << "Cache hits: " << result.cacheHits << std::endl;
+        }
+        if (result.skippedBySize > 0) {
+            std::cout << "Skipped by size: " << result.skippedBySize << " files, "
+                      << result.bytesSkippedBySize << " bytes" << std::endl;
+        }
+        if (result.dedupedFiles > 0 || result.dedupedDirectories > 0) {
+            std::cout << "Deduplicated: " << result.dedupedFiles << " files, "
+                      << result.dedupedBytes << " bytes, "
+                      << result.dedupedDirectories << " directories" << std::endl;
+        }
+        if (result.filteredFiles > 0 || result.filteredDirectories > 0) {
+            std::cout << "Filtered: " << result.filteredFiles << " files, "
+                      << result.filteredDirectories << " directories" << std::endl;
+        }
+        if (options.archiveDepth > 0) {
+            std::cout << "Archive members: " << result.archiveMembers << " scanned, "
+                      << result.skippedMembers << " skipped, "
+                      << result.damagedArchives << " damaged archives" << std::endl;
+        }
+        if (options.throttle.adaptive || result.throttledTime > 0) {
+            std::cout << "Active threads at the end: " << result.activeWorkers
+                      << ", throttled " << result.throttledTime << " thread seconds" << std::endl;
+        }
         std::cout << "Execution time: " << result.executionTime << " seconds" << std::endl;
+        if (result.metrics.collected) {
+            const ScanMetrics& metrics = result.metrics;
+            std::cout << "Thread time: traversal " << metrics.traversalTime
+                      << "s, read " << metrics.readTime
+                      << "s, hash " << metrics.hashTime
+                      << "s, lookup " << metrics.lookupTime
+                      << "s, log " << metrics.logTime << "s" << std::endl;
+            std::ofstream metricsFile(metricsPath);
+            metricsFile << ScanResultToJson(result);
+            if (!metricsFile) {
+                std::cerr << "Error: Could not write metrics to " << metricsPath << std::endl;
+            }
+        }
 
         if (result.maliciousFiles > 0) {
             std::cout << "WARNING: Malicious files detected! Check log file for details." << std::endl;
@@ -75,4 +653,4 @@ int main(int argc, char* argv[]) {
     }
 
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
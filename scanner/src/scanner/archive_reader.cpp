@@ -0,0 +1,705 @@
+#include "archive_reader.hpp"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <zlib.h>
+
+namespace {
+
+const size_t TAR_BLOCK = 512;
+const size_t ZIP_HEADER_SIZE = 30;
+const size_t INFLATE_OUTPUT_SIZE = 64 << 10;
+// Longest GNU long name or pax header that is read; the rest is skipped
+const size_t MAX_NAME_RECORD = 64 << 10;
+// Larger tar sizes are corrupt headers
+const uint64_t MAX_TAR_SIZE = 1ull << 62;
+
+const uint32_t ZIP_LOCAL = 0x04034b50;
+const uint32_t ZIP_CENTRAL = 0x02014b50;
+const uint32_t ZIP_END = 0x06054b50;
+const uint32_t ZIP64_END = 0x06064b50;
+const uint32_t ZIP_DESCRIPTOR = 0x08074b50;
+
+const uint8_t ZIP_MAGIC[] = {'P', 'K', 3, 4};
+const uint8_t GZIP_MAGIC[] = {0x1f, 0x8b, 8}; // with the deflate method byte
+
+uint16_t Load16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+uint32_t Load32(const uint8_t* p) {
+    return static_cast<uint32_t>(Load16(p)) | static_cast<uint32_t>(Load16(p + 2)) << 16;
+}
+
+uint64_t Load64(const uint8_t* p) {
+    return static_cast<uint64_t>(Load32(p)) | static_cast<uint64_t>(Load32(p + 4)) << 32;
+}
+
+// Octal, or base-256 with the top bit of the first byte set (GNU)
+bool ParseTarNumber(const uint8_t* field, size_t size, uint64_t& value) {
+    value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 0; i < size; ++i) {
+            uint8_t byte = i == 0 ? field[0] & 0x7f : field[i];
+            if (value >> 55) {
+                return false;
+            }
+            value = value << 8 | byte;
+        }
+        return true;
+    }
+    size_t i = 0;
+    while (i < size && field[i] == ' ') {
+        ++i;
+    }
+    for (; i < size && field[i] != ' ' && field[i] != 0; ++i) {
+        if (field[i] < '0' || field[i] > '7' || value >> 60) {
+            return false;
+        }
+        value = value << 3 | static_cast<uint64_t>(field[i] - '0');
+    }
+    return true;
+}
+
+// The checksum is the byte sum of the block with its own field as spaces;
+// old implementations summed signed bytes
+bool IsTarHeader(const uint8_t* block) {
+    uint64_t stored;
+    if (!ParseTarNumber(block + 148, 8, stored)) {
+        return false;
+    }
+    int64_t unsignedSum = 0;
+    int64_t signedSum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        uint8_t byte = i >= 148 && i < 156 ? ' ' : block[i];
+        unsignedSum += byte;
+        signedSum += static_cast<int8_t>(byte);
+    }
+    return static_cast<int64_t>(stored) == unsignedSum || static_cast<int64_t>(stored) == signedSum;
+}
+
+std::string CString(const uint8_t* field, size_t size) {
+    const uint8_t* end = std::find(field, field + size, 0);
+    return std::string(reinterpret_cast<const char*>(field), end - field);
+}
+
+std::string TarName(const uint8_t* block) {
+    std::string name = CString(block, 100);
+    if (std::memcmp(block + 257, "ustar", 5) == 0) {
+        std::string prefix = CString(block + 345, 155);
+        if (!prefix.empty()) {
+            name = prefix + "/" + name;
+        }
+    }
+    return name;
+}
+
+// "path" from pax records ("<length> <key>=<value>\n"), empty if absent
+std::string PaxPath(const std::vector<uint8_t>& records) {
+    std::string text(records.begin(), records.end());
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t space = text.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+        size_t length = 0;
+        for (size_t i = pos; i < space; ++i) {
+            if (text[i] < '0' || text[i] > '9' || length > text.size()) {
+                return "";
+            }
+            length = length * 10 + static_cast<size_t>(text[i] - '0');
+        }
+        if (length <= space - pos || pos + length > text.size()) {
+            break;
+        }
+        std::string record = text.substr(space + 1, pos + length - space - 2);
+        if (record.compare(0, 5, "path=") == 0) {
+            return record.substr(5);
+        }
+        pos += length;
+    }
+    return "";
+}
+
+std::string BaseName(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool EndsWith(const std::string& text, const char* suffix) {
+    size_t size = std::strlen(suffix);
+    if (text.size() < size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (std::tolower(static_cast<unsigned char>(text[text.size() - size + i])) != suffix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// zlib inflate state with its output buffer. Raw deflate for zip members,
+// gzip framing (header and trailer checked by zlib) for gzip files.
+class ArchiveReader::Inflater {
+public:
+    enum class Result { NeedInput, End, Error };
+
+    explicit Inflater(bool gzip) : gzip_(gzip), output_(INFLATE_OUTPUT_SIZE) {
+        std::memset(&stream_, 0, sizeof(stream_));
+        ok_ = inflateInit2(&stream_, gzip ? 16 + MAX_WBITS : -MAX_WBITS) == Z_OK;
+        WatchHeader();
+    }
+
+    ~Inflater() {
+        if (ok_) {
+            inflateEnd(&stream_);
+        }
+    }
+
+    void Reset() {
+        if (ok_) {
+            inflateReset(&stream_);
+        }
+        WatchHeader();
+    }
+
+    // Input taken or output made since the last reset
+    bool Started() const { return stream_.total_in > 0; }
+    bool Produced() const { return stream_.total_out > 0; }
+
+    // File name from the gzip header, empty if there is none
+    std::string StoredName() const {
+        if (!gzip_ || header_.done != 1 || !header_.name) {
+            return "";
+        }
+        return CString(name_, sizeof(name_));
+    }
+
+    // Inflates from `data` until it is used up, the stream ends or is
+    // corrupt; `out(bytes, size)` receives the output as it is made
+    template<class OutFn>
+    Result Inflate(const uint8_t* data, size_t size, size_t& consumed, OutFn&& out) {
+        consumed = 0;
+        if (!ok_) {
+            return Result::Error;
+        }
+        for (;;) {
+            uInt chunk = static_cast<uInt>(std::min<size_t>(size, UINT_MAX));
+            stream_.next_in = const_cast<Bytef*>(data);
+            stream_.avail_in = chunk;
+            stream_.next_out = output_.data();
+            stream_.avail_out = static_cast<uInt>(output_.size());
+            int rc = inflate(&stream_, Z_NO_FLUSH);
+            size_t used = chunk - stream_.avail_in;
+            size_t produced = output_.size() - stream_.avail_out;
+            data += used;
+            size -= used;
+            consumed += used;
+            if (produced > 0) {
+                out(output_.data(), produced);
+            }
+            if (rc == Z_STREAM_END) {
+                return Result::End;
+            }
+            if (rc == Z_BUF_ERROR) {
+                if (used == 0 && produced == 0) {
+                    return Result::NeedInput;
+                }
+                continue;
+            }
+            if (rc != Z_OK) {
+                return Result::Error;
+            }
+            // A full output buffer may leave more to flush with no new input
+            if (size == 0 && stream_.avail_out != 0) {
+                return Result::NeedInput;
+            }
+        }
+    }
+
+private:
+    void WatchHeader() {
+        if (gzip_ && ok_) {
+            std::memset(&header_, 0, sizeof(header_));
+            header_.name = name_;
+            header_.name_max = sizeof(name_) - 1;
+            inflateGetHeader(&stream_, &header_);
+        }
+    }
+
+    bool gzip_;
+    bool ok_ = false;
+    z_stream stream_;
+    gz_header header_{};
+    Bytef name_[256] = {};
+    std::vector<Bytef> output_;
+};
+
+ArchiveReader::ArchiveReader(DigestSet types, unsigned depth, std::string name)
+    : types_(types), depth_(depth), name_(std::move(name)) {}
+
+ArchiveReader::~ArchiveReader() = default;
+
+void ArchiveReader::Feed(const uint8_t* data, size_t size, const MemberFn& member) {
+    if (state_ == State::Done) {
+        return;
+    }
+    if (state_ == State::Sniff) {
+        size_t take = std::min(size, TAR_BLOCK - header_.size());
+        header_.insert(header_.end(), data, data + take);
+        data += take;
+        size -= take;
+        if (!Recognize(false)) {
+            return;
+        }
+        // The format parser starts over with the bytes seen so far
+        std::vector<uint8_t> sniffed;
+        sniffed.swap(header_);
+        Process(sniffed.data(), sniffed.size(), member);
+    }
+    Process(data, size, member);
+}
+
+void ArchiveReader::Finish(const MemberFn& member) {
+    if (state_ == State::Sniff) {
+        Recognize(true);
+        std::vector<uint8_t> sniffed;
+        sniffed.swap(header_);
+        Process(sniffed.data(), sniffed.size(), member);
+    }
+
+    switch (state_) {
+    case State::Done:
+    case State::Sniff:
+        break;
+    case State::Header:
+        // A tar may end without its zero blocks; a zip ends with the central
+        // directory, so running out before it means it was cut off
+        if (format_ == Format::Zip || !header_.empty()) {
+            Fail();
+        }
+        break;
+    case State::Inflate:
+        if (format_ == Format::Gzip && gzipEnded_ && !inflater_->Started()) {
+            if (!member_) {
+                BeginMember(inflater_->StoredName());
+            }
+            EndMember(member);
+        } else {
+            Fail();
+        }
+        break;
+    default:
+        Fail();
+        break;
+    }
+    state_ = State::Done;
+}
+
+bool ArchiveReader::Recognize(bool final) {
+    const uint8_t* bytes = header_.data();
+    size_t size = header_.size();
+    if (size >= sizeof(ZIP_MAGIC) && std::memcmp(bytes, ZIP_MAGIC, sizeof(ZIP_MAGIC)) == 0) {
+        format_ = Format::Zip;
+    } else if (size >= sizeof(GZIP_MAGIC) && std::memcmp(bytes, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0) {
+        format_ = Format::Gzip;
+    } else if (size >= TAR_BLOCK && IsTarHeader(bytes)) {
+        format_ = Format::Tar;
+    } else if (size < TAR_BLOCK && !final) {
+        return false;
+    }
+
+    switch (format_) {
+    case Format::Tar:
+    case Format::Zip:
+        state_ = State::Header;
+        break;
+    case Format::Gzip:
+        inflater_ = std::make_unique<Inflater>(true);
+        state_ = State::Inflate;
+        break;
+    case Format::Unknown:
+        state_ = State::Done;
+        break;
+    }
+    return true;
+}
+
+bool ArchiveReader::Fill(const uint8_t*& data, size_t& size, size_t want) {
+    if (header_.size() < want) {
+        size_t take = std::min(size, want - header_.size());
+        header_.insert(header_.end(), data, data + take);
+        data += take;
+        size -= take;
+    }
+    return header_.size() >= want;
+}
+
+void ArchiveReader::Process(const uint8_t* data, size_t size, const MemberFn& member) {
+    while (size > 0 && state_ != State::Done) {
+        switch (state_) {
+        case State::Header:
+            if (format_ == Format::Tar) {
+                if (!Fill(data, size, TAR_BLOCK)) {
+                    return;
+                }
+                TarHeader(member);
+            } else {
+                if (!Fill(data, size, 4)) {
+                    return;
+                }
+                uint32_t signature = Load32(header_.data());
+                if (signature != ZIP_LOCAL) {
+                    // Members are followed by the central directory
+                    if (signature != ZIP_CENTRAL && signature != ZIP_END && signature != ZIP64_END) {
+                        Fail();
+                    }
+                    state_ = State::Done;
+                    break;
+                }
+                if (!Fill(data, size, ZIP_HEADER_SIZE)) {
+                    return;
+                }
+                size_t total = ZIP_HEADER_SIZE + Load16(header_.data() + 26) + Load16(header_.data() + 28);
+                if (!Fill(data, size, total)) {
+                    return;
+                }
+                ZipHeader(member);
+            }
+            break;
+
+        case State::Data: {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(size, remaining_));
+            MemberData(data, take, member);
+            data += take;
+            size -= take;
+            remaining_ -= take;
+            if (remaining_ == 0) {
+                EndMember(member);
+                if (format_ == Format::Tar) {
+                    remaining_ = padding_;
+                    state_ = remaining_ > 0 ? State::Skip : State::Header;
+                } else {
+                    AfterZipMember();
+                }
+            }
+            break;
+        }
+
+        case State::Skip: {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(size, remaining_));
+            data += take;
+            size -= take;
+            remaining_ -= take;
+            if (remaining_ == 0) {
+                if (format_ == Format::Tar) {
+                    state_ = State::Header;
+                } else {
+                    AfterZipMember();
+                }
+            }
+            break;
+        }
+
+        case State::LongName:
+        case State::Pax: {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(size, remaining_));
+            size_t keep = std::min(take, MAX_NAME_RECORD - std::min(MAX_NAME_RECORD, header_.size()));
+            header_.insert(header_.end(), data, data + keep);
+            data += take;
+            size -= take;
+            remaining_ -= take;
+            if (remaining_ == 0) {
+                if (state_ == State::LongName) {
+                    longName_ = CString(header_.data(), header_.size());
+                } else {
+                    std::string path = PaxPath(header_);
+                    if (!path.empty()) {
+                        longName_ = path;
+                    }
+                }
+                header_.clear();
+                remaining_ = padding_;
+                state_ = remaining_ > 0 ? State::Skip : State::Header;
+            }
+            break;
+        }
+
+        case State::Inflate:
+            InflateData(data, size, member);
+            break;
+
+        case State::Descriptor: {
+            // CRC and sizes, with an optional signature in front
+            if (!Fill(data, size, 4)) {
+                return;
+            }
+            size_t want = (Load32(header_.data()) == ZIP_DESCRIPTOR ? 4 : 0) + 4 + (zip64_ ? 16 : 8);
+            if (!Fill(data, size, want)) {
+                return;
+            }
+            header_.clear();
+            state_ = State::Header;
+            break;
+        }
+
+        case State::Sniff:
+        case State::Done:
+            return;
+        }
+    }
+}
+
+void ArchiveReader::TarHeader(const MemberFn& member) {
+    const uint8_t* block = header_.data();
+    if (std::all_of(block, block + TAR_BLOCK, [](uint8_t byte) { return byte == 0; })) {
+        state_ = State::Done; // end-of-archive marker
+        return;
+    }
+    uint64_t size;
+    if (!IsTarHeader(block) || !ParseTarNumber(block + 124, 12, size) || size > MAX_TAR_SIZE) {
+        Fail();
+        return;
+    }
+    uint64_t padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+    char type = static_cast<char>(block[156]);
+    std::string name = TarName(block);
+    header_.clear();
+
+    switch (type) {
+    case 'L': // GNU long name of the next entry
+    case 'x': // pax attributes of the next entry
+        state_ = type == 'L' ? State::LongName : State::Pax;
+        remaining_ = size;
+        padding_ = padded - size;
+        if (size == 0) {
+            state_ = padding_ > 0 ? State::Skip : State::Header;
+            remaining_ = padding_;
+        }
+        return;
+    case '0':
+    case '\0':
+    case '7': // contiguous file
+        if (!longName_.empty()) {
+            name = std::move(longName_);
+            longName_.clear();
+        }
+        BeginMember(std::move(name));
+        remaining_ = size;
+        padding_ = padded - size;
+        if (size == 0) {
+            EndMember(member);
+            state_ = State::Header;
+        } else {
+            state_ = State::Data;
+        }
+        return;
+    default:
+        // Directories, links, devices, global pax headers; sparse files
+        // would need their map to be hashed
+        if (type == 'S') {
+            skipped_++;
+        }
+        longName_.clear();
+        remaining_ = padded;
+        state_ = remaining_ > 0 ? State::Skip : State::Header;
+        return;
+    }
+}
+
+void ArchiveReader::ZipHeader(const MemberFn& member) {
+    const uint8_t* header = header_.data();
+    uint16_t flags = Load16(header + 6);
+    uint16_t method = Load16(header + 8);
+    uint64_t compressedSize = Load32(header + 18);
+    uint64_t size = Load32(header + 22);
+    size_t nameLength = Load16(header + 26);
+    size_t extraLength = Load16(header + 28);
+    std::string name(reinterpret_cast<const char*>(header) + ZIP_HEADER_SIZE, nameLength);
+
+    // Zip64 extra field: 64-bit sizes for the fields that are all ones
+    zip64_ = false;
+    const uint8_t* extra = header + ZIP_HEADER_SIZE + nameLength;
+    const uint8_t* extraEnd = extra + extraLength;
+    while (extraEnd - extra >= 4) {
+        uint16_t id = Load16(extra);
+        size_t length = Load16(extra + 2);
+        extra += 4;
+        if (length > static_cast<size_t>(extraEnd - extra)) {
+            break;
+        }
+        if (id == 1) {
+            zip64_ = true;
+            const uint8_t* field = extra;
+            if (size == 0xFFFFFFFF && field + 8 <= extra + length) {
+                size = Load64(field);
+                field += 8;
+            }
+            if (compressedSize == 0xFFFFFFFF && field + 8 <= extra + length) {
+                compressedSize = Load64(field);
+            }
+        }
+        extra += length;
+    }
+    header_.clear();
+
+    // With a data descriptor the sizes usually follow the data instead
+    zipDescriptor_ = (flags & 8) != 0;
+    zipSizeKnown_ = !zipDescriptor_ || compressedSize != 0;
+    remaining_ = compressedSize;
+
+    const bool encrypted = (flags & 1) != 0;
+    const bool directory = !name.empty() && name.back() == '/';
+    if (encrypted || (method != 0 && method != 8)) {
+        if (!directory) {
+            skipped_++;
+        }
+        if (!zipSizeKnown_) {
+            state_ = State::Done; // the end of the data cannot be found
+        } else if (remaining_ > 0) {
+            state_ = State::Skip;
+        } else {
+            AfterZipMember();
+        }
+        return;
+    }
+    if (directory && zipSizeKnown_ && compressedSize == 0) {
+        AfterZipMember();
+        return;
+    }
+
+    BeginMember(std::move(name));
+    if (zipSizeKnown_ && compressedSize == 0) {
+        EndMember(member);
+        AfterZipMember();
+    } else if (method == 0) {
+        if (!zipSizeKnown_) {
+            DropMember();
+            skipped_++;
+            state_ = State::Done;
+            return;
+        }
+        state_ = State::Data;
+    } else {
+        if (inflater_) {
+            inflater_->Reset();
+        } else {
+            inflater_ = std::make_unique<Inflater>(false);
+        }
+        state_ = State::Inflate;
+    }
+}
+
+void ArchiveReader::InflateData(const uint8_t*& data, size_t& size, const MemberFn& member) {
+    const bool bounded = format_ == Format::Zip && zipSizeKnown_;
+    size_t available = bounded ? static_cast<size_t>(std::min<uint64_t>(size, remaining_)) : size;
+    size_t consumed = 0;
+    Inflater::Result result = inflater_->Inflate(data, available, consumed,
+        [&](const uint8_t* bytes, size_t count) {
+            if (!member_) {
+                BeginMember(inflater_->StoredName());
+            }
+            MemberData(bytes, count, member);
+        });
+    data += consumed;
+    size -= consumed;
+    if (bounded) {
+        remaining_ -= consumed;
+    }
+
+    switch (result) {
+    case Inflater::Result::NeedInput:
+        if (bounded && remaining_ == 0) {
+            Fail(); // the compressed size ended inside the stream
+        }
+        break;
+    case Inflater::Result::End:
+        if (format_ == Format::Gzip) {
+            // Concatenated gzip streams make up one content
+            gzipEnded_ = true;
+            inflater_->Reset();
+        } else {
+            EndMember(member);
+            if (bounded && remaining_ > 0) {
+                state_ = State::Skip;
+            } else {
+                AfterZipMember();
+            }
+        }
+        break;
+    case Inflater::Result::Error:
+        if (format_ == Format::Gzip && gzipEnded_ && !inflater_->Produced()) {
+            // Trailing bytes after the last stream, such as tape padding
+            if (!member_) {
+                BeginMember(inflater_->StoredName());
+            }
+            EndMember(member);
+            state_ = State::Done;
+        } else {
+            Fail();
+        }
+        break;
+    }
+}
+
+void ArchiveReader::AfterZipMember() {
+    header_.clear();
+    state_ = zipDescriptor_ ? State::Descriptor : State::Header;
+}
+
+void ArchiveReader::BeginMember(std::string name) {
+    if (format_ == Format::Gzip && name.empty()) {
+        name = name_;
+        if (EndsWith(name, ".tgz")) {
+            name.replace(name.size() - 3, 3, "tar");
+        } else if (EndsWith(name, ".gz")) {
+            name.resize(name.size() - 3);
+        }
+    }
+    member_ = std::make_unique<Member>(std::move(name), types_);
+    if (depth_ > 1) {
+        member_->nested = std::make_unique<ArchiveReader>(types_, depth_ - 1, BaseName(member_->name));
+    }
+}
+
+void ArchiveReader::MemberData(const uint8_t* data, size_t size, const MemberFn& member) {
+    member_->hasher.Update(data, size);
+    if (member_->nested) {
+        member_->nested->Feed(data, size, [&](const std::string& name, const FileDigests& digests) {
+            member(member_->name + "!" + name, digests);
+        });
+    }
+}
+
+void ArchiveReader::EndMember(const MemberFn& member) {
+    if (member_->nested) {
+        member_->nested->Finish([&](const std::string& name, const FileDigests& digests) {
+            member(member_->name + "!" + name, digests);
+        });
+    }
+    FileDigests digests;
+    member_->hasher.Final(digests);
+    members_++;
+    member(member_->name, digests);
+    DropMember();
+}
+
+void ArchiveReader::DropMember() {
+    if (member_ && member_->nested) {
+        members_ += member_->nested->Members();
+        skipped_ += member_->nested->SkippedMembers();
+        damaged_ += member_->nested->DamagedArchives();
+    }
+    member_.reset();
+}
+
+void ArchiveReader::Fail() {
+    damaged_++;
+    DropMember();
+    state_ = State::Done;
+}
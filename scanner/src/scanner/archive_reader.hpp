@@ -0,0 +1,107 @@
+#pragma once
+#include "scanner_export.hpp"
+#include "digest.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reads the members of a tar, gzip or zip file out of its bytes while they
+// are being hashed, so nothing is extracted and the file is read once. The
+// format is recognized from the first bytes; anything else is ignored.
+// Every member is hashed on the fly and reported once its last byte went
+// by. Members that are archives themselves are opened the same way up to
+// `depth` levels, a gzip stream counting as a level of its own (a .tar.gz
+// needs two). Memory stays bounded per level whatever the archive size:
+// a header buffer and, for compressed data, one inflate window.
+// Zip members are found through their local headers: a zip with a prefix
+// (self-extracting) is not recognized, and a stored member of unknown size
+// ends the walk.
+class SCANNER_API ArchiveReader {
+public:
+    enum class Format { Unknown, Tar, Gzip, Zip };
+
+    // Called with the member name ("dir/file", nested ones as
+    // "inner.tar!dir/file") and its digests
+    using MemberFn = std::function<void(const std::string& name, const FileDigests& digests)>;
+
+    // `name` is the archive's own file name; a gzip stream without a stored
+    // name reports its content under it, minus the .gz suffix
+    ArchiveReader(DigestSet types, unsigned depth, std::string name);
+    ~ArchiveReader();
+
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    // Next bytes of the archive, in order
+    void Feed(const uint8_t* data, size_t size, const MemberFn& member);
+    // End of the archive; reports what is still open if it is complete
+    void Finish(const MemberFn& member);
+
+    Format GetFormat() const { return format_; }
+    size_t Members() const { return members_; }             // hashed, nested ones included
+    size_t SkippedMembers() const { return skipped_; }      // encrypted or in an unsupported method
+    size_t DamagedArchives() const { return damaged_; }     // this one or nested ones cut off or corrupt
+
+private:
+    class Inflater;
+
+    enum class State {
+        Sniff,       // collecting the first bytes to recognize the format
+        Header,      // tar header block or zip local header
+        Data,        // member bytes, `remaining_` of them
+        Skip,        // bytes not hashed, `remaining_` of them
+        Inflate,     // compressed zip member or gzip stream
+        LongName,    // GNU tar long name, `remaining_` bytes
+        Pax,         // pax extended header, `remaining_` bytes
+        Descriptor,  // zip data descriptor after a member
+        Done         // end of the archive or nothing more can be read
+    };
+
+    struct Member {
+        std::string name;
+        MultiHasher hasher;
+        std::unique_ptr<ArchiveReader> nested;
+
+        Member(std::string memberName, DigestSet types) : name(std::move(memberName)), hasher(types) {}
+    };
+
+    void Process(const uint8_t* data, size_t size, const MemberFn& member);
+    bool Recognize(bool final);
+    // Moves bytes into header_ until it holds `want`
+    bool Fill(const uint8_t*& data, size_t& size, size_t want);
+
+    void TarHeader(const MemberFn& member);
+    void ZipHeader(const MemberFn& member);
+    void InflateData(const uint8_t*& data, size_t& size, const MemberFn& member);
+    void AfterZipMember();
+
+    void BeginMember(std::string name);
+    void MemberData(const uint8_t* data, size_t size, const MemberFn& member);
+    void EndMember(const MemberFn& member);
+    void DropMember();
+    void Fail();
+
+    DigestSet types_;
+    unsigned depth_;
+    std::string name_;
+    Format format_ = Format::Unknown;
+    State state_ = State::Sniff;
+
+    std::vector<uint8_t> header_;
+    uint64_t remaining_ = 0;
+    uint64_t padding_ = 0;        // tar: zero bytes after the member data
+    std::string longName_;        // tar: name for the next header (GNU or pax)
+    bool zipDescriptor_ = false;  // zip: sizes follow the data
+    bool zipSizeKnown_ = false;
+    bool zip64_ = false;
+    bool gzipEnded_ = false;      // gzip: a stream ended, the content is complete
+    std::unique_ptr<Inflater> inflater_;
+    std::unique_ptr<Member> member_;
+
+    size_t members_ = 0;
+    size_t skipped_ = 0;
+    size_t damaged_ = 0;
+};
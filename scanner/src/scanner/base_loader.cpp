@@ -0,0 +1,234 @@
+#include "base_loader.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+const size_t MAX_MALFORMED_SAMPLES = 20;
+
+struct MalformedLine {
+    size_t line; // index within the chunk
+    const char* reason;
+};
+
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    HashBaseBuilder builder;
+    size_t lines = 0;
+    size_t malformed = 0;
+    std::vector<MalformedLine> samples;
+};
+
+// Decimal file size; false unless the field is all digits and fits uint64
+bool ParseSize(std::string_view field, uint64_t& size) {
+    if (field.empty() || field.size() > 19) {
+        return false;
+    }
+    size = 0;
+    for (char c : field) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        size = size * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return true;
+}
+
+// Accepts "hash;verdict" and "hash;size;verdict", the hash being any digest
+// ParseDigestHex knows. Returns nullptr on success or a description of what
+// is wrong with the line.
+const char* ParseBaseLine(std::string_view line, DigestType& type, uint8_t* digest, uint64_t& size,
+                          std::string_view& verdict) {
+    size_t pos = line.find(';');
+    if (pos == std::string_view::npos) {
+        return "missing ';' separator";
+    }
+    if (!ParseDigestHex(line.substr(0, pos), type, digest)) {
+        return "hash is not 32, 40 or 64 hex digits";
+    }
+    verdict = line.substr(pos + 1);
+    size = HashBase::ANY_SIZE;
+
+    size_t sizeEnd = verdict.find(';');
+    if (sizeEnd != std::string_view::npos && ParseSize(verdict.substr(0, sizeEnd), size)) {
+        verdict = verdict.substr(sizeEnd + 1);
+    }
+    if (verdict.empty()) {
+        return "empty verdict";
+    }
+    return nullptr;
+}
+
+void ParseChunk(Chunk& chunk) {
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+        const char* lineEnd = newline ? newline : chunk.end;
+        std::string_view line(p, lineEnd - p);
+        // Remove carriage return if present (for Windows line endings)
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        if (!line.empty()) {
+            DigestType type;
+            uint8_t digest[32];
+            uint64_t size;
+            std::string_view verdict;
+            const char* error = ParseBaseLine(line, type, digest, size, verdict);
+            if (!error) {
+                chunk.builder.Add(type, digest, verdict, size);
+            } else {
+                chunk.malformed++;
+                if (chunk.samples.size() < MAX_MALFORMED_SAMPLES) {
+                    chunk.samples.push_back(MalformedLine{chunk.lines, error});
+                }
+            }
+        }
+
+        chunk.lines++;
+        p = newline ? newline + 1 : chunk.end;
+    }
+    chunk.builder.Sort();
+}
+
+} // namespace
+
+std::shared_ptr<HashBase> LoadCsvBase(const std::string& path, size_t threadCount,
+                                      const BaseFilterOptions& filter, BaseLoadReport& report) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        return nullptr;
+    }
+
+    const char* begin = reinterpret_cast<const char*>(file.Data());
+    const char* end = begin + file.Size();
+    if (file.Size() >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0) {
+        begin += 3;
+    }
+
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 4;
+    }
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, (end - begin) / MIN_CHUNK_SIZE));
+
+    // Cut at line boundaries
+    std::vector<Chunk> chunks(chunkCount);
+    const char* cursor = begin;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        chunks[i].begin = cursor;
+        const char* target = begin + (end - begin) * (i + 1) / chunkCount;
+        if (i + 1 == chunkCount || target <= cursor) {
+            target = i + 1 == chunkCount ? end : cursor;
+        } else {
+            const char* newline = static_cast<const char*>(std::memchr(target, '\n', end - target));
+            target = newline ? newline + 1 : end;
+        }
+        chunks[i].end = target;
+        cursor = target;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        threads.emplace_back(ParseChunk, std::ref(chunks[i]));
+    }
+    ParseChunk(chunks[0]);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    size_t firstLine = 1;
+    for (const auto& chunk : chunks) {
+        report.lines += chunk.lines;
+        report.malformedLines += chunk.malformed;
+        for (const auto& sample : chunk.samples) {
+            if (report.malformedSamples.size() < MAX_MALFORMED_SAMPLES) {
+                report.malformedSamples.push_back(
+                    "line " + std::to_string(firstLine + sample.line) + ": " + sample.reason);
+            }
+        }
+        firstLine += chunk.lines;
+    }
+
+    // Pairwise merge of the sorted runs, earlier chunks absorb later ones
+    for (size_t step = 1; step < chunks.size(); step *= 2) {
+        threads.clear();
+        for (size_t i = 0; i + step < chunks.size(); i += 2 * step) {
+            threads.emplace_back([&chunks, i, step] {
+                chunks[i].builder.Merge(std::move(chunks[i + step].builder));
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    HashBaseBuilder& builder = chunks[0].builder;
+    if (builder.Size() >= filter.minSignatures) {
+        builder.SetFilterBitsPerKey(filter.bitsPerKey);
+    }
+    return builder.Build();
+}
+
+std::shared_ptr<PatternMatcher> LoadPatternBase(const std::string& path, BaseLoadReport& report) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        return nullptr;
+    }
+    const char* p = reinterpret_cast<const char*>(file.Data());
+    const char* end = p + file.Size();
+    if (file.Size() >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        p += 3;
+    }
+
+    PatternMatcherBuilder builder;
+    std::vector<uint8_t> bytes;
+    while (p < end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* lineEnd = newline ? newline : end;
+        std::string_view line(p, lineEnd - p);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        report.lines++;
+        p = newline ? newline + 1 : end;
+        if (line.empty()) {
+            continue;
+        }
+
+        const char* error = nullptr;
+        size_t pos = line.find(';');
+        std::string_view hex = line.substr(0, pos);
+        bytes.resize(hex.size() / 2);
+        if (pos == std::string_view::npos) {
+            error = "missing ';' separator";
+        } else if (hex.size() % 2 != 0 || !DecodeHex(hex, bytes.data())) {
+            error = "pattern is not an even number of hex digits";
+        } else if (bytes.size() < MIN_PATTERN_SIZE) {
+            error = "pattern is shorter than 4 bytes";
+        } else if (pos + 1 == line.size()) {
+            error = "empty verdict";
+        }
+        if (error) {
+            report.malformedLines++;
+            if (report.malformedSamples.size() < MAX_MALFORMED_SAMPLES) {
+                report.malformedSamples.push_back("line " + std::to_string(report.lines) + ": " + error);
+            }
+            continue;
+        }
+        builder.Add(bytes.data(), bytes.size(), line.substr(pos + 1));
+    }
+
+    std::shared_ptr<PatternMatcher> matcher = builder.Build();
+    if (matcher) {
+        report.signatures = matcher->Size();
+    }
+    return matcher;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "hash_base.hpp"
+#include "pattern_matcher.hpp"
+#include "scanner.hpp"
+#include <memory>
+#include <string>
+
+// Parses a "hash;verdict" / "hash;size;verdict" CSV base in parallel. The
+// hash is MD5, SHA-1 or SHA-256, told apart by its length or by an "md5:",
+// "sha1:" or "sha256:" prefix. The file is mapped and cut into chunks at
+// line boundaries; every chunk is parsed and sorted on its own thread and
+// the sorted runs are then merged pairwise, also in parallel.
+// Malformed lines are skipped and counted in `report`.
+std::shared_ptr<HashBase> LoadCsvBase(const std::string& path, size_t threadCount,
+                                      const BaseFilterOptions& filter, BaseLoadReport& report);
+
+// Parses a "hexbytes;verdict" pattern base: one byte pattern of at least
+// MIN_PATTERN_SIZE bytes per line, in hex. Malformed lines are skipped and
+// counted in `report`; nullptr if the file cannot be read or the automaton
+// would be too large.
+const size_t MIN_PATTERN_SIZE = 4;
+std::shared_ptr<PatternMatcher> LoadPatternBase(const std::string& path, BaseLoadReport& report);
@@ -0,0 +1,67 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Fixed-capacity FIFO between one or more producers and consumers.
+// Push blocks while the queue is full, Pop blocks while it is empty.
+template<class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    // Returns false if the queue was closed before the item could be stored
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        lock.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and drained
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        return TakeFront(lock, item);
+    }
+
+    bool TryPop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return TakeFront(lock, item);
+    }
+
+    // Wakes all waiters; remaining items can still be popped
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    bool TakeFront(std::unique_lock<std::mutex>& lock, T& item) {
+        if (items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+    const size_t capacity_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    bool closed_ = false;
+};
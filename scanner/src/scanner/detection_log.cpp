@@ -0,0 +1,196 @@
+#include "detection_log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace {
+
+// Upper bound on the writer's sleep when the policy asks for immediate writes,
+// in case a wake-up is missed
+const unsigned IMMEDIATE_POLL_MS = 10;
+
+bool SyncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifndef _WIN32
+    return fsync(fileno(file)) == 0;
+#else
+    return _commit(_fileno(file)) == 0;
+#endif
+}
+
+} // namespace
+
+DetectionLog::~DetectionLog() {
+    Close();
+}
+
+bool DetectionLog::Open(const std::string& path, size_t producers, const LogFlushPolicy& policy) {
+    Close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        return false;
+    }
+    // Batches are already large, stdio buffering would only add a copy
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+
+    policy_ = policy;
+    policy_.bufferSize = std::max<size_t>(policy_.bufferSize, 4096);
+    producers_.clear();
+    for (size_t i = 0; i < std::max<size_t>(producers, 1); ++i) {
+        auto producer = std::make_unique<Producer>();
+        producer->capacity = policy_.bufferSize;
+        producer->ring = std::make_unique<char[]>(producer->capacity);
+        producers_.push_back(std::move(producer));
+    }
+
+    stopping_ = false;
+    failed_ = false;
+    wakeRequested_ = false;
+    writer_ = std::thread([this] { WriterLoop(); });
+    return true;
+}
+
+void DetectionLog::Write(size_t producer, const std::string& filePath, std::string_view hash,
+                         std::string_view verdict) {
+    Producer& self = *producers_[producer % producers_.size()];
+
+    std::string& text = self.scratch;
+    text.clear();
+    text += "File: ";
+    text += filePath;
+    text += "\nHash: ";
+    text += hash;
+    text += "\nVerdict: ";
+    text += verdict;
+    text += "\n----------------------------------------\n";
+
+    size_t tail = self.tail.load(std::memory_order_relaxed);
+    size_t head = self.head.load(std::memory_order_acquire);
+    size_t used = tail - head;
+    if (self.capacity - used < text.size()) {
+        // Ring full: hand the entry over on the side instead of waiting
+        auto node = new Overflow;
+        node->text = text;
+        node->next = self.overflow.load(std::memory_order_relaxed);
+        while (!self.overflow.compare_exchange_weak(node->next, node,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed)) {
+        }
+        Wake();
+        return;
+    }
+
+    size_t offset = tail % self.capacity;
+    size_t first = std::min(text.size(), self.capacity - offset);
+    std::memcpy(self.ring.get() + offset, text.data(), first);
+    std::memcpy(self.ring.get(), text.data() + first, text.size() - first);
+    self.tail.store(tail + text.size(), std::memory_order_release);
+
+    if (policy_.intervalMs == 0 || (used + text.size()) * 2 >= self.capacity) {
+        Wake();
+    }
+}
+
+void DetectionLog::Wake() {
+    if (!wakeRequested_.exchange(true, std::memory_order_acq_rel)) {
+        wakeUp_.notify_one();
+    }
+}
+
+void DetectionLog::Collect(std::string& batch) {
+    for (auto& producer : producers_) {
+        Producer& p = *producer;
+        size_t head = p.head.load(std::memory_order_relaxed);
+        size_t tail = p.tail.load(std::memory_order_acquire);
+        if (tail != head) {
+            size_t offset = head % p.capacity;
+            size_t size = tail - head;
+            size_t first = std::min(size, p.capacity - offset);
+            batch.append(p.ring.get() + offset, first);
+            batch.append(p.ring.get(), size - first);
+            p.head.store(tail, std::memory_order_release);
+        }
+
+        // The overflow list is newest first
+        Overflow* node = p.overflow.exchange(nullptr, std::memory_order_acquire);
+        Overflow* ordered = nullptr;
+        while (node) {
+            Overflow* next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+        while (ordered) {
+            Overflow* next = ordered->next;
+            batch += ordered->text;
+            delete ordered;
+            ordered = next;
+        }
+    }
+}
+
+void DetectionLog::WriteBatch(const std::string& batch) {
+    if (batch.empty() || failed_) {
+        return;
+    }
+    if (std::fwrite(batch.data(), 1, batch.size(), file_) != batch.size()) {
+        failed_ = true;
+        return;
+    }
+    if (policy_.syncEachBatch && !SyncFile(file_)) {
+        failed_ = true;
+    }
+}
+
+void DetectionLog::WriterLoop() {
+    auto interval = std::chrono::milliseconds(
+        policy_.intervalMs > 0 ? policy_.intervalMs : IMMEDIATE_POLL_MS);
+    std::string batch;
+    for (;;) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeUp_.wait_for(lock, interval, [this] {
+                return stopping_ || wakeRequested_.load(std::memory_order_acquire);
+            });
+            stop = stopping_;
+        }
+        wakeRequested_.store(false, std::memory_order_release);
+
+        batch.clear();
+        Collect(batch);
+        WriteBatch(batch);
+        if (stop) {
+            break;
+        }
+    }
+}
+
+bool DetectionLog::Close() {
+    if (!file_) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeUp_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+
+    bool ok = !failed_ && SyncFile(file_);
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    producers_.clear();
+    return ok;
+}
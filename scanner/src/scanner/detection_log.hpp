@@ -0,0 +1,74 @@
+#pragma once
+#include "scanner.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Detection log with one buffer per producer thread and a writer thread.
+// A producer formats the entry into its own ring and publishes it with a
+// single atomic store; when the ring is full the entry goes to an overflow
+// list, so logging never waits for the disk or for other producers.
+// The writer drains all buffers into one batch per wake-up and writes it
+// with a single call.
+class DetectionLog {
+public:
+    DetectionLog() = default;
+    ~DetectionLog();
+
+    DetectionLog(const DetectionLog&) = delete;
+    DetectionLog& operator=(const DetectionLog&) = delete;
+
+    // Truncates `path` and starts the writer; `producers` is the number of
+    // threads that will call Write, each with its own index
+    bool Open(const std::string& path, size_t producers, const LogFlushPolicy& policy);
+    bool IsOpen() const { return file_ != nullptr; }
+
+    // Appends one entry; only one thread may use a given producer index at a time.
+    // `hash` is the hex digest that matched.
+    void Write(size_t producer, const std::string& filePath, std::string_view hash,
+               std::string_view verdict);
+
+    // Writes everything still buffered, syncs the file to disk and stops the
+    // writer. Producers must be done. False if any write failed.
+    bool Close();
+
+private:
+    struct Overflow {
+        Overflow* next = nullptr;
+        std::string text;
+    };
+
+    // Single producer / single consumer ring. Positions only grow, the
+    // offset in `ring` is position % capacity.
+    struct Producer {
+        std::unique_ptr<char[]> ring;
+        size_t capacity = 0;
+        alignas(64) std::atomic<size_t> head{0}; // advanced by the writer
+        alignas(64) std::atomic<size_t> tail{0}; // advanced by the producer
+        std::atomic<Overflow*> overflow{nullptr};
+        std::string scratch;
+    };
+
+    void Wake();
+    void WriterLoop();
+    void Collect(std::string& batch);
+    void WriteBatch(const std::string& batch);
+
+    std::vector<std::unique_ptr<Producer>> producers_;
+    LogFlushPolicy policy_;
+    std::FILE* file_ = nullptr;
+    std::thread writer_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeUp_;
+    std::atomic<bool> wakeRequested_{false};
+    bool stopping_ = false;
+    bool failed_ = false; // writer thread only until Close joins it
+};
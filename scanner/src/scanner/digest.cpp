@@ -0,0 +1,60 @@
+#include "digest.hpp"
+#include <cstring>
+
+size_t DigestSize(DigestType type) {
+    switch (type) {
+    case DigestType::SHA1: return 20;
+    case DigestType::SHA256: return 32;
+    default: return 16;
+    }
+}
+
+const char* DigestTypeName(DigestType type) {
+    switch (type) {
+    case DigestType::SHA1: return "sha1";
+    case DigestType::SHA256: return "sha256";
+    default: return "md5";
+    }
+}
+
+std::string DigestToHex(const uint8_t* digest, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result(2 * size, '0');
+    for (size_t i = 0; i < size; ++i) {
+        result[2 * i] = digits[digest[i] >> 4];
+        result[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    return result;
+}
+
+void MultiHasher::Update(const void* data, size_t size) {
+    if (types_ & DigestBit(DigestType::MD5)) {
+        md5_.Update(data, size);
+    }
+    UpdateExceptMD5(data, size);
+}
+
+void MultiHasher::UpdateExceptMD5(const void* data, size_t size) {
+    if (types_ & DigestBit(DigestType::SHA1)) {
+        sha1_.Update(data, size);
+    }
+    if (types_ & DigestBit(DigestType::SHA256)) {
+        sha256_.Update(data, size);
+    }
+}
+
+void MultiHasher::Final(FileDigests& digests) {
+    digests.types = 0;
+    if (types_ & DigestBit(DigestType::MD5)) {
+        MD5Digest md5 = md5_.Final();
+        std::memcpy(digests.Set(DigestType::MD5), md5.data(), md5.size());
+    }
+    if (types_ & DigestBit(DigestType::SHA1)) {
+        SHA1Digest sha1 = sha1_.Final();
+        std::memcpy(digests.Set(DigestType::SHA1), sha1.data(), sha1.size());
+    }
+    if (types_ & DigestBit(DigestType::SHA256)) {
+        SHA256Digest sha256 = sha256_.Final();
+        std::memcpy(digests.Set(DigestType::SHA256), sha256.data(), sha256.size());
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "scanner_export.hpp"
+#include "md5.hpp"
+#include "sha.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Content digests a signature can be listed under
+enum class DigestType : uint8_t {
+    MD5,
+    SHA1,
+    SHA256
+};
+
+const size_t DIGEST_TYPE_COUNT = 3;
+
+// Set of digest types, bit (1 << type) per member
+using DigestSet = uint32_t;
+
+constexpr DigestSet DigestBit(DigestType type) {
+    return DigestSet(1) << static_cast<unsigned>(type);
+}
+
+const DigestSet ALL_DIGESTS = (DigestSet(1) << DIGEST_TYPE_COUNT) - 1;
+
+SCANNER_API size_t DigestSize(DigestType type);
+SCANNER_API const char* DigestTypeName(DigestType type); // "md5", "sha1", "sha256"
+SCANNER_API std::string DigestToHex(const uint8_t* digest, size_t size);
+
+// Every digest computed for one file content, packed back to back.
+// Only the types in `types` hold a value.
+struct FileDigests {
+    static constexpr size_t TOTAL_SIZE = 16 + 20 + 32;
+
+    DigestSet types = 0;
+    uint8_t bytes[TOTAL_SIZE] = {};
+
+    static size_t Offset(DigestType type) {
+        static const size_t offsets[DIGEST_TYPE_COUNT] = {0, 16, 36};
+        return offsets[static_cast<size_t>(type)];
+    }
+    bool Has(DigestType type) const { return (types & DigestBit(type)) != 0; }
+    const uint8_t* Get(DigestType type) const { return bytes + Offset(type); }
+    uint8_t* Set(DigestType type) {
+        types |= DigestBit(type);
+        return bytes + Offset(type);
+    }
+    std::string ToHex(DigestType type) const { return DigestToHex(Get(type), DigestSize(type)); }
+};
+
+// Computes every digest of a set from the same data in one pass
+class SCANNER_API MultiHasher {
+public:
+    explicit MultiHasher(DigestSet types = DigestBit(DigestType::MD5)) : types_(types) {}
+
+    DigestSet Types() const { return types_; }
+
+    void Update(const void* data, size_t size);
+    // Everything but MD5, for callers that hash MD5 of several files in
+    // lockstep through MD5UpdateMany on MD5Context()
+    void UpdateExceptMD5(const void* data, size_t size);
+    MD5& MD5Context() { return md5_; }
+
+    void Final(FileDigests& digests);
+
+private:
+    DigestSet types_;
+    MD5 md5_;
+    SHA1 sha1_;
+    SHA256 sha256_;
+};
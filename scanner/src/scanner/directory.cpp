@@ -0,0 +1,93 @@
+#include "directory.hpp"
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Large batches mean few syscalls per directory, also over NFS
+const size_t DENTS_BUFFER_SIZE = 64 << 10;
+
+const int DIRECTORY_FLAGS = O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY;
+
+} // namespace
+
+Directory::~Directory() {
+    close(fd_);
+}
+
+std::shared_ptr<Directory> Directory::Open(const std::string& path) {
+    int fd = open(path.c_str(), DIRECTORY_FLAGS);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::shared_ptr<Directory>(new Directory(fd, path));
+}
+
+std::shared_ptr<Directory> Directory::OpenChild(const char* name, std::string path) const {
+    // O_NOFOLLOW: a symlink to a directory is not descended into
+    int fd = openat(fd_, name, DIRECTORY_FLAGS | O_NOFOLLOW);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::shared_ptr<Directory>(new Directory(fd, std::move(path)));
+}
+
+std::string Directory::Join(const char* name) const {
+    std::string path = path_;
+    if (!path.empty() && path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+long Directory::ReadBatch() {
+    if (!buffer_) {
+        buffer_ = std::make_unique<char[]>(DENTS_BUFFER_SIZE);
+    }
+    long size = syscall(SYS_getdents64, fd_, buffer_.get(), DENTS_BUFFER_SIZE);
+    if (size <= 0) {
+        // Directory fully read, the batch buffer is not needed any more
+        buffer_.reset();
+    }
+    return size < 0 ? -1 : size;
+}
+
+Directory::EntryType Directory::TypeOf(unsigned char dtype) {
+    switch (dtype) {
+        case DT_REG: return EntryType::File;
+        case DT_DIR: return EntryType::Directory;
+        case DT_LNK: return EntryType::Symlink;
+        case DT_UNKNOWN: return EntryType::Unknown;
+        default: return EntryType::Other;
+    }
+}
+
+bool Directory::Stat(const char* name, bool followLinks, FileIdentity& identity,
+                     EntryType& type) const {
+    struct stat st;
+    if (fstatat(fd_, name, &st, followLinks ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    FileIdentityFromStat(st, identity);
+    type = S_ISREG(st.st_mode) ? EntryType::File
+         : S_ISDIR(st.st_mode) ? EntryType::Directory
+         : S_ISLNK(st.st_mode) ? EntryType::Symlink
+         : EntryType::Other;
+    return true;
+}
+
+bool Directory::Stat(FileIdentity& identity) const {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return false;
+    }
+    FileIdentityFromStat(st, identity);
+    return true;
+}
+
+#endif // __linux__
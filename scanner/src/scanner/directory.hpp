@@ -0,0 +1,84 @@
+#pragma once
+#ifdef __linux__
+#include "scan_cache.hpp"
+#include <memory>
+#include <string>
+
+// Open directory read with raw getdents64 batches. Subdirectories are
+// opened with openat() relative to it, so the kernel never resolves the
+// full path again; a task for a subdirectory keeps its parent open until
+// the subdirectory itself has been opened.
+class Directory {
+public:
+    enum class EntryType {
+        File,
+        Directory,
+        Symlink,
+        Other,
+        Unknown // file system does not fill d_type, stat to find out
+    };
+
+    ~Directory();
+
+    Directory(const Directory&) = delete;
+    Directory& operator=(const Directory&) = delete;
+
+    static std::shared_ptr<Directory> Open(const std::string& path);
+    // `path` is only kept for reporting, the directory is found through this one
+    std::shared_ptr<Directory> OpenChild(const char* name, std::string path) const;
+
+    const std::string& Path() const { return path_; }
+    // Full path of an entry of this directory
+    std::string Join(const char* name) const;
+
+    // Calls fn(name, type) for every entry except "." and "..".
+    // False if the directory could not be read to the end.
+    template<class Fn>
+    bool ForEach(Fn&& fn);
+
+    // fstatat() of an entry; with `followLinks` a symlink reports its target like stat()
+    bool Stat(const char* name, bool followLinks, FileIdentity& identity, EntryType& type) const;
+    // fstat() of the directory itself
+    bool Stat(FileIdentity& identity) const;
+
+private:
+    Directory(int fd, std::string path) : fd_(fd), path_(std::move(path)) {}
+
+    // Next batch of raw entries into buffer_; 0 at the end, -1 on error
+    long ReadBatch();
+    static EntryType TypeOf(unsigned char dtype);
+
+    int fd_;
+    std::string path_;
+    std::unique_ptr<char[]> buffer_;
+};
+
+template<class Fn>
+bool Directory::ForEach(Fn&& fn) {
+    // Same layout as struct linux_dirent64
+    struct RawEntry {
+        unsigned long long ino;
+        long long off;
+        unsigned short reclen;
+        unsigned char type;
+        char name[1];
+    };
+
+    for (;;) {
+        long size = ReadBatch();
+        if (size <= 0) {
+            return size == 0;
+        }
+        for (long offset = 0; offset < size;) {
+            const auto* entry = reinterpret_cast<const RawEntry*>(buffer_.get() + offset);
+            offset += entry->reclen;
+            const char* name = entry->name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            fn(name, TypeOf(entry->type));
+        }
+    }
+}
+
+#endif // __linux__
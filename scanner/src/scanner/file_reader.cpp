@@ -0,0 +1,328 @@
+#include "file_reader.hpp"
+#include "io_uring.hpp"
+#include "scan_cache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const size_t STREAM_READ_SIZE = 65536;
+const size_t MMAP_SPAN_SIZE = 1 << 20;
+const size_t DIRECT_READ_SIZE = 1 << 20;
+const size_t DIRECT_ALIGNMENT = 4096;
+
+// std::ifstream into an owned buffer; works everywhere
+class StreamReader : public FileReader {
+public:
+    StreamReader() : buffer_(STREAM_READ_SIZE) {}
+
+    bool Open(const std::string& path) override {
+        path_ = path;
+        file_.open(path, std::ios::binary);
+        return file_.is_open();
+    }
+
+    // std::ifstream hides its descriptor; the path was just resolved by open
+    bool Identify(FileIdentity& identity) override {
+        return GetFileIdentity(path_, identity);
+    }
+
+    bool Next(const uint8_t*& data, size_t& size) override {
+        file_.read(buffer_.data(), buffer_.size());
+        if (file_.bad()) {
+            return false;
+        }
+        size = static_cast<size_t>(file_.gcount());
+        data = reinterpret_cast<const uint8_t*>(buffer_.data());
+        finished_ = size < buffer_.size();
+        return true;
+    }
+
+    bool Finished() const override {
+        return finished_;
+    }
+
+private:
+    std::string path_;
+    std::ifstream file_;
+    std::vector<char> buffer_;
+    bool finished_ = false;
+};
+
+#ifndef _WIN32
+
+// Whole-file read-only mapping handed out in spans, no copies at all
+class MmapReader : public FileReader {
+public:
+    ~MmapReader() override {
+        if (map_) {
+            munmap(map_, size_);
+        }
+    }
+
+    bool Open(const std::string& path) override {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        FileIdentityFromStat(st, identity_);
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            map_ = static_cast<uint8_t*>(map);
+            madvise(map_, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        return true;
+    }
+
+    bool Identify(FileIdentity& identity) override {
+        identity = identity_;
+        return true;
+    }
+
+    bool Next(const uint8_t*& data, size_t& size) override {
+        size = std::min(MMAP_SPAN_SIZE, size_ - offset_);
+        data = map_ + offset_;
+        offset_ += size;
+
+        // Ask for the following span while this one is hashed
+        size_t ahead = std::min(MMAP_SPAN_SIZE, size_ - offset_);
+        if (ahead > 0) {
+            madvise(map_ + offset_, ahead, MADV_WILLNEED);
+        }
+        return true;
+    }
+
+    bool Finished() const override {
+        return offset_ >= size_;
+    }
+
+private:
+    FileIdentity identity_;
+    uint8_t* map_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+};
+
+#endif // _WIN32
+
+#ifdef __linux__
+
+// Setting a ring up (io_uring_setup and three mappings) costs more than
+// reading a small file, so DirectReader takes one from here and gives it
+// back once nothing is in flight
+const size_t MAX_POOLED_RINGS = 64;
+
+std::mutex ringPoolMutex;
+bool ringUnavailable = false;
+
+std::vector<std::unique_ptr<IoUring>>& RingPool() {
+    static std::vector<std::unique_ptr<IoUring>> pool;
+    return pool;
+}
+
+std::unique_ptr<IoUring> AcquireRing() {
+    {
+        std::lock_guard<std::mutex> lock(ringPoolMutex);
+        auto& pool = RingPool();
+        if (!pool.empty()) {
+            std::unique_ptr<IoUring> ring = std::move(pool.back());
+            pool.pop_back();
+            return ring;
+        }
+        if (ringUnavailable) {
+            return nullptr;
+        }
+    }
+    auto ring = std::make_unique<IoUring>();
+    if (!ring->Init(2)) {
+        std::lock_guard<std::mutex> lock(ringPoolMutex);
+        ringUnavailable = true;
+        return nullptr;
+    }
+    return ring;
+}
+
+void ReleaseRing(std::unique_ptr<IoUring> ring) {
+    std::lock_guard<std::mutex> lock(ringPoolMutex);
+    auto& pool = RingPool();
+    if (pool.size() < MAX_POOLED_RINGS) {
+        pool.push_back(std::move(ring));
+    }
+}
+
+// O_DIRECT reads into two aligned buffers. While the caller hashes one, the
+// next read is already in flight through io_uring (plain pread if the ring
+// is unavailable). Bypasses the page cache, so files larger than RAM do not
+// evict everything else.
+class DirectReader : public FileReader {
+public:
+    ~DirectReader() override {
+        // The kernel may still be writing into a buffer
+        if (inFlight_) {
+            io_uring_cqe* cqe;
+            if (ring_->WaitCqe(cqe)) {
+                ring_->SeenCqe();
+                inFlight_ = false;
+            }
+        }
+        // A ring with a read still pending or a failed submission is not reused
+        if (ring_ && !inFlight_ && !failed_) {
+            ReleaseRing(std::move(ring_));
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        for (auto* buffer : buffers_) {
+            std::free(buffer);
+        }
+    }
+
+    bool Open(const std::string& path) override {
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (fd_ < 0 && errno == EINVAL) {
+            // Filesystem without O_DIRECT support (tmpfs and friends)
+            fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            return false;
+        }
+        FileIdentityFromStat(st, identity_);
+        size_ = static_cast<uint64_t>(st.st_size);
+
+        for (auto*& buffer : buffers_) {
+            buffer = static_cast<uint8_t*>(std::aligned_alloc(DIRECT_ALIGNMENT, DIRECT_READ_SIZE));
+            if (!buffer) {
+                return false;
+            }
+        }
+        ring_ = AcquireRing();
+        return Issue();
+    }
+
+    bool Identify(FileIdentity& identity) override {
+        identity = identity_;
+        return true;
+    }
+
+    bool Next(const uint8_t*& data, size_t& size) override {
+        long result = Complete();
+        if (result < 0) {
+            return false;
+        }
+        size = static_cast<size_t>(result);
+        data = buffers_[current_];
+        offset_ += size;
+        finished_ = size == 0 || offset_ >= size_;
+
+        // Start filling the other buffer before handing this one out
+        current_ ^= 1;
+        if (!finished_ && !Issue()) {
+            return false;
+        }
+        return true;
+    }
+
+    bool Finished() const override {
+        return finished_;
+    }
+
+private:
+    // Starts the read of the chunk at offset_ into buffers_[current_]
+    bool Issue() {
+        if (ring_) {
+            io_uring_sqe* sqe = ring_->GetSqe();
+            if (!sqe) {
+                return false;
+            }
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd_;
+            sqe->addr = reinterpret_cast<uint64_t>(buffers_[current_]);
+            sqe->len = DIRECT_READ_SIZE;
+            sqe->off = offset_;
+            if (ring_->Submit() < 0) {
+                failed_ = true;
+                return false;
+            }
+            inFlight_ = true;
+        }
+        return true;
+    }
+
+    // Result of the read issued for buffers_[current_]
+    long Complete() {
+        if (!ring_) {
+            ssize_t n;
+            do {
+                n = pread(fd_, buffers_[current_], DIRECT_READ_SIZE, static_cast<off_t>(offset_));
+            } while (n < 0 && errno == EINTR);
+            return n;
+        }
+        if (!inFlight_) {
+            return -1;
+        }
+        io_uring_cqe* cqe;
+        if (!ring_->WaitCqe(cqe)) {
+            return -1;
+        }
+        long result = cqe->res;
+        ring_->SeenCqe();
+        inFlight_ = false;
+        return result;
+    }
+
+    std::unique_ptr<IoUring> ring_; // nullptr - plain pread
+    bool failed_ = false;
+    int fd_ = -1;
+    FileIdentity identity_;
+    uint64_t size_ = 0;
+    uint64_t offset_ = 0;
+    uint8_t* buffers_[2] = {nullptr, nullptr};
+    int current_ = 0;
+    bool inFlight_ = false;
+    bool finished_ = false;
+};
+
+#endif // __linux__
+
+} // namespace
+
+std::unique_ptr<FileReader> CreateFileReader(ReadBackend backend) {
+    switch (backend) {
+#ifndef _WIN32
+    case ReadBackend::Mmap:
+        return std::make_unique<MmapReader>();
+#endif
+#ifdef __linux__
+    case ReadBackend::Direct:
+        return std::make_unique<DirectReader>();
+#endif
+    default:
+        return std::make_unique<StreamReader>();
+    }
+}
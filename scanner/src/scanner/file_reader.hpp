@@ -0,0 +1,30 @@
+#pragma once
+#include "scanner.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct FileIdentity;
+
+// Sequential source of file contents for the hash loop
+class FileReader {
+public:
+    virtual ~FileReader() = default;
+
+    virtual bool Open(const std::string& path) = 0;
+
+    // Identity of the opened file: from the descriptor Open used where the
+    // backend has one, else a stat of the path
+    virtual bool Identify(FileIdentity& identity) = 0;
+
+    // Returns the next piece of the file; the pointer stays valid until the
+    // following call. Returns false on a read error.
+    virtual bool Next(const uint8_t*& data, size_t& size) = 0;
+
+    // True once Next has returned the last byte of the file
+    virtual bool Finished() const = 0;
+};
+
+// Backends that are not available on this platform fall back to Stream
+std::unique_ptr<FileReader> CreateFileReader(ReadBackend backend);
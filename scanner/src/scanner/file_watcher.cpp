@@ -0,0 +1,172 @@
+#include "file_watcher.hpp"
+#ifdef __linux__
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t DIRECTORY_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_MOVED_FROM |
+                                  IN_CREATE | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW |
+                                  IN_EXCL_UNLINK;
+
+// Enough for a few hundred events with names per read
+const size_t EVENT_BUFFER_SIZE = 64 << 10;
+
+bool HasPrefix(const std::string& path, const std::string& directory) {
+    return path.size() > directory.size() && path.compare(0, directory.size(), directory) == 0 &&
+           path[directory.size()] == '/';
+}
+
+} // namespace
+
+FileWatcher::~FileWatcher() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool FileWatcher::Start(const std::string& root, bool reportExisting) {
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+        return false;
+    }
+    root_ = root;
+    while (root_.size() > 1 && root_.back() == '/') {
+        root_.pop_back();
+    }
+    AddTree(root_, reportExisting);
+    return !directories_.empty();
+}
+
+void FileWatcher::AddTree(const std::string& directory, bool report) {
+    // A second add of a watched inode returns its descriptor, so renamed
+    // directories simply get their new path here
+    int wd = inotify_add_watch(fd_, directory.c_str(), DIRECTORY_EVENTS);
+    if (wd < 0) {
+        if (errno == ENOSPC && !limitWarned_) {
+            std::cerr << "Warning: inotify watch limit reached, part of " << root_
+                      << " is not watched (fs.inotify.max_user_watches)" << std::endl;
+            limitWarned_ = true;
+        }
+        return;
+    }
+    directories_[wd] = directory;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code typeError;
+        if (it->is_symlink(typeError)) {
+            if (report && it->is_regular_file(typeError)) {
+                Touch(it->path().string(), true);
+            }
+        } else if (it->is_directory(typeError)) {
+            AddTree(it->path().string(), report);
+        } else if (report && it->is_regular_file(typeError)) {
+            Touch(it->path().string(), true);
+        }
+    }
+}
+
+void FileWatcher::RemoveTree(const std::string& directory) {
+    for (auto it = directories_.begin(); it != directories_.end();) {
+        if (it->second == directory || HasPrefix(it->second, directory)) {
+            inotify_rm_watch(fd_, it->first);
+            it = directories_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        it = HasPrefix(it->first, directory) ? pending_.erase(it) : std::next(it);
+    }
+}
+
+// `start` adds the path; without it only a path already pending is postponed
+void FileWatcher::Touch(const std::string& path, bool start) {
+    auto it = pending_.find(path);
+    if (it != pending_.end()) {
+        it->second = Clock::now();
+    } else if (start) {
+        pending_.emplace(path, Clock::now());
+    }
+}
+
+void FileWatcher::ReadEvents() {
+    alignas(inotify_event) char buffer[EVENT_BUFFER_SIZE];
+    for (;;) {
+        ssize_t size = read(fd_, buffer, sizeof(buffer));
+        if (size <= 0) {
+            return;
+        }
+        for (ssize_t offset = 0; offset < size;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost: everything may have changed
+                std::cerr << "Warning: inotify queue overflow, rescanning " << root_ << std::endl;
+                AddTree(root_, true);
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                directories_.erase(event->wd);
+                continue;
+            }
+            auto dir = directories_.find(event->wd);
+            if (dir == directories_.end() || event->len == 0) {
+                continue;
+            }
+            std::string path = dir->second + "/" + event->name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    AddTree(path, true);
+                } else if (event->mask & IN_MOVED_FROM) {
+                    RemoveTree(path);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                Touch(path, true);
+            } else if (event->mask & IN_MODIFY) {
+                // Still being written: wait for it to settle again
+                Touch(path, false);
+            } else if (event->mask & IN_MOVED_FROM) {
+                pending_.erase(path);
+            }
+        }
+    }
+}
+
+void FileWatcher::Poll(int timeoutMs, std::vector<std::string>& ready) {
+    // Wake up in time for the oldest pending file to settle
+    if (!pending_.empty()) {
+        auto oldest = Clock::time_point::max();
+        for (const auto& entry : pending_) {
+            oldest = std::min(oldest, entry.second);
+        }
+        auto due = std::chrono::duration_cast<std::chrono::milliseconds>(oldest + settle_ - Clock::now());
+        timeoutMs = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(timeoutMs, due.count() + 1)));
+    }
+
+    pollfd events{fd_, POLLIN, 0};
+    if (poll(&events, 1, timeoutMs) > 0) {
+        ReadEvents();
+    }
+
+    auto now = Clock::now();
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (now - it->second >= settle_) {
+            ready.push_back(it->first);
+            it = pending_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,48 @@
+#pragma once
+#ifdef __linux__
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Recursive inotify watch over a directory tree. Reports regular files that
+// were closed after writing or moved into the tree once no further event
+// arrived for them for `settle`, so a burst of writes costs one scan.
+// New directories are watched as they appear and their content reported;
+// after an event queue overflow the whole tree is reported again.
+class FileWatcher {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FileWatcher(std::chrono::milliseconds settle) : settle_(settle) {}
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watches every directory under `root`; with `reportExisting` the files
+    // already there are reported as well
+    bool Start(const std::string& root, bool reportExisting);
+
+    // Waits up to `timeoutMs` for events and appends the files that settled
+    void Poll(int timeoutMs, std::vector<std::string>& ready);
+
+    size_t WatchCount() const { return directories_.size(); }
+
+private:
+    // Watches `directory` and everything below it; files found there are
+    // queued with `report`
+    void AddTree(const std::string& directory, bool report);
+    void RemoveTree(const std::string& directory);
+    void Touch(const std::string& path, bool start);
+    void ReadEvents();
+
+    int fd_ = -1;
+    std::string root_;
+    std::chrono::milliseconds settle_;
+    std::unordered_map<int, std::string> directories_; // watch descriptor -> path
+    std::unordered_map<std::string, Clock::time_point> pending_; // path -> last event
+    bool limitWarned_ = false;
+};
+
+#endif // __linux__
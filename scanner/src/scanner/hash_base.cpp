@@ -0,0 +1,612 @@
+#include "hash_base.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HASH_BASE_SSE2 1
+#endif
+
+namespace {
+
+// Compiled base layout (host byte order, little-endian in practice):
+//   BaseHeader
+//   per digest type:
+//     keys          count x DigestKey, sorted
+//     tails         count x tailSize bytes, rest of digests longer than a key
+//     verdictIds    count x uint32
+//     buckets       (1 << bucketBits) + 1 x uint32, first index per top-bits prefix
+//   verdictOffsets  verdictCount + 1 x uint32 into strings
+//   strings         NUL-terminated verdict names
+//   sizes           sizeCount x uint64, sorted distinct file sizes
+//   filter          filterBlocks x 64-byte Bloom filter blocks, optional
+// Every section starts on a 64-byte boundary.
+const char BASE_MAGIC[8] = {'M', 'W', 'B', 'A', 'S', 'E', '0', '1'};
+const uint32_t BASE_VERSION = 4;
+const size_t SECTION_ALIGNMENT = 64;
+const size_t KEY_SIZE = sizeof(DigestKey);
+
+struct TableHeader {
+    uint64_t count;
+    uint32_t bucketBits;
+    uint32_t tailSize;
+    uint64_t keysOffset;
+    uint64_t tailsOffset;
+    uint64_t verdictIdsOffset;
+    uint64_t bucketsOffset;
+};
+
+struct BaseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t typeCount;
+    uint64_t count;
+    uint64_t verdictCount;
+    uint64_t verdictOffsetsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t sizesOffset;
+    uint64_t sizeCount;
+    uint64_t unsizedCount; // signatures without a file size
+    uint64_t filterOffset;
+    uint64_t filterBlocks;
+    uint64_t imageSize;
+    TableHeader tables[DIGEST_TYPE_COUNT];
+};
+
+size_t AlignUp(size_t value) {
+    return (value + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+uint64_t LoadBE64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+bool Less(const DigestKey& a, const DigestKey& b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+bool Equal(const DigestKey& a, const DigestKey& b) {
+    return a.hi == b.hi && a.lo == b.lo;
+}
+
+bool NonDecreasing(const uint32_t* values, size_t count) {
+    for (size_t i = 1; i < count; ++i) {
+        if (values[i] < values[i - 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t TailSize(DigestType type) {
+    return DigestSize(type) - KEY_SIZE;
+}
+
+// Bloom filter position of a signature: the block comes from the top key
+// bits, and one bit in each of the block's eight words from six bits of the
+// low word each. Digests are uniformly distributed, no further hashing.
+const size_t FILTER_WORDS = HashBase::FILTER_BLOCK_SIZE / sizeof(uint64_t);
+
+inline size_t FilterBlock(const DigestKey& key, size_t blocks) {
+    return static_cast<size_t>(((key.hi >> 32) * blocks) >> 32);
+}
+
+inline uint64_t FilterBits(const DigestKey& key, DigestType type) {
+    return key.lo ^ (static_cast<uint64_t>(type) * 0x9E3779B97F4A7C15ull);
+}
+
+// Enough buckets for ~8 signatures each, at most 1M buckets (4 MB)
+unsigned ChooseBucketBits(size_t count) {
+    unsigned bits = 1;
+    while (bits < 20 && (size_t(1) << (bits + 3)) < count) {
+        bits++;
+    }
+    return bits;
+}
+
+} // namespace
+
+DigestKey MakeDigestKey(const uint8_t* digest) {
+    return DigestKey{LoadBE64(digest), LoadBE64(digest + 8)};
+}
+
+namespace {
+
+#ifdef HASH_BASE_SSE2
+
+// Decodes 16 hex characters into 8 bytes (in the low half); false if any
+// character is not a hex digit
+inline bool DecodeHex16(const char* text, __m128i& bytes) {
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+        return false;
+    }
+
+    __m128i nibbles = _mm_or_si128(
+        _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+        _mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    // Each 16-bit lane holds (high nibble, low nibble) in memory order
+    __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+    __m128i low = _mm_srli_epi16(nibbles, 8);
+    bytes = _mm_or_si128(high, low);
+    return true;
+}
+
+#endif // HASH_BASE_SSE2
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+// 32 digits at a time with SSE2
+bool DecodeHex(std::string_view hex, uint8_t* out) {
+    size_t i = 0;
+#ifdef HASH_BASE_SSE2
+    for (; i + 32 <= hex.size(); i += 32, out += 16) {
+        __m128i first, second;
+        if (!DecodeHex16(hex.data() + i, first) || !DecodeHex16(hex.data() + i + 16, second)) {
+            return false;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(first, second));
+    }
+#endif
+    for (; i + 1 < hex.size(); i += 2) {
+        int high = HexValue(hex[i]);
+        int low = HexValue(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        *out++ = static_cast<uint8_t>((high << 4) | low);
+    }
+    return i == hex.size();
+}
+
+bool ParseMD5Hex(std::string_view hex, MD5Digest& digest) {
+    return hex.size() == 32 && DecodeHex(hex, digest.data());
+}
+
+bool ParseDigestHex(std::string_view text, DigestType& type, uint8_t* digest) {
+    size_t colon = text.find(':');
+    std::string_view hex = colon == std::string_view::npos ? text : text.substr(colon + 1);
+    switch (hex.size()) {
+    case 32: type = DigestType::MD5; break;
+    case 40: type = DigestType::SHA1; break;
+    case 64: type = DigestType::SHA256; break;
+    default: return false;
+    }
+    if (colon != std::string_view::npos && text.substr(0, colon) != DigestTypeName(type)) {
+        return false;
+    }
+    return DecodeHex(hex, digest);
+}
+
+HashBase::~HashBase() = default;
+
+bool HashBase::Attach(const uint8_t* image, size_t size) {
+    if (size < sizeof(BaseHeader)) {
+        return false;
+    }
+    BaseHeader header;
+    std::memcpy(&header, image, sizeof(header));
+    if (std::memcmp(header.magic, BASE_MAGIC, sizeof(BASE_MAGIC)) != 0 ||
+        header.version != BASE_VERSION || header.typeCount != DIGEST_TYPE_COUNT ||
+        header.imageSize > size || header.count > UINT32_MAX ||
+        header.verdictCount > UINT32_MAX || header.sizeCount > header.count) {
+        return false;
+    }
+
+    auto fits = [&](uint64_t offset, uint64_t bytes) {
+        return offset % SECTION_ALIGNMENT == 0 && offset <= header.imageSize &&
+               bytes <= header.imageSize - offset;
+    };
+    uint64_t total = 0;
+    for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+        const TableHeader& table = header.tables[t];
+        if (table.bucketBits < 1 || table.bucketBits > 32 || table.count > header.count ||
+            table.tailSize != TailSize(static_cast<DigestType>(t))) {
+            return false;
+        }
+        uint64_t bucketCount = (uint64_t(1) << table.bucketBits) + 1;
+        if (!fits(table.keysOffset, table.count * sizeof(DigestKey)) ||
+            !fits(table.tailsOffset, table.count * table.tailSize) ||
+            !fits(table.verdictIdsOffset, table.count * sizeof(uint32_t)) ||
+            !fits(table.bucketsOffset, bucketCount * sizeof(uint32_t))) {
+            return false;
+        }
+        total += table.count;
+    }
+    if (total != header.count ||
+        !fits(header.verdictOffsetsOffset, (header.verdictCount + 1) * sizeof(uint32_t)) ||
+        !fits(header.stringsOffset, header.stringsSize) ||
+        !fits(header.sizesOffset, header.sizeCount * sizeof(uint64_t)) ||
+        header.filterBlocks > UINT32_MAX ||
+        !fits(header.filterOffset, header.filterBlocks * FILTER_BLOCK_SIZE)) {
+        return false;
+    }
+
+    image_ = image;
+    imageSize_ = header.imageSize;
+    for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+        const TableHeader& source = header.tables[t];
+        Table& table = tables_[t];
+        table.keys = reinterpret_cast<const DigestKey*>(image + source.keysOffset);
+        table.tails = image + source.tailsOffset;
+        table.verdictIds = reinterpret_cast<const uint32_t*>(image + source.verdictIdsOffset);
+        table.buckets = reinterpret_cast<const uint32_t*>(image + source.bucketsOffset);
+        table.count = source.count;
+        table.tailSize = source.tailSize;
+        table.bucketShift = 64 - source.bucketBits;
+        // Bucket starts ascend from 0 to count, so every bucket lies within the keys
+        size_t bucketCount = size_t(1) << source.bucketBits;
+        if (table.buckets[0] != 0 || table.buckets[bucketCount] != table.count ||
+            !NonDecreasing(table.buckets, bucketCount + 1)) {
+            return false;
+        }
+    }
+    verdictOffsets_ = reinterpret_cast<const uint32_t*>(image + header.verdictOffsetsOffset);
+    strings_ = reinterpret_cast<const char*>(image + header.stringsOffset);
+    sizes_ = reinterpret_cast<const uint64_t*>(image + header.sizesOffset);
+    sizeCount_ = header.sizeCount;
+    filter_ = reinterpret_cast<const uint64_t*>(image + header.filterOffset);
+    filterBlocks_ = header.filterBlocks;
+    unsizedCount_ = header.unsizedCount;
+    count_ = header.count;
+    verdictCount_ = header.verdictCount;
+
+    // Likewise verdict offsets ascend to the end of the strings
+    return verdictOffsets_[verdictCount_] == header.stringsSize &&
+           NonDecreasing(verdictOffsets_, verdictCount_ + 1) &&
+           (header.stringsSize == 0 || strings_[header.stringsSize - 1] == '\0');
+}
+
+std::shared_ptr<HashBase> HashBase::Map(const std::string& path) {
+    std::shared_ptr<HashBase> base(new HashBase());
+    base->file_ = std::make_unique<MappedFile>();
+    if (!base->file_->Open(path) || !base->Attach(base->file_->Data(), base->file_->Size())) {
+        return nullptr;
+    }
+    if (base->filterBlocks_ > 0) {
+        // Only filter hits reach the tables; reading ahead around them
+        // would just fill memory with neighbouring signatures
+        base->file_->AdviseRandom();
+    }
+    return base;
+}
+
+bool HashBase::IsCompiled(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(BASE_MAGIC)];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, BASE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool HashBase::Save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(image_), static_cast<std::streamsize>(imageSize_));
+    return static_cast<bool>(file.flush());
+}
+
+DigestSet HashBase::Types() const {
+    DigestSet types = 0;
+    for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+        if (tables_[t].count > 0) {
+            types |= DigestBit(static_cast<DigestType>(t));
+        }
+    }
+    return types;
+}
+
+bool HashBase::MayContain(DigestType type, const uint8_t* digest) const {
+    if (filterBlocks_ == 0) {
+        return true;
+    }
+    DigestKey key = MakeDigestKey(digest);
+    const uint64_t* block = filter_ + FilterBlock(key, filterBlocks_) * FILTER_WORDS;
+    uint64_t bits = FilterBits(key, type);
+    uint64_t missing = 0;
+    for (size_t i = 0; i < FILTER_WORDS; ++i) {
+        missing |= ~block[i] & (uint64_t(1) << ((bits >> (6 * i)) & 63));
+    }
+    return missing == 0;
+}
+
+bool HashBase::Find(DigestType type, const uint8_t* digest, std::string_view& verdict) const {
+    const Table& table = tables_[static_cast<size_t>(type)];
+    if (table.count == 0 || !MayContain(type, digest)) {
+        return false;
+    }
+    DigestKey key = MakeDigestKey(digest);
+    size_t bucket = static_cast<size_t>(key.hi >> table.bucketShift);
+    size_t lo = table.buckets[bucket];
+    size_t hi = table.buckets[bucket + 1];
+    if (hi <= lo || hi > table.count) {
+        return false;
+    }
+    size_t n = hi - lo;
+
+    // Branch-free search for the last key not above ours within the bucket
+    const DigestKey* first = table.keys + lo;
+    while (n > 1) {
+        size_t half = n / 2;
+        first = Less(first[half], key) || Equal(first[half], key) ? first + half : first;
+        n -= half;
+    }
+    if (!Equal(*first, key)) {
+        return false;
+    }
+
+    // Digests sharing the key are adjacent and ordered by tail; walk back
+    // from the last of them
+    size_t index = first - table.keys;
+    if (table.tailSize > 0) {
+        const uint8_t* tail = digest + KEY_SIZE;
+        while (std::memcmp(table.tails + index * table.tailSize, tail, table.tailSize) != 0) {
+            if (index == lo || !Equal(table.keys[index - 1], key)) {
+                return false;
+            }
+            index--;
+        }
+    }
+
+    uint32_t id = table.verdictIds[index];
+    if (id >= verdictCount_) {
+        return false;
+    }
+    uint32_t begin = verdictOffsets_[id];
+    uint32_t end = verdictOffsets_[id + 1];
+    if (begin >= end) {
+        return false;
+    }
+    verdict = std::string_view(strings_ + begin, end - begin - 1);
+    return true;
+}
+
+bool HashBase::Find(const FileDigests& digests, DigestType& matched, std::string_view& verdict) const {
+    for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+        DigestType type = static_cast<DigestType>(t);
+        if (digests.Has(type) && Find(type, digests.Get(type), verdict)) {
+            matched = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HashBase::MayMatchSize(uint64_t size) const {
+    if (unsizedCount_ > 0) {
+        return true;
+    }
+    return std::binary_search(sizes_, sizes_ + sizeCount_, size);
+}
+
+namespace {
+
+template<class Entry>
+bool EntryLess(const Entry& a, const Entry& b) {
+    if (a.type != b.type) {
+        return a.type < b.type;
+    }
+    if (!Equal(a.key, b.key)) {
+        return Less(a.key, b.key);
+    }
+    return std::memcmp(a.tail, b.tail, sizeof(a.tail)) < 0;
+}
+
+template<class Entry>
+bool EntryEqual(const Entry& a, const Entry& b) {
+    return a.type == b.type && Equal(a.key, b.key) && std::memcmp(a.tail, b.tail, sizeof(a.tail)) == 0;
+}
+
+} // namespace
+
+void HashBaseBuilder::Add(DigestType type, const uint8_t* digest, std::string_view verdict,
+                          uint64_t size) {
+    uint32_t id;
+    if (!verdicts_.empty() && verdicts_[lastVerdict_] == verdict) {
+        id = lastVerdict_;
+    } else {
+        auto it = verdictIds_.find(std::string(verdict));
+        if (it != verdictIds_.end()) {
+            id = it->second;
+        } else {
+            id = static_cast<uint32_t>(verdicts_.size());
+            verdicts_.emplace_back(verdict);
+            verdictIds_.emplace(verdicts_.back(), id);
+        }
+        lastVerdict_ = id;
+    }
+
+    Entry entry;
+    entry.key = MakeDigestKey(digest);
+    std::memset(entry.tail, 0, sizeof(entry.tail));
+    std::memcpy(entry.tail, digest + KEY_SIZE, TailSize(type));
+    entry.type = type;
+    entry.verdict = id;
+    entry.size = size;
+    if (!entries_.empty() && EntryLess(entry, entries_.back())) {
+        sorted_ = false;
+    }
+    entries_.push_back(entry);
+}
+
+void HashBaseBuilder::Sort() {
+    if (sorted_) {
+        return;
+    }
+    // Stable sort keeps duplicates in input order, so the last one wins later
+    std::stable_sort(entries_.begin(), entries_.end(), EntryLess<Entry>);
+    sorted_ = true;
+}
+
+void HashBaseBuilder::Merge(HashBaseBuilder&& later) {
+    Sort();
+    later.Sort();
+
+    std::vector<uint32_t> remap(later.verdicts_.size());
+    for (size_t i = 0; i < later.verdicts_.size(); ++i) {
+        auto it = verdictIds_.find(later.verdicts_[i]);
+        if (it != verdictIds_.end()) {
+            remap[i] = it->second;
+        } else {
+            remap[i] = static_cast<uint32_t>(verdicts_.size());
+            verdicts_.push_back(std::move(later.verdicts_[i]));
+            verdictIds_.emplace(verdicts_.back(), remap[i]);
+        }
+    }
+    for (auto& entry : later.entries_) {
+        entry.verdict = remap[entry.verdict];
+    }
+
+    // std::merge takes equal keys from the first range first, so entries
+    // from `later` stay behind ours and win deduplication
+    std::vector<Entry> merged;
+    merged.reserve(entries_.size() + later.entries_.size());
+    std::merge(entries_.begin(), entries_.end(), later.entries_.begin(), later.entries_.end(),
+               std::back_inserter(merged), EntryLess<Entry>);
+    entries_ = std::move(merged);
+
+    later.entries_.clear();
+    later.verdicts_.clear();
+    later.verdictIds_.clear();
+    later.sorted_ = true;
+}
+
+std::shared_ptr<HashBase> HashBaseBuilder::Build() {
+    Sort();
+    size_t count = 0;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (i + 1 < entries_.size() && EntryEqual(entries_[i], entries_[i + 1])) {
+            continue;
+        }
+        entries_[count++] = entries_[i];
+    }
+    entries_.resize(count);
+
+    BaseHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BASE_MAGIC, sizeof(BASE_MAGIC));
+    header.version = BASE_VERSION;
+    header.typeCount = DIGEST_TYPE_COUNT;
+    header.count = count;
+    header.verdictCount = verdicts_.size();
+    for (const auto& verdict : verdicts_) {
+        header.stringsSize += verdict.size() + 1;
+    }
+
+    std::vector<uint64_t> sizes;
+    size_t typeBegin[DIGEST_TYPE_COUNT + 1] = {};
+    for (const auto& entry : entries_) {
+        header.tables[static_cast<size_t>(entry.type)].count++;
+        if (entry.size == HashBase::ANY_SIZE) {
+            header.unsizedCount++;
+        } else {
+            sizes.push_back(entry.size);
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    header.sizeCount = sizes.size();
+
+    // Entries are sorted by type first, so every table is a contiguous run
+    size_t offset = AlignUp(sizeof(BaseHeader));
+    for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+        TableHeader& table = header.tables[t];
+        typeBegin[t + 1] = typeBegin[t] + table.count;
+        table.bucketBits = ChooseBucketBits(table.count);
+        table.tailSize = static_cast<uint32_t>(TailSize(static_cast<DigestType>(t)));
+        table.keysOffset = offset;
+        table.tailsOffset = AlignUp(table.keysOffset + table.count * sizeof(DigestKey));
+        table.verdictIdsOffset = AlignUp(table.tailsOffset + table.count * table.tailSize);
+        table.bucketsOffset = AlignUp(table.verdictIdsOffset + table.count * sizeof(uint32_t));
+        offset = AlignUp(table.bucketsOffset + ((size_t(1) << table.bucketBits) + 1) * sizeof(uint32_t));
+    }
+    header.verdictOffsetsOffset = offset;
+    header.stringsOffset = AlignUp(header.verdictOffsetsOffset + (verdicts_.size() + 1) * sizeof(uint32_t));
+    header.sizesOffset = AlignUp(header.stringsOffset + header.stringsSize);
+    header.filterOffset = AlignUp(header.sizesOffset + sizes.size() * sizeof(uint64_t));
+    if (filterBitsPerKey_ > 0 && count > 0) {
+        header.filterBlocks = (uint64_t(count) * filterBitsPerKey_ + HashBase::FILTER_BLOCK_SIZE * 8 - 1) /
+                              (HashBase::FILTER_BLOCK_SIZE * 8);
+    }
+    header.imageSize = header.filterOffset + header.filterBlocks * HashBase::FILTER_BLOCK_SIZE;
+
+    std::shared_ptr<HashBase> base(new HashBase());
+    base->storage_.assign((header.imageSize + 7) / 8, 0);
+    uint8_t* image = reinterpret_cast<uint8_t*>(base->storage_.data());
+    std::memcpy(image, &header, sizeof(header));
+
+    for (size_t t = 0; t < DIGEST_TYPE_COUNT; ++t) {
+        const TableHeader& table = header.tables[t];
+        auto* keys = reinterpret_cast<DigestKey*>(image + table.keysOffset);
+        uint8_t* tails = image + table.tailsOffset;
+        auto* verdictIds = reinterpret_cast<uint32_t*>(image + table.verdictIdsOffset);
+        auto* buckets = reinterpret_cast<uint32_t*>(image + table.bucketsOffset);
+        size_t bucketCount = (size_t(1) << table.bucketBits) + 1;
+        unsigned shift = 64 - table.bucketBits;
+        size_t bucket = 0;
+        for (size_t i = 0; i < table.count; ++i) {
+            const Entry& entry = entries_[typeBegin[t] + i];
+            keys[i] = entry.key;
+            std::memcpy(tails + i * table.tailSize, entry.tail, table.tailSize);
+            verdictIds[i] = entry.verdict;
+            size_t target = static_cast<size_t>(entry.key.hi >> shift);
+            while (bucket <= target) {
+                buckets[bucket++] = static_cast<uint32_t>(i);
+            }
+        }
+        while (bucket < bucketCount) {
+            buckets[bucket++] = static_cast<uint32_t>(table.count);
+        }
+    }
+
+    auto* verdictOffsets = reinterpret_cast<uint32_t*>(image + header.verdictOffsetsOffset);
+    char* strings = reinterpret_cast<char*>(image + header.stringsOffset);
+    uint32_t stringOffset = 0;
+    for (size_t i = 0; i < verdicts_.size(); ++i) {
+        verdictOffsets[i] = stringOffset;
+        std::memcpy(strings + stringOffset, verdicts_[i].data(), verdicts_[i].size());
+        stringOffset += static_cast<uint32_t>(verdicts_[i].size() + 1);
+    }
+    verdictOffsets[verdicts_.size()] = stringOffset;
+    if (!sizes.empty()) {
+        std::memcpy(image + header.sizesOffset, sizes.data(), sizes.size() * sizeof(uint64_t));
+    }
+    if (header.filterBlocks > 0) {
+        auto* filter = reinterpret_cast<uint64_t*>(image + header.filterOffset);
+        for (const auto& entry : entries_) {
+            uint64_t* block = filter + FilterBlock(entry.key, header.filterBlocks) * FILTER_WORDS;
+            uint64_t bits = FilterBits(entry.key, entry.type);
+            for (size_t i = 0; i < FILTER_WORDS; ++i) {
+                block[i] |= uint64_t(1) << ((bits >> (6 * i)) & 63);
+            }
+        }
+    }
+
+    if (!base->Attach(image, header.imageSize)) {
+        return nullptr;
+    }
+    entries_.clear();
+    verdicts_.clear();
+    verdictIds_.clear();
+    return base;
+}
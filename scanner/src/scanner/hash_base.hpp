@@ -0,0 +1,158 @@
+#pragma once
+#include "scanner_export.hpp"
+#include "digest.hpp"
+#include "md5.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class MappedFile;
+
+// First 16 bytes of a digest as two big-endian words, so integer order
+// equals byte order
+struct DigestKey {
+    uint64_t hi;
+    uint64_t lo;
+};
+
+DigestKey MakeDigestKey(const uint8_t* digest);
+inline DigestKey MakeDigestKey(const MD5Digest& digest) { return MakeDigestKey(digest.data()); }
+
+// Read-only signature tables, one per digest type: sorted 128-bit digest
+// prefixes with the remaining bytes of longer digests alongside, a radix
+// table over the top bits for the first probe, and a verdict table shared
+// by all types.
+// The image is identical in memory and on disk, so a compiled base file is
+// used straight from a read-only mapping without any parsing.
+// An optional blocked Bloom filter over all signatures answers nearly every
+// miss from a single cache line, so the tables of a huge mapped base are
+// only paged in for the few digests that pass it.
+class SCANNER_API HashBase {
+public:
+    // File size of a signature that does not specify one
+    static constexpr uint64_t ANY_SIZE = UINT64_MAX;
+
+    HashBase(const HashBase&) = delete;
+    HashBase& operator=(const HashBase&) = delete;
+    ~HashBase();
+
+    // Maps a compiled base; nullptr if the file is missing or malformed
+    static std::shared_ptr<HashBase> Map(const std::string& path);
+    // True if the file starts with the compiled base signature
+    static bool IsCompiled(const std::string& path);
+
+    bool Save(const std::string& path) const;
+
+    size_t Size() const { return count_; }
+    size_t Size(DigestType type) const { return tables_[static_cast<size_t>(type)].count; }
+    size_t VerdictCount() const { return verdictCount_; }
+    // Types that have at least one signature
+    DigestSet Types() const;
+
+    // `digest` holds DigestSize(type) bytes
+    bool Find(DigestType type, const uint8_t* digest, std::string_view& verdict) const;
+    bool Find(const MD5Digest& digest, std::string_view& verdict) const {
+        return Find(DigestType::MD5, digest.data(), verdict);
+    }
+    // Tries every digest of the file; `matched` is the type that was found
+    bool Find(const FileDigests& digests, DigestType& matched, std::string_view& verdict) const;
+
+    // False only if every signature carries a file size and none of them
+    // equals `size`, i.e. a file of that size cannot match and need not be read
+    bool MayMatchSize(uint64_t size) const;
+    bool HasSizeIndex() const { return unsizedCount_ == 0 && count_ > 0; }
+
+    // False if the digest is certainly not in the base; always true without a filter
+    bool MayContain(DigestType type, const uint8_t* digest) const;
+    size_t FilterBytes() const { return filterBlocks_ * FILTER_BLOCK_SIZE; }
+
+    static constexpr size_t FILTER_BLOCK_SIZE = 64;
+
+private:
+    friend class HashBaseBuilder;
+
+    HashBase() = default;
+    bool Attach(const uint8_t* image, size_t size);
+
+    // Exactly one of these owns the image
+    std::vector<uint64_t> storage_;
+    std::unique_ptr<MappedFile> file_;
+
+    const uint8_t* image_ = nullptr;
+    size_t imageSize_ = 0;
+
+    struct Table {
+        const DigestKey* keys = nullptr;
+        const uint8_t* tails = nullptr; // digest bytes past the key, tailSize per signature
+        const uint32_t* verdictIds = nullptr;
+        const uint32_t* buckets = nullptr;
+        size_t count = 0;
+        size_t tailSize = 0;
+        unsigned bucketShift = 64;
+    };
+
+    Table tables_[DIGEST_TYPE_COUNT];
+    const uint32_t* verdictOffsets_ = nullptr;
+    const char* strings_ = nullptr;
+    const uint64_t* sizes_ = nullptr; // sorted distinct sizes of sized signatures
+    const uint64_t* filter_ = nullptr; // filterBlocks_ blocks of 8 words
+    size_t filterBlocks_ = 0;
+    size_t sizeCount_ = 0;
+    size_t unsizedCount_ = 0;
+    size_t count_ = 0;
+    size_t verdictCount_ = 0;
+};
+
+// Collects signatures and produces a HashBase. A digest listed several
+// times keeps the verdict of its last occurrence.
+class SCANNER_API HashBaseBuilder {
+public:
+    void Add(DigestType type, const uint8_t* digest, std::string_view verdict,
+             uint64_t size = HashBase::ANY_SIZE);
+    void Add(const MD5Digest& digest, std::string_view verdict,
+             uint64_t size = HashBase::ANY_SIZE) {
+        Add(DigestType::MD5, digest.data(), verdict, size);
+    }
+    size_t Size() const { return entries_.size(); }
+
+    // Adds a blocked Bloom filter of about `bitsPerKey` bits per signature to
+    // the built base, 0 - none (the default)
+    void SetFilterBitsPerKey(unsigned bitsPerKey) { filterBitsPerKey_ = bitsPerKey; }
+
+    // Sorts the collected entries, keeping equal digests in input order
+    void Sort();
+    // Appends signatures that came after ours in the input; both sides are
+    // sorted first, the result is a single sorted run
+    void Merge(HashBaseBuilder&& later);
+
+    std::shared_ptr<HashBase> Build();
+
+private:
+    struct Entry {
+        DigestKey key;
+        uint8_t tail[16]; // zero past the digest size
+        DigestType type;
+        uint32_t verdict;
+        uint64_t size;
+    };
+
+    std::vector<Entry> entries_;
+    bool sorted_ = true;
+    std::vector<std::string> verdicts_;
+    std::unordered_map<std::string, uint32_t> verdictIds_;
+    uint32_t lastVerdict_ = 0;
+    unsigned filterBitsPerKey_ = 0;
+};
+
+// Parses 32 hex digits (either case); false on any other input
+SCANNER_API bool ParseMD5Hex(std::string_view hex, MD5Digest& digest);
+// Parses a typed signature hash: 32, 40 or 64 hex digits for MD5, SHA-1 or
+// SHA-256, optionally prefixed with "md5:", "sha1:" or "sha256:".
+// `digest` receives DigestSize(type) bytes.
+SCANNER_API bool ParseDigestHex(std::string_view text, DigestType& type, uint8_t* digest);
+// Decodes an even number of hex digits into hex.size() / 2 bytes of `out`
+bool DecodeHex(std::string_view hex, uint8_t* out);
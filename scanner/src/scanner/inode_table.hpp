@@ -0,0 +1,64 @@
+#pragma once
+#include "digest.hpp"
+#include "scan_cache.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Files reachable through several paths (hardlinks). The first path seen
+// for an inode is its primary and gets hashed; every other path reuses the
+// primary's digest, waiting for it if hashing is still in progress.
+class InodeTable {
+public:
+    enum class ClaimResult {
+        Primary, // caller hashes the file and reports through Complete
+        Waiting, // path parked until the primary completes
+        Hashed,  // digest of the inode returned right away
+        Failed   // the primary could not be read
+    };
+
+    ClaimResult Claim(uint64_t device, uint64_t inode, const std::string& path, FileDigests& digest) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto inserted = inodes_.try_emplace({device, inode});
+        State& state = inserted.first->second;
+        if (inserted.second) {
+            return ClaimResult::Primary;
+        }
+        if (!state.done) {
+            state.waiting.push_back(path);
+            return ClaimResult::Waiting;
+        }
+        if (state.failed) {
+            return ClaimResult::Failed;
+        }
+        digest = state.digest;
+        return ClaimResult::Hashed;
+    }
+
+    // Records the primary's digest (nullptr if it failed) and returns the
+    // paths that were waiting for it
+    std::vector<std::string> Complete(uint64_t device, uint64_t inode, const FileDigests* digest) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        State& state = inodes_[{device, inode}];
+        state.done = true;
+        state.failed = digest == nullptr;
+        if (digest) {
+            state.digest = *digest;
+        }
+        return std::move(state.waiting);
+    }
+
+private:
+    struct State {
+        FileDigests digest;
+        bool done = false;
+        bool failed = false;
+        std::vector<std::string> waiting;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<std::pair<uint64_t, uint64_t>, State, FileKeyHash> inodes_;
+};
@@ -0,0 +1,171 @@
+#include "io_uring.hpp"
+#ifdef __linux__
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int Setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int Enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int Register(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+template<class T>
+T* At(void* base, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+} // namespace
+
+IoUring::~IoUring() {
+    if (sqes_) {
+        munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_) {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if (ringFd_ >= 0) {
+        close(ringFd_);
+    }
+}
+
+bool IoUring::Init(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = Setup(entries, &params);
+    if (fd < 0) {
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        sqRing_ = nullptr;
+        close(fd);
+        return false;
+    }
+    if (singleMmap) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            cqRing_ = nullptr;
+            munmap(sqRing_, sqRingSize_);
+            sqRing_ = nullptr;
+            close(fd);
+            return false;
+        }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        if (cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = cqRing_ = nullptr;
+        close(fd);
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_ = At<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = At<unsigned>(sqRing_, params.sq_off.tail);
+    sqMask_ = *At<unsigned>(sqRing_, params.sq_off.ring_mask);
+    cqHead_ = At<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = At<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *At<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = At<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+
+    // Submission slots are always used in ring order
+    unsigned* array = At<unsigned>(sqRing_, params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    entries_ = params.sq_entries;
+    sqeTail_ = submitted_ = *sqTail_;
+    ringFd_ = fd;
+    return true;
+}
+
+bool IoUring::RegisterFileSlots(unsigned count) {
+    // -1 entries are registered as empty slots
+    std::vector<int> fds(count, -1);
+    return Register(ringFd_, IORING_REGISTER_FILES, fds.data(), count) == 0;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= entries_) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &sqes_[sqeTail_ & sqMask_];
+    sqeTail_++;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::Submit(unsigned waitCount) {
+    unsigned toSubmit = sqeTail_ - submitted_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    submitted_ = sqeTail_;
+    if (toSubmit == 0 && waitCount == 0) {
+        return 0;
+    }
+
+    for (;;) {
+        int ret = Enter(ringFd_, toSubmit, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        return ret < 0 ? -errno : ret;
+    }
+}
+
+bool IoUring::PeekCqe(io_uring_cqe*& cqe) {
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    cqe = &cqes_[head & cqMask_];
+    return true;
+}
+
+bool IoUring::WaitCqe(io_uring_cqe*& cqe) {
+    while (!PeekCqe(cqe)) {
+        int ret = Enter(ringFd_, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IoUring::SeenCqe() {
+    __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE);
+}
+
+#endif // __linux__
@@ -0,0 +1,59 @@
+#pragma once
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <cstddef>
+
+// Minimal io_uring ring on top of the raw syscalls (no liburing dependency).
+// Not thread safe: one ring is driven by one thread at a time.
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Returns false if the kernel (or a sandbox) does not provide io_uring
+    bool Init(unsigned entries);
+    bool Valid() const { return ringFd_ >= 0; }
+
+    // Registers `count` empty fixed-file slots, which openat can then fill
+    // with direct descriptors (sqe->file_index = slot + 1)
+    bool RegisterFileSlots(unsigned count);
+
+    // Next free submission entry (zeroed), nullptr when the ring is full
+    io_uring_sqe* GetSqe();
+
+    // Publishes the prepared entries and waits for `waitCount` completions.
+    // Returns the number of submitted entries or -errno.
+    int Submit(unsigned waitCount = 0);
+
+    // Oldest unconsumed completion; WaitCqe blocks until one is available
+    bool PeekCqe(io_uring_cqe*& cqe);
+    bool WaitCqe(io_uring_cqe*& cqe);
+    void SeenCqe();
+
+private:
+    int ringFd_ = -1;
+    unsigned entries_ = 0;
+
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    unsigned sqeTail_ = 0;   // entries handed out by GetSqe
+    unsigned submitted_ = 0; // entries published to the kernel
+};
+
+#endif // __linux__
@@ -0,0 +1,64 @@
+#include "mapped_file.hpp"
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapping_) {
+        munmap(mapping_, size_);
+    }
+#endif
+}
+
+void MappedFile::AdviseRandom() {
+#ifndef _WIN32
+    if (mapping_) {
+        madvise(mapping_, size_, MADV_RANDOM);
+    }
+#endif
+}
+
+bool MappedFile::Open(const std::string& path) {
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        mapping_ = map;
+        data_ = static_cast<const uint8_t*>(map);
+    }
+    close(fd);
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    size_ = static_cast<size_t>(file.tellg());
+    storage_.resize((size_ + 7) / 8);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(storage_.data()), static_cast<std::streamsize>(size_))) {
+        return false;
+    }
+    data_ = reinterpret_cast<const uint8_t*>(storage_.data());
+    return true;
+#endif
+}
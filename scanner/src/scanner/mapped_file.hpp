@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file: a shared mapping where available,
+// otherwise the file is read into memory in one go
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+    // Tells the kernel that pages are touched in random order, so faults
+    // read no neighbouring pages (no-op without a mapping)
+    void AdviseRandom();
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    void* mapping_ = nullptr;
+    std::vector<uint64_t> storage_; // 8-byte aligned fallback copy
+};
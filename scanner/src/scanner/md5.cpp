@@ -0,0 +1,518 @@
+#include "md5.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MD5_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define MD5_X86 0
+#endif
+
+#if MD5_X86 && (defined(__GNUC__) || defined(__clang__))
+#define MD5_TARGET_AVX2 __attribute__((target("avx2")))
+#define MD5_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define MD5_TARGET_AVX2
+#define MD5_TARGET_AVX512
+#endif
+
+namespace {
+
+// The 64 MD5 steps: round function, register rotation, message word, constant, shift
+#define MD5_STEPS(STEP) \
+    STEP(F, a, b, c, d,  0, 0xd76aa478,  7) \
+    STEP(F, d, a, b, c,  1, 0xe8c7b756, 12) \
+    STEP(F, c, d, a, b,  2, 0x242070db, 17) \
+    STEP(F, b, c, d, a,  3, 0xc1bdceee, 22) \
+    STEP(F, a, b, c, d,  4, 0xf57c0faf,  7) \
+    STEP(F, d, a, b, c,  5, 0x4787c62a, 12) \
+    STEP(F, c, d, a, b,  6, 0xa8304613, 17) \
+    STEP(F, b, c, d, a,  7, 0xfd469501, 22) \
+    STEP(F, a, b, c, d,  8, 0x698098d8,  7) \
+    STEP(F, d, a, b, c,  9, 0x8b44f7af, 12) \
+    STEP(F, c, d, a, b, 10, 0xffff5bb1, 17) \
+    STEP(F, b, c, d, a, 11, 0x895cd7be, 22) \
+    STEP(F, a, b, c, d, 12, 0x6b901122,  7) \
+    STEP(F, d, a, b, c, 13, 0xfd987193, 12) \
+    STEP(F, c, d, a, b, 14, 0xa679438e, 17) \
+    STEP(F, b, c, d, a, 15, 0x49b40821, 22) \
+    STEP(G, a, b, c, d,  1, 0xf61e2562,  5) \
+    STEP(G, d, a, b, c,  6, 0xc040b340,  9) \
+    STEP(G, c, d, a, b, 11, 0x265e5a51, 14) \
+    STEP(G, b, c, d, a,  0, 0xe9b6c7aa, 20) \
+    STEP(G, a, b, c, d,  5, 0xd62f105d,  5) \
+    STEP(G, d, a, b, c, 10, 0x02441453,  9) \
+    STEP(G, c, d, a, b, 15, 0xd8a1e681, 14) \
+    STEP(G, b, c, d, a,  4, 0xe7d3fbc8, 20) \
+    STEP(G, a, b, c, d,  9, 0x21e1cde6,  5) \
+    STEP(G, d, a, b, c, 14, 0xc33707d6,  9) \
+    STEP(G, c, d, a, b,  3, 0xf4d50d87, 14) \
+    STEP(G, b, c, d, a,  8, 0x455a14ed, 20) \
+    STEP(G, a, b, c, d, 13, 0xa9e3e905,  5) \
+    STEP(G, d, a, b, c,  2, 0xfcefa3f8,  9) \
+    STEP(G, c, d, a, b,  7, 0x676f02d9, 14) \
+    STEP(G, b, c, d, a, 12, 0x8d2a4c8a, 20) \
+    STEP(H, a, b, c, d,  5, 0xfffa3942,  4) \
+    STEP(H, d, a, b, c,  8, 0x8771f681, 11) \
+    STEP(H, c, d, a, b, 11, 0x6d9d6122, 16) \
+    STEP(H, b, c, d, a, 14, 0xfde5380c, 23) \
+    STEP(H, a, b, c, d,  1, 0xa4beea44,  4) \
+    STEP(H, d, a, b, c,  4, 0x4bdecfa9, 11) \
+    STEP(H, c, d, a, b,  7, 0xf6bb4b60, 16) \
+    STEP(H, b, c, d, a, 10, 0xbebfbc70, 23) \
+    STEP(H, a, b, c, d, 13, 0x289b7ec6,  4) \
+    STEP(H, d, a, b, c,  0, 0xeaa127fa, 11) \
+    STEP(H, c, d, a, b,  3, 0xd4ef3085, 16) \
+    STEP(H, b, c, d, a,  6, 0x04881d05, 23) \
+    STEP(H, a, b, c, d,  9, 0xd9d4d039,  4) \
+    STEP(H, d, a, b, c, 12, 0xe6db99e5, 11) \
+    STEP(H, c, d, a, b, 15, 0x1fa27cf8, 16) \
+    STEP(H, b, c, d, a,  2, 0xc4ac5665, 23) \
+    STEP(I, a, b, c, d,  0, 0xf4292244,  6) \
+    STEP(I, d, a, b, c,  7, 0x432aff97, 10) \
+    STEP(I, c, d, a, b, 14, 0xab9423a7, 15) \
+    STEP(I, b, c, d, a,  5, 0xfc93a039, 21) \
+    STEP(I, a, b, c, d, 12, 0x655b59c3,  6) \
+    STEP(I, d, a, b, c,  3, 0x8f0ccc92, 10) \
+    STEP(I, c, d, a, b, 10, 0xffeff47d, 15) \
+    STEP(I, b, c, d, a,  1, 0x85845dd1, 21) \
+    STEP(I, a, b, c, d,  8, 0x6fa87e4f,  6) \
+    STEP(I, d, a, b, c, 15, 0xfe2ce6e0, 10) \
+    STEP(I, c, d, a, b,  6, 0xa3014314, 15) \
+    STEP(I, b, c, d, a, 13, 0x4e0811a1, 21) \
+    STEP(I, a, b, c, d,  4, 0xf7537e82,  6) \
+    STEP(I, d, a, b, c, 11, 0xbd3af235, 10) \
+    STEP(I, c, d, a, b,  2, 0x2ad7d2bb, 15) \
+    STEP(I, b, c, d, a,  9, 0xeb86d391, 21)
+
+const uint32_t kInitState[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+inline uint32_t LoadLE32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline uint32_t Rotl(uint32_t x, int s) {
+    return (x << s) | (x >> (32 - s));
+}
+
+inline uint32_t FScalar(uint32_t b, uint32_t c, uint32_t d) { return d ^ (b & (c ^ d)); }
+inline uint32_t GScalar(uint32_t b, uint32_t c, uint32_t d) { return c ^ (d & (b ^ c)); }
+inline uint32_t HScalar(uint32_t b, uint32_t c, uint32_t d) { return b ^ c ^ d; }
+inline uint32_t IScalar(uint32_t b, uint32_t c, uint32_t d) { return c ^ (b | ~d); }
+
+void CompressScalar(uint32_t state[4], const uint8_t* data, size_t blocks) {
+    for (size_t blk = 0; blk < blocks; ++blk, data += 64) {
+        uint32_t m[16];
+        for (int j = 0; j < 16; ++j) {
+            m[j] = LoadLE32(data + 4 * j);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+#define SCALAR_STEP(f, a, b, c, d, k, t, s) \
+        a = b + Rotl(a + f##Scalar(b, c, d) + m[k] + t, s);
+        MD5_STEPS(SCALAR_STEP)
+#undef SCALAR_STEP
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+}
+
+#if MD5_X86
+
+// 8 lanes, one 32-bit word of every stream per AVX2 register
+MD5_TARGET_AVX2 inline __m256i Rotl8(__m256i x, int s) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, s), _mm256_srli_epi32(x, 32 - s));
+}
+MD5_TARGET_AVX2 inline __m256i FAvx2(__m256i b, __m256i c, __m256i d) {
+    return _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+}
+MD5_TARGET_AVX2 inline __m256i GAvx2(__m256i b, __m256i c, __m256i d) {
+    return _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)));
+}
+MD5_TARGET_AVX2 inline __m256i HAvx2(__m256i b, __m256i c, __m256i d) {
+    return _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+}
+MD5_TARGET_AVX2 inline __m256i IAvx2(__m256i b, __m256i c, __m256i d) {
+    return _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, _mm256_set1_epi32(-1))));
+}
+
+// states/data hold exactly 8 entries; unused lanes are padded by the caller
+MD5_TARGET_AVX2 void CompressAvx2(uint32_t* const* states, const uint8_t* const* data, size_t blocks) {
+    alignas(32) uint32_t lanes[4][8];
+    for (int r = 0; r < 4; ++r) {
+        for (int l = 0; l < 8; ++l) {
+            lanes[r][l] = states[l][r];
+        }
+    }
+    __m256i sa = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[0]));
+    __m256i sb = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[1]));
+    __m256i sc = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[2]));
+    __m256i sd = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[3]));
+
+    for (size_t blk = 0; blk < blocks; ++blk) {
+        alignas(32) uint32_t words[16][8];
+        for (int l = 0; l < 8; ++l) {
+            const uint8_t* p = data[l] + blk * 64;
+            for (int j = 0; j < 16; ++j) {
+                std::memcpy(&words[j][l], p + 4 * j, 4);
+            }
+        }
+        __m256i m[16];
+        for (int j = 0; j < 16; ++j) {
+            m[j] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[j]));
+        }
+
+        __m256i a = sa, b = sb, c = sc, d = sd;
+#define AVX2_STEP(f, a, b, c, d, k, t, s) \
+        a = _mm256_add_epi32(b, Rotl8(_mm256_add_epi32(_mm256_add_epi32(a, f##Avx2(b, c, d)), \
+                                      _mm256_add_epi32(m[k], _mm256_set1_epi32(int(t)))), s));
+        MD5_STEPS(AVX2_STEP)
+#undef AVX2_STEP
+        sa = _mm256_add_epi32(sa, a);
+        sb = _mm256_add_epi32(sb, b);
+        sc = _mm256_add_epi32(sc, c);
+        sd = _mm256_add_epi32(sd, d);
+    }
+
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), sa);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), sb);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), sc);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[3]), sd);
+    for (int r = 0; r < 4; ++r) {
+        for (int l = 0; l < 8; ++l) {
+            states[l][r] = lanes[r][l];
+        }
+    }
+}
+
+// 16 lanes. The shifts are masked with all lanes set: the unmasked ones in
+// GCC's headers trip -Wmaybe-uninitialized on an undefined pass-through operand
+MD5_TARGET_AVX512 inline __m512i Rotl16(__m512i x, unsigned s) {
+    return _mm512_or_si512(_mm512_maskz_slli_epi32(0xFFFF, x, s), _mm512_maskz_srli_epi32(0xFFFF, x, 32 - s));
+}
+// The round functions map onto single ternary-logic instructions
+#define FAvx512(b, c, d) _mm512_ternarylogic_epi32(b, c, d, 0xCA)
+#define GAvx512(b, c, d) _mm512_ternarylogic_epi32(b, c, d, 0xE4)
+#define HAvx512(b, c, d) _mm512_ternarylogic_epi32(b, c, d, 0x96)
+#define IAvx512(b, c, d) _mm512_ternarylogic_epi32(b, c, d, 0x39)
+
+// states/data hold exactly 16 entries; unused lanes are padded by the caller
+MD5_TARGET_AVX512 void CompressAvx512(uint32_t* const* states, const uint8_t* const* data, size_t blocks) {
+    alignas(64) uint32_t lanes[4][16];
+    for (int r = 0; r < 4; ++r) {
+        for (int l = 0; l < 16; ++l) {
+            lanes[r][l] = states[l][r];
+        }
+    }
+    __m512i sa = _mm512_load_si512(lanes[0]);
+    __m512i sb = _mm512_load_si512(lanes[1]);
+    __m512i sc = _mm512_load_si512(lanes[2]);
+    __m512i sd = _mm512_load_si512(lanes[3]);
+
+    for (size_t blk = 0; blk < blocks; ++blk) {
+        alignas(64) uint32_t words[16][16];
+        for (int l = 0; l < 16; ++l) {
+            const uint8_t* p = data[l] + blk * 64;
+            for (int j = 0; j < 16; ++j) {
+                std::memcpy(&words[j][l], p + 4 * j, 4);
+            }
+        }
+        __m512i m[16];
+        for (int j = 0; j < 16; ++j) {
+            m[j] = _mm512_load_si512(words[j]);
+        }
+
+        __m512i a = sa, b = sb, c = sc, d = sd;
+#define AVX512_STEP(f, a, b, c, d, k, t, s) \
+        a = _mm512_add_epi32(b, Rotl16(_mm512_add_epi32(_mm512_add_epi32(a, f##Avx512(b, c, d)), \
+                                       _mm512_add_epi32(m[k], _mm512_set1_epi32(int(t)))), s));
+        MD5_STEPS(AVX512_STEP)
+#undef AVX512_STEP
+        sa = _mm512_add_epi32(sa, a);
+        sb = _mm512_add_epi32(sb, b);
+        sc = _mm512_add_epi32(sc, c);
+        sd = _mm512_add_epi32(sd, d);
+    }
+
+    _mm512_store_si512(lanes[0], sa);
+    _mm512_store_si512(lanes[1], sb);
+    _mm512_store_si512(lanes[2], sc);
+    _mm512_store_si512(lanes[3], sd);
+    for (int r = 0; r < 4; ++r) {
+        for (int l = 0; l < 16; ++l) {
+            states[l][r] = lanes[r][l];
+        }
+    }
+}
+
+bool QueryCpu(MD5Engine engine) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (!osxsave) return false;
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(regs, 7, 0);
+    if (engine == MD5Engine::AVX2) {
+        return (xcr0 & 0x6) == 0x6 && (regs[1] & (1 << 5)) != 0;
+    }
+    return (xcr0 & 0xE6) == 0xE6 && (regs[1] & (1 << 16)) != 0;
+#else
+    __builtin_cpu_init();
+    if (engine == MD5Engine::AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+bool CpuSupports(MD5Engine engine) {
+    static const bool avx2 = QueryCpu(MD5Engine::AVX2);
+    static const bool avx512 = avx2 && QueryCpu(MD5Engine::AVX512);
+    return engine == MD5Engine::AVX512 ? avx512 : avx2;
+}
+
+#else
+
+bool CpuSupports(MD5Engine) {
+    return false;
+}
+
+#endif // MD5_X86
+
+// Falls back to the next narrower engine the CPU can actually run
+MD5Engine Resolve(MD5Engine engine) {
+    if (engine == MD5Engine::Auto) {
+        return DetectMD5Engine();
+    }
+    if (engine == MD5Engine::AVX512 && !CpuSupports(MD5Engine::AVX512)) {
+        engine = MD5Engine::AVX2;
+    }
+    if (engine == MD5Engine::AVX2 && !CpuSupports(MD5Engine::AVX2)) {
+        engine = MD5Engine::Scalar;
+    }
+    return engine;
+}
+
+// Runs `blocks` blocks for up to `width` lanes with the given SIMD engine
+void CompressLanes(MD5Engine engine, uint32_t* const* states, const uint8_t* const* data,
+                   size_t count, size_t blocks) {
+#if MD5_X86
+    uint32_t dummyState[16][4];
+    uint32_t* laneStates[16];
+    const uint8_t* laneData[16];
+    size_t width = engine == MD5Engine::AVX512 ? 16 : 8;
+    for (size_t l = 0; l < width; ++l) {
+        if (l < count) {
+            laneStates[l] = states[l];
+            laneData[l] = data[l];
+        } else {
+            // Idle lanes re-read lane 0's input and write into scratch state
+            laneStates[l] = dummyState[l];
+            laneData[l] = data[0];
+        }
+    }
+    if (engine == MD5Engine::AVX512) {
+        CompressAvx512(laneStates, laneData, blocks);
+    } else {
+        CompressAvx2(laneStates, laneData, blocks);
+    }
+#else
+    (void)engine;
+    for (size_t l = 0; l < count; ++l) {
+        CompressScalar(states[l], data[l], blocks);
+    }
+#endif
+}
+
+} // namespace
+
+MD5::MD5() {
+    Reset();
+}
+
+void MD5::Reset() {
+    std::memcpy(state_, kInitState, sizeof(state_));
+    length_ = 0;
+    buffered_ = 0;
+}
+
+void MD5::Update(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    length_ += size;
+
+    if (buffered_ > 0) {
+        size_t take = std::min(size, sizeof(buffer_) - buffered_);
+        std::memcpy(buffer_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        size -= take;
+        if (buffered_ < sizeof(buffer_)) {
+            return;
+        }
+        CompressScalar(state_, buffer_, 1);
+        buffered_ = 0;
+    }
+
+    size_t blocks = size / 64;
+    if (blocks > 0) {
+        CompressScalar(state_, p, blocks);
+        p += blocks * 64;
+        size -= blocks * 64;
+    }
+
+    if (size > 0) {
+        std::memcpy(buffer_, p, size);
+        buffered_ = size;
+    }
+}
+
+MD5Digest MD5::Final() {
+    uint64_t bitLength = length_ * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padLength = (buffered_ < 56) ? (56 - buffered_) : (120 - buffered_);
+    for (int i = 0; i < 8; ++i) {
+        padding[padLength + i] = uint8_t(bitLength >> (8 * i));
+    }
+    Update(padding, padLength + 8);
+
+    MD5Digest digest;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            digest[i * 4 + j] = uint8_t(state_[i] >> (8 * j));
+        }
+    }
+    Reset();
+    return digest;
+}
+
+std::string MD5::ToHex(const MD5Digest& digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result(32, '0');
+    for (size_t i = 0; i < digest.size(); ++i) {
+        result[2 * i] = digits[digest[i] >> 4];
+        result[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    return result;
+}
+
+MD5Engine DetectMD5Engine() {
+    static const MD5Engine detected = [] {
+        if (CpuSupports(MD5Engine::AVX512)) return MD5Engine::AVX512;
+        if (CpuSupports(MD5Engine::AVX2)) return MD5Engine::AVX2;
+        return MD5Engine::Scalar;
+    }();
+    return detected;
+}
+
+const char* MD5EngineName(MD5Engine engine) {
+    switch (Resolve(engine)) {
+    case MD5Engine::AVX512: return "avx512";
+    case MD5Engine::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+size_t MD5LaneCount(MD5Engine engine) {
+    switch (Resolve(engine)) {
+    case MD5Engine::AVX512: return 16;
+    case MD5Engine::AVX2: return 8;
+    default: return 1;
+    }
+}
+
+void MD5UpdateMany(MD5* const* contexts, const uint8_t* const* data,
+                   const size_t* sizes, size_t count, MD5Engine engine) {
+    engine = Resolve(engine);
+    if (engine == MD5Engine::Scalar || count < 2) {
+        for (size_t i = 0; i < count; ++i) {
+            contexts[i]->Update(data[i], sizes[i]);
+        }
+        return;
+    }
+
+    const size_t width = MD5LaneCount(engine);
+    std::vector<const uint8_t*> cursor(count);
+    std::vector<size_t> remaining(count);
+
+    // Top up partially filled block buffers first so every lane is block aligned
+    for (size_t i = 0; i < count; ++i) {
+        MD5& ctx = *contexts[i];
+        const uint8_t* p = data[i];
+        size_t size = sizes[i];
+        ctx.length_ += size;
+        if (ctx.buffered_ > 0) {
+            size_t take = std::min(size, sizeof(ctx.buffer_) - ctx.buffered_);
+            std::memcpy(ctx.buffer_ + ctx.buffered_, p, take);
+            ctx.buffered_ += take;
+            p += take;
+            size -= take;
+            if (ctx.buffered_ == sizeof(ctx.buffer_)) {
+                CompressScalar(ctx.state_, ctx.buffer_, 1);
+                ctx.buffered_ = 0;
+            }
+        }
+        cursor[i] = p;
+        remaining[i] = size;
+    }
+
+    // Lockstep over the lanes that still hold full blocks
+    std::vector<size_t> active;
+    active.reserve(count);
+    uint32_t* laneStates[16];
+    const uint8_t* laneData[16];
+    for (;;) {
+        active.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (remaining[i] >= 64) {
+                active.push_back(i);
+            }
+        }
+        if (active.empty()) {
+            break;
+        }
+        if (active.size() == 1) {
+            size_t i = active[0];
+            size_t blocks = remaining[i] / 64;
+            CompressScalar(contexts[i]->state_, cursor[i], blocks);
+            cursor[i] += blocks * 64;
+            remaining[i] -= blocks * 64;
+            continue;
+        }
+
+        size_t lanes = std::min(active.size(), width);
+        // Half-empty 16-lane batches are cheaper on the 8-lane kernel
+        MD5Engine laneEngine = lanes <= 8 ? MD5Engine::AVX2 : engine;
+        size_t blocks = SIZE_MAX;
+        for (size_t l = 0; l < lanes; ++l) {
+            size_t i = active[l];
+            laneStates[l] = contexts[i]->state_;
+            laneData[l] = cursor[i];
+            blocks = std::min(blocks, remaining[i] / 64);
+        }
+        CompressLanes(laneEngine, laneStates, laneData, lanes, blocks);
+        for (size_t l = 0; l < lanes; ++l) {
+            size_t i = active[l];
+            cursor[i] += blocks * 64;
+            remaining[i] -= blocks * 64;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (remaining[i] > 0) {
+            MD5& ctx = *contexts[i];
+            std::memcpy(ctx.buffer_ + ctx.buffered_, cursor[i], remaining[i]);
+            ctx.buffered_ += remaining[i];
+        }
+    }
+}
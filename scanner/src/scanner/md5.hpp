@@ -0,0 +1,51 @@
+#pragma once
+#include "scanner_export.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using MD5Digest = std::array<uint8_t, 16>;
+
+// Implementation used for the block compression function
+enum class MD5Engine {
+    Auto,    // best engine supported by the current CPU
+    Scalar,  // one stream at a time
+    AVX2,    // 8 streams per call
+    AVX512   // 16 streams per call
+};
+
+// Incremental MD5 context (RFC 1321)
+class SCANNER_API MD5 {
+public:
+    MD5();
+
+    void Reset();
+    void Update(const void* data, size_t size);
+    MD5Digest Final();
+
+    static std::string ToHex(const MD5Digest& digest);
+
+private:
+    friend SCANNER_API void MD5UpdateMany(MD5* const* contexts, const uint8_t* const* data,
+                                          const size_t* sizes, size_t count, MD5Engine engine);
+
+    uint32_t state_[4];
+    uint64_t length_;
+    uint8_t buffer_[64];
+    size_t buffered_;
+};
+
+// Engine picked by runtime CPU detection
+SCANNER_API MD5Engine DetectMD5Engine();
+SCANNER_API const char* MD5EngineName(MD5Engine engine);
+
+// Number of independent streams the engine hashes per call (1, 8 or 16)
+SCANNER_API size_t MD5LaneCount(MD5Engine engine = MD5Engine::Auto);
+
+// Updates `count` independent contexts at once, context i with data[i]/sizes[i].
+// Full blocks are compressed in lockstep across SIMD lanes; the result is the
+// same as calling contexts[i]->Update(data[i], sizes[i]) for every i.
+SCANNER_API void MD5UpdateMany(MD5* const* contexts, const uint8_t* const* data,
+                               const size_t* sizes, size_t count,
+                               MD5Engine engine = MD5Engine::Auto);
@@ -0,0 +1,310 @@
+#include "pattern_matcher.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PATTERN_AVX2 1
+#include <immintrin.h>
+#define PATTERN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+// The prefilter pays off only if most bytes cannot start a pattern
+const size_t MAX_PREFILTER_CANDIDATES = 64;
+// Same for the byte pairs, out of 65536
+const size_t MAX_PAIR_CANDIDATES = 8192;
+
+#ifdef PATTERN_AVX2
+
+bool CpuHasAVX2() {
+    static const bool avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return avx2;
+}
+
+// First position from `pos` whose byte is in the nibble-table set
+PATTERN_TARGET_AVX2 size_t FindCandidateAVX2(const uint8_t* data, size_t pos, size_t size,
+                                             const uint8_t* lowNibbles, const uint8_t* highNibbles) {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lowNibbles)));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(highNibbles)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i lowHit = _mm256_shuffle_epi8(low, _mm256_and_si256(bytes, nibble));
+        __m256i highHit = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+        __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(lowHit, highHit), _mm256_setzero_si256());
+        uint32_t hits = ~static_cast<uint32_t>(_mm256_movemask_epi8(miss));
+        if (hits != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(hits));
+        }
+    }
+    for (; pos < size; ++pos) {
+        if (lowNibbles[data[pos] & 0x0f] & highNibbles[data[pos] >> 4]) {
+            return pos;
+        }
+    }
+    return size;
+}
+
+#endif // PATTERN_AVX2
+
+} // namespace
+
+bool PatternMatcher::Scan(Cursor& cursor, const uint8_t* data, size_t size) const {
+    if (cursor.match != NO_MATCH) {
+        return true;
+    }
+    const uint32_t* table = table_.data();
+    const uint32_t matchStart = matchStart_;
+    uint32_t state = cursor.state;
+    size_t pos = 0;
+
+    auto found = [&] {
+        uint32_t pattern = matchPattern_[(state - matchStart) / classCount_];
+        cursor.state = state;
+        cursor.match = pattern;
+        cursor.matchOffset = cursor.offset + pos - lengths_[pattern];
+        cursor.offset += pos;
+        return true;
+    };
+
+    if (prefilter_) {
+        while (pos < size) {
+            if (state == 0) {
+                pos = SkipToCandidate(data, pos, size);
+                if (pos == size) {
+                    break;
+                }
+            }
+            // Follow the DFA until it falls back to the root
+            do {
+                state = table[state + classes_[data[pos++]]];
+                if (state >= matchStart) {
+                    return found();
+                }
+            } while (state != 0 && pos < size);
+        }
+    } else if (pairFilter_) {
+        while (pos < size) {
+            // With at most one byte open, the DFA state only depends on the
+            // previous byte, so it can restart from the root at the next pair
+            // that starts a pattern. A state carried over from the previous
+            // buffer is stepped as is.
+            if (state < shallowEnd_ && (state == 0 || pos > 0)) {
+                pos = SkipToPair(data, state == 0 ? pos : pos - 1, size);
+                state = table[classes_[data[pos++]]]; // no one-byte patterns here
+                if (pos == size) {
+                    break;
+                }
+            }
+            do {
+                state = table[state + classes_[data[pos++]]];
+                if (state >= matchStart) {
+                    return found();
+                }
+            } while (state >= shallowEnd_ && pos < size);
+        }
+    } else {
+        for (; pos < size; ++pos) {
+            state = table[state + classes_[data[pos]]];
+            if (state >= matchStart) {
+                ++pos;
+                return found();
+            }
+        }
+    }
+    cursor.state = state;
+    cursor.offset += size;
+    return false;
+}
+
+size_t PatternMatcher::SkipToCandidate(const uint8_t* data, size_t pos, size_t size) const {
+#ifdef PATTERN_AVX2
+    return FindCandidateAVX2(data, pos, size, lowNibbles_, highNibbles_);
+#else
+    (void)data;
+    (void)size;
+    return pos;
+#endif
+}
+
+size_t PatternMatcher::SkipToPair(const uint8_t* data, size_t pos, size_t size) const {
+    const uint64_t* pairs = pairs_.data();
+    for (; pos + 1 < size; ++pos) {
+        uint32_t pair = data[pos] | static_cast<uint32_t>(data[pos + 1]) << 8;
+        if ((pairs[pair >> 6] >> (pair & 63)) & 1) {
+            return pos;
+        }
+    }
+    return pos;
+}
+
+void PatternMatcherBuilder::Add(const uint8_t* bytes, size_t size, std::string_view verdict) {
+    patterns_.push_back(Pattern{std::vector<uint8_t>(bytes, bytes + size), std::string(verdict)});
+}
+
+std::shared_ptr<PatternMatcher> PatternMatcherBuilder::Build(size_t maxBytes) {
+    std::shared_ptr<PatternMatcher> matcher(new PatternMatcher());
+
+    // Byte classes: one per byte that occurs in a pattern, one for the rest
+    bool used[256] = {};
+    for (const auto& pattern : patterns_) {
+        for (uint8_t byte : pattern.bytes) {
+            used[byte] = true;
+        }
+    }
+    uint32_t classCount = 0;
+    bool anyUnused = std::find(std::begin(used), std::end(used), false) != std::end(used);
+    if (anyUnused) {
+        classCount = 1; // class 0
+    }
+    for (int byte = 0; byte < 256; ++byte) {
+        matcher->classes_[byte] = used[byte] ? static_cast<uint8_t>(classCount++) : 0;
+    }
+    if (classCount == 0) {
+        classCount = 1;
+    }
+    // 256 used bytes take classes 0..255, which still fits a uint8_t
+    matcher->classCount_ = classCount;
+
+    // Trie with dense rows, -1 - no edge
+    const size_t rowLimit = maxBytes / (classCount * sizeof(uint32_t));
+    std::vector<int32_t> next(classCount, -1);
+    std::vector<uint32_t> output(1, PatternMatcher::NO_MATCH);
+    std::vector<uint32_t> depth(1, 0);
+    std::vector<uint64_t> pairs(65536 / 64, 0);
+    size_t pairCount = 0;
+    bool shortPattern = false;
+    for (size_t index = 0; index < patterns_.size(); ++index) {
+        const auto& pattern = patterns_[index];
+        matcher->lengths_.push_back(static_cast<uint32_t>(pattern.bytes.size()));
+        matcher->verdicts_.push_back(pattern.verdict);
+        if (pattern.bytes.size() < 2) {
+            shortPattern = true;
+        } else {
+            uint32_t pair = pattern.bytes[0] | static_cast<uint32_t>(pattern.bytes[1]) << 8;
+            uint64_t bit = uint64_t{1} << (pair & 63);
+            pairCount += (pairs[pair >> 6] & bit) == 0;
+            pairs[pair >> 6] |= bit;
+        }
+        size_t state = 0;
+        for (uint8_t byte : pattern.bytes) {
+            int32_t& edge = next[state * classCount + matcher->classes_[byte]];
+            if (edge < 0) {
+                if (output.size() + 1 > rowLimit || output.size() >= INT32_MAX) {
+                    return nullptr;
+                }
+                edge = static_cast<int32_t>(output.size());
+                output.push_back(PatternMatcher::NO_MATCH);
+                depth.push_back(depth[state] + 1);
+                next.resize(next.size() + classCount, -1);
+            }
+            state = static_cast<size_t>(next[state * classCount + matcher->classes_[byte]]);
+        }
+        if (!pattern.bytes.empty() && output[state] == PatternMatcher::NO_MATCH) {
+            output[state] = static_cast<uint32_t>(index);
+        }
+    }
+    patterns_.clear();
+    const size_t stateCount = output.size();
+
+    // Breadth-first: failure links turn missing edges into DFA transitions,
+    // and a state also ends whatever its failure state ends
+    std::vector<uint32_t> fail(stateCount, 0);
+    std::vector<uint32_t> order;
+    order.reserve(stateCount);
+    for (uint32_t c = 0; c < classCount; ++c) {
+        int32_t& edge = next[c];
+        if (edge < 0) {
+            edge = 0;
+        } else {
+            order.push_back(static_cast<uint32_t>(edge));
+        }
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        uint32_t state = order[i];
+        output[state] = std::min(output[state], output[fail[state]]);
+        for (uint32_t c = 0; c < classCount; ++c) {
+            int32_t& edge = next[static_cast<size_t>(state) * classCount + c];
+            int32_t fallback = next[static_cast<size_t>(fail[state]) * classCount + c];
+            if (edge < 0) {
+                edge = fallback;
+            } else {
+                fail[edge] = static_cast<uint32_t>(fallback);
+                order.push_back(static_cast<uint32_t>(edge));
+            }
+        }
+    }
+
+    // Renumber: the root and the states one byte deep first, match states
+    // last, and store row offsets
+    std::vector<uint32_t> id(stateCount);
+    uint32_t plain = 0;
+    for (size_t state = 0; state < stateCount; ++state) {
+        if (depth[state] <= 1 && output[state] == PatternMatcher::NO_MATCH) {
+            id[state] = plain++;
+        }
+    }
+    const uint32_t shallow = plain;
+    for (size_t state = 0; state < stateCount; ++state) {
+        if (depth[state] > 1 && output[state] == PatternMatcher::NO_MATCH) {
+            id[state] = plain++;
+        }
+    }
+    uint32_t matching = plain;
+    for (size_t state = 0; state < stateCount; ++state) {
+        if (output[state] != PatternMatcher::NO_MATCH) {
+            id[state] = matching++;
+            matcher->matchPattern_.push_back(output[state]);
+        }
+    }
+    matcher->stateCount_ = stateCount;
+    matcher->matchStart_ = plain * classCount;
+    matcher->shallowEnd_ = shallow * classCount;
+    matcher->table_.resize(stateCount * classCount);
+    for (size_t state = 0; state < stateCount; ++state) {
+        uint32_t* row = &matcher->table_[static_cast<size_t>(id[state]) * classCount];
+        for (uint32_t c = 0; c < classCount; ++c) {
+            row[c] = id[next[state * classCount + c]] * classCount;
+        }
+    }
+
+    // Prefilter over the bytes that leave the root. High nibbles get a
+    // bucket bit each (shared once there are more than 8), so the tables
+    // may pass a few extra bytes but never miss one.
+    uint8_t bucketOf[16];
+    size_t buckets = 0;
+    std::fill(std::begin(bucketOf), std::end(bucketOf), 0xff);
+    for (int byte = 0; byte < 256; ++byte) {
+        if (matcher->table_[matcher->classes_[byte]] == 0) {
+            continue;
+        }
+        uint8_t high = static_cast<uint8_t>(byte >> 4);
+        if (bucketOf[high] == 0xff) {
+            bucketOf[high] = static_cast<uint8_t>(buckets++ % 8);
+        }
+        uint8_t bit = static_cast<uint8_t>(1u << bucketOf[high]);
+        matcher->highNibbles_[high] |= bit;
+        matcher->lowNibbles_[byte & 0x0f] |= bit;
+    }
+    size_t candidates = 0;
+    for (int byte = 0; byte < 256; ++byte) {
+        if (matcher->lowNibbles_[byte & 0x0f] & matcher->highNibbles_[byte >> 4]) {
+            candidates++;
+        }
+    }
+#ifdef PATTERN_AVX2
+    matcher->prefilter_ = candidates > 0 && candidates <= MAX_PREFILTER_CANDIDATES && CpuHasAVX2();
+#else
+    (void)candidates;
+#endif
+    if (!matcher->prefilter_ && !shortPattern && pairCount > 0 && pairCount <= MAX_PAIR_CANDIDATES) {
+        matcher->pairFilter_ = true;
+        matcher->pairs_ = std::move(pairs);
+    }
+    return matcher;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "scanner_export.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Byte-pattern signatures compiled into one Aho-Corasick automaton, run over
+// the buffers a file is hashed from, so a payload changed elsewhere in the
+// file is still found and no extra read pass is needed.
+// The automaton is a dense DFA over byte classes (bytes no pattern contains
+// share one class) with row offsets as state ids and the states that end a
+// pattern numbered last, so each byte costs one table load and one compare.
+// While the DFA is at its root, a SIMD prefilter (AVX2 nibble shuffles)
+// skips 32 bytes at a time that cannot start any pattern. Large sets start
+// with too many different bytes for that; they skip instead to the next
+// byte pair that starts a pattern, looked up in an 8 KB bitmap.
+class SCANNER_API PatternMatcher {
+public:
+    static constexpr uint32_t NO_MATCH = UINT32_MAX;
+
+    // Automaton position carried from one buffer of a file to the next
+    struct Cursor {
+        uint32_t state = 0;
+        uint64_t offset = 0; // bytes scanned so far
+        uint32_t match = NO_MATCH;
+        uint64_t matchOffset = 0; // where the match starts in the file
+    };
+
+    PatternMatcher(const PatternMatcher&) = delete;
+    PatternMatcher& operator=(const PatternMatcher&) = delete;
+
+    // Scans the next bytes of a file. Stops at the first match, later calls
+    // then return at once; true if the cursor holds a match.
+    bool Scan(Cursor& cursor, const uint8_t* data, size_t size) const;
+
+    size_t Size() const { return lengths_.size(); }
+    size_t StateCount() const { return stateCount_; }
+    size_t MemoryBytes() const { return table_.size() * sizeof(uint32_t); }
+    bool HasPrefilter() const { return prefilter_ || pairFilter_; }
+
+    std::string_view Verdict(uint32_t pattern) const { return verdicts_[pattern]; }
+    size_t Length(uint32_t pattern) const { return lengths_[pattern]; }
+
+private:
+    friend class PatternMatcherBuilder;
+
+    PatternMatcher() = default;
+    size_t SkipToCandidate(const uint8_t* data, size_t pos, size_t size) const;
+    // First position from `pos` where a pattern can start; size - 1 if the
+    // pair there would cross the end of the buffer
+    size_t SkipToPair(const uint8_t* data, size_t pos, size_t size) const;
+
+    uint8_t classes_[256] = {};
+    uint32_t classCount_ = 0;
+    std::vector<uint32_t> table_;       // stateCount_ rows of classCount_ next-state ids
+    uint32_t matchStart_ = 0;           // ids from here on end a pattern
+    uint32_t shallowEnd_ = 0;           // ids below are the root and one byte deep
+    std::vector<uint32_t> matchPattern_; // pattern ended by each match state
+    size_t stateCount_ = 0;
+    std::vector<uint32_t> lengths_;
+    std::vector<std::string> verdicts_;
+
+    // Nibble tables over the bytes that leave the root
+    bool prefilter_ = false;
+    uint8_t lowNibbles_[16] = {};
+    uint8_t highNibbles_[16] = {};
+    // Bitmap over the first two bytes of the patterns, indexed by b0 | b1 << 8
+    bool pairFilter_ = false;
+    std::vector<uint64_t> pairs_;
+};
+
+// Collects patterns and compiles the automaton. Where several patterns end
+// at the same byte, the one added first is reported.
+class SCANNER_API PatternMatcherBuilder {
+public:
+    void Add(const uint8_t* bytes, size_t size, std::string_view verdict);
+    size_t Size() const { return patterns_.size(); }
+
+    // nullptr if the DFA would need more than `maxBytes` of tables
+    std::shared_ptr<PatternMatcher> Build(size_t maxBytes = 512u << 20);
+
+private:
+    struct Pattern {
+        std::vector<uint8_t> bytes;
+        std::string verdict;
+    };
+    std::vector<Pattern> patterns_;
+};
@@ -0,0 +1,227 @@
+#include "scan_cache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace {
+
+// Cache file layout (host byte order): CacheHeader, then `count` entries
+// sorted by (device, inode)
+const char CACHE_MAGIC[8] = {'M', 'W', 'C', 'A', 'C', 'H', 'E', '1'};
+const uint32_t CACHE_VERSION = 2;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t count;
+};
+
+template<class A, class B>
+bool KeyLess(const A& a, const B& b) {
+    return a.device < b.device || (a.device == b.device && a.inode < b.inode);
+}
+
+bool SyncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifndef _WIN32
+    return fsync(fileno(file)) == 0;
+#else
+    return _commit(_fileno(file)) == 0;
+#endif
+}
+
+// Makes a rename into the directory of `path` survive a crash
+bool SyncParentDirectory(const std::string& path) {
+#ifndef _WIN32
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+} // namespace
+
+#ifndef _WIN32
+void FileIdentityFromStat(const struct stat& st, FileIdentity& identity) {
+    identity.device = static_cast<uint64_t>(st.st_dev);
+    identity.inode = static_cast<uint64_t>(st.st_ino);
+    identity.size = static_cast<uint64_t>(st.st_size);
+    identity.links = static_cast<uint64_t>(st.st_nlink);
+#ifdef __APPLE__
+    identity.mtimeNs = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    identity.ctimeNs = int64_t(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    identity.mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    identity.ctimeNs = int64_t(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+}
+#endif
+
+bool GetFileIdentity(const std::string& path, FileIdentity& identity) {
+#ifndef _WIN32
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    FileIdentityFromStat(st, identity);
+    return true;
+#else
+    (void)path;
+    (void)identity;
+    return false;
+#endif
+}
+
+ScanCache::Entry ScanCache::MakeEntry(const FileIdentity& identity, const FileDigests& digests,
+                                     uint32_t flags) {
+    Entry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    entry.device = identity.device;
+    entry.inode = identity.inode;
+    entry.size = identity.size;
+    entry.mtimeNs = identity.mtimeNs;
+    entry.ctimeNs = identity.ctimeNs;
+    entry.types = digests.types;
+    entry.flags = flags;
+    std::memcpy(entry.digests, digests.bytes, sizeof(entry.digests));
+    return entry;
+}
+
+bool ScanCache::Open(const std::string& path) {
+    std::ifstream probe(path, std::ios::binary);
+    if (!probe) {
+        return true;
+    }
+    probe.close();
+
+    if (!file_.Open(path) || file_.Size() < sizeof(CacheHeader)) {
+        return false;
+    }
+    CacheHeader header;
+    std::memcpy(&header, file_.Data(), sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION || header.entrySize != sizeof(Entry) ||
+        header.count > (file_.Size() - sizeof(CacheHeader)) / sizeof(Entry)) {
+        return false;
+    }
+
+    entries_ = reinterpret_cast<const Entry*>(file_.Data() + sizeof(CacheHeader));
+    count_ = header.count;
+    seen_.reset(new std::atomic<bool>[count_]());
+    return true;
+}
+
+bool ScanCache::Lookup(const FileIdentity& identity, DigestSet types, FileDigests& digests,
+                       uint32_t* flags) {
+    Entry entry;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(freshMutex_);
+        auto it = fresh_.find({identity.device, identity.inode});
+        if (it != fresh_.end()) {
+            entry = it->second;
+            found = true;
+        }
+    }
+    if (!found) {
+        const Entry* end = entries_ + count_;
+        const Entry* it = std::lower_bound(entries_, end, identity,
+                                           [](const Entry& a, const FileIdentity& b) { return KeyLess(a, b); });
+        if (it == end || it->device != identity.device || it->inode != identity.inode) {
+            return false;
+        }
+        seen_[it - entries_].store(true, std::memory_order_relaxed);
+        entry = *it;
+    }
+
+    if (entry.size != identity.size || entry.mtimeNs != identity.mtimeNs ||
+        entry.ctimeNs != identity.ctimeNs || (entry.types & types) != types) {
+        return false;
+    }
+    digests.types = entry.types;
+    std::memcpy(digests.bytes, entry.digests, sizeof(digests.bytes));
+    if (flags) {
+        *flags = entry.flags;
+    }
+    return true;
+}
+
+void ScanCache::Store(const FileIdentity& identity, const FileDigests& digests, uint32_t flags) {
+    std::lock_guard<std::mutex> lock(freshMutex_);
+    fresh_[{identity.device, identity.inode}] = MakeEntry(identity, digests, flags);
+    stores_++;
+}
+
+bool ScanCache::Save(const std::string& path, bool compact) {
+    std::vector<Entry> merged;
+    uint64_t stores;
+    {
+        std::lock_guard<std::mutex> lock(freshMutex_);
+        stores = stores_;
+        merged.reserve(count_ + fresh_.size());
+        for (size_t i = 0; i < count_; ++i) {
+            if (compact && !seen_[i].load(std::memory_order_relaxed)) {
+                continue;
+            }
+            if (fresh_.count({entries_[i].device, entries_[i].inode}) == 0) {
+                merged.push_back(entries_[i]);
+            }
+        }
+        for (const auto& item : fresh_) {
+            merged.push_back(item.second);
+        }
+    }
+    std::sort(merged.begin(), merged.end(), [](const Entry& a, const Entry& b) { return KeyLess(a, b); });
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.entrySize = sizeof(Entry);
+    header.count = merged.size();
+
+    // The data is on disk before the rename can be, so a crash leaves
+    // either the old cache or the whole new one
+    std::string tempPath = path + ".tmp";
+    std::FILE* out = std::fopen(tempPath.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    bool written = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                   std::fwrite(merged.data(), sizeof(Entry), merged.size(), out) == merged.size() &&
+                   SyncFile(out);
+    if (std::fclose(out) != 0 || !written) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0 || !SyncParentDirectory(path)) {
+        return false;
+    }
+    savedStores_ = stores;
+    return true;
+}
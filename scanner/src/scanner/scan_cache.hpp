@@ -0,0 +1,93 @@
+#pragma once
+#include "digest.hpp"
+#include "mapped_file.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// What identifies a file version: where it lives and when it last changed
+struct FileIdentity {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    int64_t ctimeNs = 0;
+    uint64_t links = 1; // hard link count, not part of the cache key
+};
+
+// Hash of a (device, inode) key
+struct FileKeyHash {
+    size_t operator()(const std::pair<uint64_t, uint64_t>& key) const {
+        return std::hash<uint64_t>()(key.first * 0x9E3779B97F4A7C15ull ^ key.second);
+    }
+};
+
+// stat() of `path`; false on error or on platforms without inode numbers
+bool GetFileIdentity(const std::string& path, FileIdentity& identity);
+
+#ifndef _WIN32
+struct stat;
+void FileIdentityFromStat(const struct stat& st, FileIdentity& identity);
+#endif
+
+// Persistent map from file identity to content digest. The file on disk is
+// a sorted array that is memory-mapped and binary searched; digests computed
+// during a scan are collected separately and merged in by Save.
+// Only digests are cached, never verdicts: a cached digest is looked up in
+// whatever base is loaded, so a base update takes effect without re-reading
+// unchanged files.
+class ScanCache {
+public:
+    // A missing file is an empty cache. A corrupt one is ignored (and will be
+    // replaced on Save), Open then returns false.
+    bool Open(const std::string& path);
+
+    // Set on files found to be archives: only the digests of the whole file
+    // are cached, so scanning their members means reading them again
+    static constexpr uint32_t ARCHIVE = 1;
+
+    // Thread safe. Hits only if size, mtime and ctime are unchanged and the
+    // entry holds at least the digests in `types`.
+    bool Lookup(const FileIdentity& identity, DigestSet types, FileDigests& digests,
+                uint32_t* flags = nullptr);
+    void Store(const FileIdentity& identity, const FileDigests& digests, uint32_t flags = 0);
+
+    // Writes the merged cache atomically (temporary file + rename), synced
+    // to disk before and after the rename. With `compact` only entries looked
+    // up or stored since Open are kept, which drops files that were deleted
+    // or are outside the scanned tree. May run alongside Lookup and Store.
+    bool Save(const std::string& path, bool compact);
+    // True if entries were stored since Open or the last successful Save
+    bool Changed() const { return stores_.load(std::memory_order_relaxed) != savedStores_; }
+
+    size_t Size() const { return count_ + fresh_.size(); }
+
+private:
+    struct Entry {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtimeNs;
+        int64_t ctimeNs;
+        DigestSet types;
+        uint32_t flags;
+        uint8_t digests[FileDigests::TOTAL_SIZE];
+    };
+
+    static Entry MakeEntry(const FileIdentity& identity, const FileDigests& digests, uint32_t flags);
+
+    MappedFile file_;
+    const Entry* entries_ = nullptr;
+    size_t count_ = 0;
+    std::unique_ptr<std::atomic<bool>[]> seen_;
+
+    std::mutex freshMutex_;
+    std::unordered_map<std::pair<uint64_t, uint64_t>, Entry, FileKeyHash> fresh_;
+    std::atomic<uint64_t> stores_{0};
+    std::atomic<uint64_t> savedStores_{0};
+};
@@ -0,0 +1,380 @@
+#include "scan_checkpoint.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+
+namespace {
+
+const char CHECKPOINT_MAGIC[8] = {'S', 'C', 'A', 'N', 'C', 'K', 'P', '2'};
+
+uint64_t Fnv1a(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void PutU64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutString(std::string& out, const std::string& value) {
+    PutU64(out, value.size());
+    out.append(value);
+}
+
+// Bounds-checked reads; every Get fails once the input ran short
+class Input {
+public:
+    Input(const char* data, size_t size) : data_(data), left_(size) {}
+
+    bool GetU64(uint64_t& value) {
+        if (left_ < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, data_, sizeof(value));
+        data_ += sizeof(value);
+        left_ -= sizeof(value);
+        return true;
+    }
+
+    bool GetString(std::string& value) {
+        uint64_t size;
+        if (!GetU64(size) || size > left_) {
+            return false;
+        }
+        value.assign(data_, static_cast<size_t>(size));
+        data_ += size;
+        left_ -= static_cast<size_t>(size);
+        return true;
+    }
+
+    bool AtEnd() const { return left_ == 0; }
+
+private:
+    const char* data_;
+    size_t left_;
+};
+
+// Counters kept in a checkpoint, in file order
+template<class Result, class Fn>
+void ForEachCounter(Result& result, Fn&& fn) {
+    fn(result.totalFiles);
+    fn(result.maliciousFiles);
+    fn(result.errorCount);
+    fn(result.skippedBySize);
+    fn(result.bytesSkippedBySize);
+    fn(result.cacheHits);
+    fn(result.dedupedFiles);
+    fn(result.dedupedBytes);
+    fn(result.archiveMembers);
+    fn(result.skippedMembers);
+    fn(result.damagedArchives);
+    fn(result.filteredFiles);
+    fn(result.filteredDirectories);
+}
+
+void PutNames(std::string& out, const std::vector<std::string>& done,
+              const std::unordered_set<std::string>& saved) {
+    PutU64(out, done.size() + saved.size());
+    for (const auto& name : done) {
+        PutString(out, name);
+    }
+    for (const auto& name : saved) {
+        PutString(out, name);
+    }
+}
+
+bool GetNames(Input& in, std::vector<std::string>& names) {
+    uint64_t count;
+    if (!in.GetU64(count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string name;
+        if (!in.GetString(name)) {
+            return false;
+        }
+        names.push_back(std::move(name));
+    }
+    return true;
+}
+
+} // namespace
+
+ScanCheckpoint::ScanCheckpoint(std::string root, size_t slots)
+    : root_(std::move(root)), found_(std::max<size_t>(slots, 1)) {}
+
+bool ScanCheckpoint::Load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(CHECKPOINT_MAGIC) + sizeof(uint64_t) ||
+        std::memcmp(data.data(), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+        return false;
+    }
+    size_t bodySize = data.size() - sizeof(uint64_t);
+    uint64_t checksum;
+    std::memcpy(&checksum, data.data() + bodySize, sizeof(checksum));
+    if (checksum != Fnv1a(data.data(), bodySize)) {
+        return false; // cut off or damaged
+    }
+
+    Input in(data.data() + sizeof(CHECKPOINT_MAGIC), bodySize - sizeof(CHECKPOINT_MAGIC));
+    std::string root;
+    uint64_t rootDone;
+    if (!in.GetString(root) || root != root_ || !in.GetU64(rootDone)) {
+        return false;
+    }
+    ScanResult restored;
+    bool ok = true;
+    ForEachCounter(restored, [&](auto& counter) {
+        uint64_t value = 0;
+        ok = ok && in.GetU64(value);
+        counter = static_cast<std::remove_reference_t<decltype(counter)>>(value);
+    });
+    uint64_t detectionCount;
+    if (!ok || !in.GetU64(detectionCount)) {
+        return false;
+    }
+    std::vector<Detection> detections;
+    for (uint64_t i = 0; i < detectionCount; ++i) {
+        Detection detection;
+        if (!in.GetString(detection.path) || !in.GetString(detection.hash) || !in.GetString(detection.verdict)) {
+            return false;
+        }
+        detections.push_back(std::move(detection));
+    }
+    uint64_t nodeCount;
+    if (!in.GetU64(nodeCount)) {
+        return false;
+    }
+    std::unordered_map<std::string, Progress> saved;
+    for (uint64_t i = 0; i < nodeCount; ++i) {
+        std::string nodePath;
+        if (!in.GetString(nodePath)) {
+            return false;
+        }
+        Progress& progress = saved[nodePath];
+        if (!GetNames(in, progress.doneChildren) || !GetNames(in, progress.doneFiles)) {
+            return false;
+        }
+    }
+    if (!in.AtEnd()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    restored_ = restored;
+    rootDone_ = rootDone != 0;
+    filesDone_ = restored.totalFiles;
+    detections_ = std::move(detections);
+    saved_ = std::move(saved);
+    return true;
+}
+
+bool ScanCheckpoint::Save(const std::string& path, const std::function<ScanResult()>& counters) {
+    std::string data(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    {
+        // Workers wait for the copy, not for the disk
+        std::lock_guard<std::mutex> lock(mutex_);
+        PutString(data, root_);
+        PutU64(data, rootDone_ ? 1 : 0);
+        ScanResult counts = counters();
+        counts.totalFiles = static_cast<size_t>(filesDone_);
+        counts.maliciousFiles = detections_.size();
+        ForEachCounter(counts, [&](const auto& counter) { PutU64(data, static_cast<uint64_t>(counter)); });
+
+        PutU64(data, detections_.size());
+        for (const auto& detection : detections_) {
+            PutString(data, detection.path);
+            PutString(data, detection.hash);
+            PutString(data, detection.verdict);
+        }
+
+        // Directories found but not listed yet have nothing to keep
+        size_t countAt = data.size();
+        uint64_t nodeCount = 0;
+        PutU64(data, 0);
+        const std::unordered_set<std::string> none;
+        for (const Node* node : live_) {
+            const Progress& progress = node->progress;
+            if (progress.doneChildren.empty() && progress.doneFiles.empty() &&
+                node->savedChildren.empty() && node->savedFiles.empty()) {
+                continue;
+            }
+            PutString(data, node->path);
+            PutNames(data, progress.doneChildren, node->savedChildren);
+            PutNames(data, progress.doneFiles, node->savedFiles);
+            ++nodeCount;
+        }
+        // Progress from before the restart in directories not reached again yet
+        for (const auto& entry : saved_) {
+            PutString(data, entry.first);
+            PutNames(data, entry.second.doneChildren, none);
+            PutNames(data, entry.second.doneFiles, none);
+            ++nodeCount;
+        }
+        std::memcpy(&data[countAt], &nodeCount, sizeof(nodeCount));
+    }
+    PutU64(data, Fnv1a(data.data(), data.size()));
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out.flush()) {
+            return false;
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+ScanCheckpoint::NodePtr ScanCheckpoint::Root() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rootDone_) {
+        return nullptr;
+    }
+    auto node = std::make_shared<Node>();
+    node->path = root_;
+    auto saved = saved_.find(root_);
+    if (saved != saved_.end()) {
+        node->savedChildren.insert(saved->second.doneChildren.begin(), saved->second.doneChildren.end());
+        node->savedFiles.insert(saved->second.doneFiles.begin(), saved->second.doneFiles.end());
+        saved_.erase(saved);
+    }
+    live_.insert(node.get());
+    return node;
+}
+
+ScanCheckpoint::NodePtr ScanCheckpoint::Enter(const NodePtr& parent, const std::string& path, size_t nameOffset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!parent->savedChildren.empty()) {
+        auto done = parent->savedChildren.find(path.substr(nameOffset));
+        if (done != parent->savedChildren.end()) {
+            parent->progress.doneChildren.push_back(std::move(parent->savedChildren.extract(done).value()));
+            return nullptr;
+        }
+    }
+    auto node = std::make_shared<Node>();
+    node->parent = parent;
+    node->path = path;
+    node->nameOffset = nameOffset;
+    auto saved = saved_.find(path);
+    if (saved != saved_.end()) {
+        node->savedChildren.insert(saved->second.doneChildren.begin(), saved->second.doneChildren.end());
+        node->savedFiles.insert(saved->second.doneFiles.begin(), saved->second.doneFiles.end());
+        saved_.erase(saved);
+    }
+    parent->pending++;
+    live_.insert(node.get());
+    return node;
+}
+
+bool ScanCheckpoint::Skip(const NodePtr& dir, const char* name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dir->savedFiles.empty()) {
+        return false;
+    }
+    auto done = dir->savedFiles.find(name);
+    if (done == dir->savedFiles.end()) {
+        return false;
+    }
+    dir->progress.doneFiles.push_back(std::move(dir->savedFiles.extract(done).value()));
+    return true;
+}
+
+void ScanCheckpoint::Queued(const NodePtr& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dir->pending++;
+}
+
+void ScanCheckpoint::Found(size_t slot, Detection detection) {
+    found_[slot].push_back(std::move(detection));
+}
+
+void ScanCheckpoint::FileDone(const NodePtr& dir, const char* name, bool queued, size_t slot) {
+    std::vector<Detection>& found = found_[slot];
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& detection : found) {
+        detections_.push_back(std::move(detection));
+    }
+    found.clear();
+    dir->progress.doneFiles.emplace_back(name);
+    filesDone_++;
+    if (queued && --dir->pending == 0) {
+        Release(dir);
+    }
+}
+
+void ScanCheckpoint::Listed(const NodePtr& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--dir->pending == 0) {
+        Release(dir);
+    }
+}
+
+void ScanCheckpoint::Release(NodePtr node) {
+    // A done directory becomes a name in its parent and gives its lists up;
+    // the parent may be done with it
+    while (node) {
+        live_.erase(node.get());
+        NodePtr parent = std::move(node->parent);
+        node->progress = Progress();
+        node->savedChildren.clear();
+        node->savedFiles.clear();
+        if (!parent) {
+            rootDone_ = true;
+            return;
+        }
+        parent->progress.doneChildren.push_back(node->path.substr(node->nameOffset));
+        if (--parent->pending != 0) {
+            return;
+        }
+        node = std::move(parent);
+    }
+}
+
+CheckpointSaver::CheckpointSaver(ScanCheckpoint& checkpoint, std::string path, unsigned intervalMs,
+                                 std::function<ScanResult()> counters)
+    : checkpoint_(checkpoint), path_(std::move(path)), intervalMs_(std::max(intervalMs, 1u)),
+      counters_(std::move(counters)) {
+    thread_ = std::thread([this] { Run(); });
+}
+
+CheckpointSaver::~CheckpointSaver() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void CheckpointSaver::Run() {
+    bool warned = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, std::chrono::milliseconds(intervalMs_), [this] { return stopping_; })) {
+        lock.unlock();
+        if (!checkpoint_.Save(path_, counters_) && !warned) {
+            std::cerr << "Warning: Could not save checkpoint: " << path_ << std::endl;
+            warned = true;
+        }
+        lock.lock();
+    }
+}
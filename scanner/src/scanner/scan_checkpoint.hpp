@@ -0,0 +1,128 @@
+#pragma once
+#include "scanner_export.hpp"
+#include "scanner.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Progress of a directory walk, saved to a file now and then so a scan
+// that dies can go on where it stopped. A directory is done once it was
+// listed and everything below it is done; only the topmost done ones are
+// kept, together with the names of the files done in directories still in
+// progress, the counters and the detections so far. That is the frontier
+// of the walk, so the file stays small however much was scanned, and a
+// resumed walk skips done subtrees without listing them again.
+// Files in flight when the checkpoint is taken are scanned again.
+class SCANNER_API ScanCheckpoint {
+public:
+    class Node;
+    using NodePtr = std::shared_ptr<Node>;
+
+    struct Detection {
+        std::string path;
+        std::string hash;
+        std::string verdict;
+    };
+
+    // Detections wait per slot (a worker or the walk) for their file to be done
+    explicit ScanCheckpoint(std::string root, size_t slots = 1);
+
+    // Takes over the progress saved in `path` if it is a walk of the same
+    // root. False if there is none or it cannot be used; the walk then
+    // starts from scratch.
+    bool Load(const std::string& path);
+    // Replaces `path` atomically (temporary file + rename). `counters` is
+    // called under the lock that keeps the saved state consistent; files
+    // and detections are counted here instead.
+    bool Save(const std::string& path, const std::function<ScanResult()>& counters);
+
+    // Counters and detections taken over by Load; read them before the walk starts
+    const ScanResult& Restored() const { return restored_; }
+    const std::vector<Detection>& RestoredDetections() const { return detections_; }
+
+    // The walk's root; nullptr if it was done before
+    NodePtr Root();
+    // A subdirectory found in `parent`, its name starting at `nameOffset` of
+    // `path`; nullptr if it was done before (it is skipped, nothing below it
+    // is counted)
+    NodePtr Enter(const NodePtr& parent, const std::string& path, size_t nameOffset);
+    // True if file `name` of `dir` was done before; it is skipped
+    bool Skip(const NodePtr& dir, const char* name);
+    // A file of `dir` was handed to the workers; its FileDone completes it
+    void Queued(const NodePtr& dir);
+    // A detection in the file `slot` works on; it is kept with FileDone, so a
+    // file scanned again after a restart is not reported twice. Each slot is
+    // used by one thread at a time.
+    void Found(size_t slot, Detection detection);
+    // File `name` of `dir` is done, with the detections `slot` found in it.
+    // `queued` as told through Queued.
+    void FileDone(const NodePtr& dir, const char* name, bool queued, size_t slot);
+    // All entries of `dir` have been listed (or it could not be read)
+    void Listed(const NodePtr& dir);
+
+private:
+    struct Progress {
+        std::vector<std::string> doneChildren;
+        std::vector<std::string> doneFiles;
+    };
+
+    void Release(NodePtr node);
+
+    std::string root_;
+    std::vector<std::vector<Detection>> found_; // by slot, not under the lock
+    mutable std::mutex mutex_;
+    ScanResult restored_;
+    bool rootDone_ = false;
+    uint64_t filesDone_ = 0;
+    std::vector<Detection> detections_;
+    std::unordered_set<Node*> live_; // listed or waiting to be, not done
+    // Saved progress of directories not yet entered, by path
+    std::unordered_map<std::string, Progress> saved_;
+};
+
+// Saves a checkpoint every `intervalMs` on a thread of its own until it is
+// destroyed. Workers only ever wait for the copy taken under the
+// checkpoint's lock, never for the disk.
+class CheckpointSaver {
+public:
+    CheckpointSaver(ScanCheckpoint& checkpoint, std::string path, unsigned intervalMs,
+                    std::function<ScanResult()> counters);
+    ~CheckpointSaver();
+
+    CheckpointSaver(const CheckpointSaver&) = delete;
+    CheckpointSaver& operator=(const CheckpointSaver&) = delete;
+
+private:
+    void Run();
+
+    ScanCheckpoint& checkpoint_;
+    std::string path_;
+    unsigned intervalMs_;
+    std::function<ScanResult()> counters_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+class ScanCheckpoint::Node {
+private:
+    friend class ScanCheckpoint;
+
+    NodePtr parent;
+    std::string path;
+    size_t nameOffset = 0;
+    size_t pending = 1; // the listing, queued files and subdirectories not done
+    Progress progress;
+    // Done before the restart
+    std::unordered_set<std::string> savedChildren;
+    std::unordered_set<std::string> savedFiles;
+};
@@ -0,0 +1,385 @@
+#include "scan_coordinator.hpp"
+#ifndef _WIN32
+#include "detection_log.hpp"
+#include "scan_filter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// How often a starting worker is checked for its socket
+const unsigned START_POLL_MS = 50;
+// How long a stopped worker gets to exit before it is killed
+const unsigned STOP_WAIT_MS = 5000;
+
+// Subtree to scan whole (`directory` set) or a list of files
+struct Shard {
+    std::string directory;
+    std::vector<std::string> files;
+    unsigned attempts = 0;
+};
+
+// Reply of one shard, kept until its DONE line arrives
+struct ShardReply {
+    struct Found {
+        std::string path;
+        std::string hash;
+        std::string verdict;
+    };
+    std::vector<Found> found;
+    size_t files = 0;
+    size_t malicious = 0;
+    size_t errors = 0;
+    bool errorReply = false;
+
+    void Parse(const std::string& line) {
+        if (line.compare(0, 6, "FOUND\t") == 0) {
+            // Paths may hold tabs, hashes and verdicts do not
+            size_t verdict = line.rfind('\t');
+            size_t hash = line.rfind('\t', verdict - 1);
+            if (hash > 5) {
+                found.push_back({line.substr(6, hash - 6), line.substr(hash + 1, verdict - hash - 1),
+                                 line.substr(verdict + 1)});
+            }
+        } else if (line.compare(0, 5, "DONE\t") == 0) {
+            for (size_t pos = 5; pos < line.size();) {
+                size_t end = std::min(line.find('\t', pos), line.size());
+                std::string field = line.substr(pos, end - pos);
+                size_t equals = field.find('=');
+                if (equals != std::string::npos) {
+                    std::string key = field.substr(0, equals);
+                    size_t value = std::strtoull(field.c_str() + equals + 1, nullptr, 10);
+                    if (key == "files") {
+                        files = value;
+                    } else if (key == "malicious") {
+                        malicious = value;
+                    } else if (key == "errors") {
+                        errors = value;
+                    }
+                }
+                pos = end + 1;
+            }
+        } else if (line.compare(0, 6, "ERROR\t") == 0) {
+            errorReply = true;
+        }
+    }
+};
+
+// Lists one level of `directory`: subdirectories become shards of their
+// own, its files go out in lists of up to `filesPerShard`. Like the scans
+// themselves, symlinks to directories are not followed. Entries the filter
+// rules out are only counted. False if the directory could not be read
+// (completely).
+bool SplitShard(const std::string& directory, size_t filesPerShard, const ScanFilter* filter,
+                std::vector<Shard>& parts, ScanResult& counts) {
+    std::error_code ec;
+    fs::directory_iterator it(directory, ec), end;
+    if (ec) {
+        return false;
+    }
+    Shard files;
+    for (; it != end; it.increment(ec)) {
+        const auto& entry = *it;
+        std::error_code typeError;
+        std::string path = entry.path().string();
+        bool isDirectory = entry.is_directory(typeError) && !entry.is_symlink(typeError);
+        if (!isDirectory && !entry.is_regular_file(typeError)) {
+            continue;
+        }
+        if (path.find('\n') != std::string::npos) {
+            counts.errorCount++; // cannot be put into a protocol line
+            continue;
+        }
+        if (filter) {
+            // Path independent: the root state stands for any directory
+            std::string name = entry.path().filename().string();
+            ScanFilter::State child;
+            if (isDirectory && !filter->EnterDirectory(filter->Root(), name.c_str(), child)) {
+                counts.filteredDirectories++;
+                continue;
+            }
+            if (!isDirectory && !filter->MatchFile(filter->Root(), name.c_str())) {
+                counts.filteredFiles++;
+                continue;
+            }
+        }
+        if (isDirectory) {
+            Shard child;
+            child.directory = std::move(path);
+            parts.push_back(std::move(child));
+            continue;
+        }
+        files.files.push_back(std::move(path));
+        if (files.files.size() == filesPerShard) {
+            parts.push_back(std::move(files));
+            files = Shard();
+        }
+    }
+    if (!files.files.empty()) {
+        parts.push_back(std::move(files));
+    }
+    return !ec;
+}
+
+} // namespace
+
+SocketTransport::SocketTransport(std::string socketPath) : socketPath_(std::move(socketPath)) {}
+
+bool SocketTransport::Request(const std::string& request,
+                              const std::function<void(const std::string& line)>& onLine, unsigned timeoutMs) {
+    if (!connection_.IsConnected() && !connection_.Connect(socketPath_)) {
+        return false;
+    }
+    return connection_.Request(request, onLine, timeoutMs);
+}
+
+LocalWorkerProcess::LocalWorkerProcess(std::string executable, std::vector<std::string> args, std::string socketPath)
+    : executable_(std::move(executable)), args_(std::move(args)), socketPath_(std::move(socketPath)) {}
+
+LocalWorkerProcess::~LocalWorkerProcess() {
+    connection_.Close();
+    if (pid_ > 0) {
+        // A hung worker may never get to its SIGTERM handler
+        kill(pid_, SIGTERM);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(STOP_WAIT_MS);
+        while (waitpid(pid_, nullptr, WNOHANG) == 0) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                kill(pid_, SIGKILL);
+                waitpid(pid_, nullptr, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(START_POLL_MS));
+        }
+    }
+}
+
+bool LocalWorkerProcess::Start(unsigned timeoutMs) {
+    // Everything the child needs is built before fork
+    std::vector<std::string> args = args_;
+    args.insert(args.begin(), executable_);
+    args.push_back("--daemon");
+    args.push_back(socketPath_);
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    // A stale socket must not be taken for the new daemon's
+    unlink(socketPath_.c_str());
+
+    pid_ = fork();
+    if (pid_ < 0) {
+        return false;
+    }
+    if (pid_ == 0) {
+        // Its banner would mix with the coordinator's output; errors still show
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (connection_.Connect(socketPath_)) {
+            return true;
+        }
+        if (waitpid(pid_, nullptr, WNOHANG) == pid_) {
+            pid_ = -1; // exited, e.g. the base could not be loaded
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(START_POLL_MS));
+    }
+    return false;
+}
+
+bool LocalWorkerProcess::Request(const std::string& request,
+                                 const std::function<void(const std::string& line)>& onLine, unsigned timeoutMs) {
+    return connection_.Request(request, onLine, timeoutMs);
+}
+
+ScanCoordinator::ScanCoordinator(std::vector<std::unique_ptr<ShardTransport>> workers,
+                                 const CoordinatorOptions& options)
+    : workers_(std::move(workers)), options_(options) {
+    options_.shardsPerWorker = std::max<size_t>(options_.shardsPerWorker, 1);
+    options_.filesPerShard = std::max<size_t>(options_.filesPerShard, 1);
+    options_.maxAttempts = std::max(options_.maxAttempts, 1u);
+}
+
+ScanResult ScanCoordinator::Scan(const std::string& directoryPath, const std::string& logFilePath) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ScanResult result;
+    reports_.assign(workers_.size(), WorkerReport());
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        reports_[i].name = workers_[i]->Name();
+    }
+
+    std::error_code ec;
+    if (workers_.empty() || !fs::is_directory(directoryPath, ec)) {
+        std::cerr << "Error: " << (workers_.empty() ? "No scan workers" : "Directory does not exist: " + directoryPath)
+                  << std::endl;
+        result.errorCount++;
+        return result;
+    }
+    DetectionLog logFile;
+    if (!logFilePath.empty() && !logFile.Open(logFilePath, workers_.size(), LogFlushPolicy())) {
+        std::cerr << "Error: Could not open log file: " << logFilePath << std::endl;
+        result.errorCount++;
+        return result;
+    }
+
+    // Breadth first until every worker has several shards to pull
+    std::deque<Shard> queue;
+    ScanResult listed; // errors and filtered entries of the splitting
+    const ScanFilter* filter = options_.filter && !options_.filter->Empty() ? options_.filter.get() : nullptr;
+    Shard root;
+    root.directory = directoryPath;
+    queue.push_back(std::move(root));
+    const size_t target = workers_.size() * options_.shardsPerWorker;
+    while (queue.size() < target) {
+        auto next = std::find_if(queue.begin(), queue.end(), [](const Shard& shard) { return !shard.directory.empty(); });
+        if (next == queue.end()) {
+            break;
+        }
+        Shard shard = std::move(*next);
+        queue.erase(next);
+        std::vector<Shard> parts;
+        if (!SplitShard(shard.directory, options_.filesPerShard, filter, parts, listed)) {
+            listed.errorCount++;
+        }
+        std::move(parts.begin(), parts.end(), std::back_inserter(queue));
+    }
+
+    size_t errors = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t inFlight = 0;
+    size_t alive = workers_.size();
+
+    auto serve = [&](size_t w) {
+        ShardTransport& worker = *workers_[w];
+        WorkerReport& report = reports_[w];
+        for (;;) {
+            Shard shard;
+            bool split;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return !queue.empty() || inFlight == 0; });
+                if (queue.empty()) {
+                    return;
+                }
+                shard = std::move(queue.front());
+                queue.pop_front();
+                inFlight++;
+                // Near the end a whole subtree could keep one worker busy
+                // while the others idle; it goes out in pieces instead
+                split = !shard.directory.empty() && queue.size() < alive;
+            }
+
+            if (split) {
+                std::vector<Shard> parts;
+                ScanResult counts;
+                bool complete = SplitShard(shard.directory, options_.filesPerShard, filter, parts, counts);
+                std::lock_guard<std::mutex> lock(mutex);
+                listed.errorCount += counts.errorCount + (complete ? 0 : 1);
+                listed.filteredFiles += counts.filteredFiles;
+                listed.filteredDirectories += counts.filteredDirectories;
+                for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+                    queue.push_front(std::move(*it));
+                }
+                inFlight--;
+                changed.notify_all();
+                continue;
+            }
+
+            std::string request;
+            if (!shard.directory.empty()) {
+                request = "SCAN " + shard.directory + "\n";
+            } else {
+                request = "FILES\n";
+                for (const auto& file : shard.files) {
+                    request += file + "\n";
+                }
+                request += "\n";
+            }
+            ShardReply reply;
+            auto sent = std::chrono::steady_clock::now();
+            bool ok = worker.Request(request, [&](const std::string& line) { reply.Parse(line); },
+                                     options_.shardTimeoutMs);
+            double busy = std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count();
+
+            if (ok && logFile.IsOpen()) {
+                for (const auto& found : reply.found) {
+                    logFile.Write(w, found.path, found.hash, found.verdict);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            report.busyTime += busy;
+            inFlight--;
+            changed.notify_all();
+            if (ok) {
+                report.shards++;
+                report.files += reply.files;
+                result.totalFiles += reply.files;
+                result.maliciousFiles += reply.malicious;
+                errors += reply.errors;
+            } else if (reply.errorReply) {
+                errors++; // refused, e.g. removed since it was listed
+            } else {
+                // The worker is gone or hung; its shard goes to one that is not
+                report.failed = true;
+                alive--;
+                bool timedOut = options_.shardTimeoutMs > 0 && busy * 1000 >= options_.shardTimeoutMs;
+                std::cerr << "Warning: Scan worker " << worker.Name()
+                          << (timedOut ? " did not finish a shard in time" : " stopped answering") << std::endl;
+                if (++shard.attempts < options_.maxAttempts) {
+                    queue.push_front(std::move(shard));
+                } else {
+                    errors++;
+                }
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers_.size(); ++w) {
+        threads.emplace_back(serve, w);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (!queue.empty()) {
+        std::cerr << "Error: " << queue.size() << " shards not scanned, no worker left" << std::endl;
+        errors += queue.size();
+    }
+
+    if (logFile.IsOpen() && !logFile.Close()) {
+        std::cerr << "Error: Could not write log file: " << logFilePath << std::endl;
+        errors++;
+    }
+    result.errorCount = errors + listed.errorCount;
+    result.filteredFiles = listed.filteredFiles;
+    result.filteredDirectories = listed.filteredDirectories;
+    result.activeWorkers = alive;
+    auto endTime = std::chrono::high_resolution_clock::now();
+    result.executionTime = std::chrono::duration<double>(endTime - startTime).count();
+    return result;
+}
+
+#endif // _WIN32
@@ -0,0 +1,120 @@
+#pragma once
+#ifndef _WIN32
+#include "scanner_export.hpp"
+#include "scanner.hpp"
+#include "scan_server.hpp"
+#include <sys/types.h>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A scan worker the coordinator hands shards to: anything that answers
+// ScanServer protocol requests. Workers must see the scanned paths under the
+// same names (local processes, or nodes mounting the same namespace).
+class SCANNER_API ShardTransport {
+public:
+    virtual ~ShardTransport() = default;
+
+    virtual const std::string& Name() const = 0;
+    // One request; every reply line goes to `onLine`, up to DONE or ERROR.
+    // False if the reply was ERROR, the worker could not be reached or it
+    // did not finish within `timeoutMs` (0 - no limit).
+    virtual bool Request(const std::string& request,
+                         const std::function<void(const std::string& line)>& onLine, unsigned timeoutMs) = 0;
+};
+
+// A daemon (scanner_exe --daemon) behind a Unix socket; a remote node is
+// reached through a forwarded socket. Connects on the first request.
+class SCANNER_API SocketTransport : public ShardTransport {
+public:
+    explicit SocketTransport(std::string socketPath);
+
+    const std::string& Name() const override { return socketPath_; }
+    bool Request(const std::string& request,
+                 const std::function<void(const std::string& line)>& onLine, unsigned timeoutMs) override;
+
+private:
+    std::string socketPath_;
+    ScanConnection connection_;
+};
+
+// A daemon started as a child process for the coordinated scan and stopped
+// (SIGTERM, SIGKILL if it does not exit) with the transport
+class SCANNER_API LocalWorkerProcess : public ShardTransport {
+public:
+    // Runs `executable args... --daemon socketPath`
+    LocalWorkerProcess(std::string executable, std::vector<std::string> args, std::string socketPath);
+    ~LocalWorkerProcess() override;
+
+    LocalWorkerProcess(const LocalWorkerProcess&) = delete;
+    LocalWorkerProcess& operator=(const LocalWorkerProcess&) = delete;
+
+    // Spawns the daemon and waits until it serves requests (its base is loaded)
+    bool Start(unsigned timeoutMs = 60000);
+
+    const std::string& Name() const override { return socketPath_; }
+    bool Request(const std::string& request,
+                 const std::function<void(const std::string& line)>& onLine, unsigned timeoutMs) override;
+
+private:
+    std::string executable_;
+    std::vector<std::string> args_;
+    std::string socketPath_;
+    ScanConnection connection_;
+    pid_t pid_ = -1;
+};
+
+struct CoordinatorOptions {
+    // The tree is split into subtrees until there are this many shards per
+    // worker (or nothing is left to split)
+    size_t shardsPerWorker = 8;
+    // Files directly inside a split directory go out in lists of this size
+    size_t filesPerShard = 4096;
+    // A shard whose worker broke down moves to another worker, up to this many tries
+    unsigned maxAttempts = 3;
+    // A worker that takes longer for one shard is taken for hung: it is
+    // retired and the shard moves on (0 - no limit)
+    unsigned shardTimeoutMs = 30 * 60 * 1000;
+    // Applied to what the coordinator lists itself; the workers must be given
+    // the same rules. Only PathIndependent filters, since a worker sees its
+    // shard as a scan of its own.
+    std::shared_ptr<const ScanFilter> filter;
+};
+
+// What one worker did in a coordinated scan
+struct WorkerReport {
+    std::string name;
+    size_t shards = 0;
+    size_t files = 0;
+    double busyTime = 0.0;  // seconds with a shard in flight
+    bool failed = false;    // stopped answering or timed out; its shards went to the others
+};
+
+// Spreads one directory scan over several scanner processes. The tree is
+// cut into subtree shards (SCAN) and lists of loose files (FILES); every
+// worker pulls the next shard as soon as it is done with one, so a slow
+// worker or a heavy subtree takes fewer shards instead of holding up the
+// rest. Once fewer shards are queued than there are workers, a subtree is
+// split again before it goes out, which keeps the tail of the scan fine
+// grained. Detections of a shard reach the merged log when its DONE does, so
+// a shard retried elsewhere is not reported twice; the DONE counters add up
+// to one ScanResult.
+class SCANNER_API ScanCoordinator {
+public:
+    ScanCoordinator(std::vector<std::unique_ptr<ShardTransport>> workers,
+                    const CoordinatorOptions& options = CoordinatorOptions());
+
+    // Empty log path - no log file
+    ScanResult Scan(const std::string& directoryPath, const std::string& logFilePath);
+    // Per worker, after Scan
+    const std::vector<WorkerReport>& Workers() const { return reports_; }
+
+private:
+    std::vector<std::unique_ptr<ShardTransport>> workers_;
+    CoordinatorOptions options_;
+    std::vector<WorkerReport> reports_;
+};
+
+#endif // _WIN32
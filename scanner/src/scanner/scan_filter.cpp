@@ -0,0 +1,388 @@
+#include "scan_filter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+// Rule kinds a DFA state accepts
+enum AcceptFlag : uint8_t {
+    EXCLUDE_FILE = 1,
+    EXCLUDE_DIRECTORY = 2,
+    INCLUDE_FILE = 4,
+    INCLUDE_DIRECTORY = 8
+};
+
+enum class TokenKind : uint8_t {
+    Byte,          // one literal byte
+    AnyByte,       // '?', anything but '/'
+    Star,          // '*', any run without '/'
+    DirStar,       // '**/' at a component start, any number of whole components
+    DirStarInside, // follows DirStar: the rest of a component it skips
+    AnyBytes,      // '**' elsewhere, anything
+    End            // the glob matched
+};
+
+// Globs are laid out one after another; an NFA position is an index here
+struct Positions {
+    std::vector<TokenKind> kinds;
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> flags; // at End positions
+};
+
+const int64_t NS_PER_DAY = 86400ll * 1000000000ll;
+
+std::string Trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+uint64_t ParseSize(const std::string& text) {
+    size_t end = 0;
+    uint64_t value = std::stoull(text, &end);
+    if (end < text.size()) {
+        switch (text[end]) {
+        case 'K': case 'k': return value << 10;
+        case 'M': case 'm': return value << 20;
+        case 'G': case 'g': return value << 30;
+        default: throw std::invalid_argument("bad size suffix");
+        }
+    }
+    return value;
+}
+
+int64_t ParseDays(const std::string& text) {
+    double days = std::stod(text);
+    if (days < 0) {
+        throw std::invalid_argument("negative age");
+    }
+    return static_cast<int64_t>(days * NS_PER_DAY);
+}
+
+std::string Lower(const char* text, size_t length) {
+    std::string lower(text, length);
+    for (char& c : lower) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return lower;
+}
+
+// Appends the glob's tokens and its End position; false if it is empty
+bool AddGlob(std::string text, bool include, Positions& positions, bool& anchored) {
+    bool directoryOnly = false;
+    if (text.size() >= 3 && text.compare(text.size() - 3, 3, "/**") == 0) {
+        text.resize(text.size() - 3);
+        directoryOnly = true;
+    } else if (!text.empty() && text.back() == '/') {
+        text.pop_back();
+        directoryOnly = true;
+    }
+    anchored = text.find('/') != std::string::npos;
+    if (!text.empty() && text[0] == '/') {
+        text.erase(0, 1);
+    }
+    if (text.empty()) {
+        return false;
+    }
+
+    auto push = [&](TokenKind kind, uint8_t byte) {
+        positions.kinds.push_back(kind);
+        positions.bytes.push_back(byte);
+        positions.flags.push_back(0);
+    };
+    auto pushDirStar = [&] {
+        push(TokenKind::DirStar, 0);
+        push(TokenKind::DirStarInside, 0);
+    };
+    if (!anchored) {
+        pushDirStar();
+    }
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '\\' && i + 1 < text.size()) {
+            push(TokenKind::Byte, static_cast<uint8_t>(text[++i]));
+        } else if (c == '*' && i + 1 < text.size() && text[i + 1] == '*') {
+            // Only '**/' after a '/' spans components; 'a**/' is 'a*/'
+            bool componentStart = i == 0 || text[i - 1] == '/';
+            ++i;
+            if (i + 1 < text.size() && text[i + 1] == '/' && componentStart) {
+                ++i;
+                pushDirStar();
+            } else if (i + 1 < text.size() && text[i + 1] == '/') {
+                push(TokenKind::Star, 0);
+            } else {
+                push(TokenKind::AnyBytes, 0);
+            }
+        } else if (c == '*') {
+            push(TokenKind::Star, 0);
+        } else if (c == '?') {
+            push(TokenKind::AnyByte, 0);
+        } else {
+            push(TokenKind::Byte, static_cast<uint8_t>(c));
+        }
+    }
+    push(TokenKind::End, 0);
+    if (include) {
+        positions.flags.back() = directoryOnly ? INCLUDE_DIRECTORY : INCLUDE_FILE | INCLUDE_DIRECTORY;
+    } else {
+        positions.flags.back() = directoryOnly ? EXCLUDE_DIRECTORY : EXCLUDE_FILE | EXCLUDE_DIRECTORY;
+    }
+    return true;
+}
+
+// Adds the positions reachable without input (a star matching nothing;
+// DirStar only where a component starts) and sorts the set, so equal sets
+// compare equal
+void Close(const Positions& positions, std::vector<uint32_t>& set, std::vector<uint32_t>& mark, uint32_t generation) {
+    for (uint32_t position : set) {
+        mark[position] = generation;
+    }
+    for (size_t k = 0; k < set.size(); ++k) {
+        TokenKind kind = positions.kinds[set[k]];
+        uint32_t skipTo = set[k] + (kind == TokenKind::DirStar ? 2 : 1);
+        bool skippable = kind == TokenKind::Star || kind == TokenKind::DirStar || kind == TokenKind::AnyBytes;
+        if (skippable && mark[skipTo] != generation) {
+            mark[skipTo] = generation;
+            set.push_back(skipTo);
+        }
+    }
+    std::sort(set.begin(), set.end());
+}
+
+} // namespace
+
+bool ScanFilter::Compile(const std::vector<std::string>& rules, std::string& error) {
+    *this = ScanFilter();
+    Positions positions;
+    std::vector<uint32_t> starts;
+
+    for (size_t n = 0; n < rules.size(); ++n) {
+        std::string line = Trim(rules[n]);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t space = line.find_first_of(" \t");
+        std::string keyword = line.substr(0, space);
+        std::string argument = space == std::string::npos ? std::string() : Trim(line.substr(space));
+        std::string where = "line " + std::to_string(n + 1) + ": ";
+        if (argument.empty()) {
+            error = where + "missing argument";
+            return false;
+        }
+        try {
+            if (keyword == "exclude" || keyword == "include") {
+                uint32_t start = static_cast<uint32_t>(positions.kinds.size());
+                bool anchored;
+                if (!AddGlob(argument, keyword == "include", positions, anchored)) {
+                    error = where + "empty glob";
+                    return false;
+                }
+                starts.push_back(start);
+                pathIndependent_ = pathIndependent_ && !anchored && keyword == "exclude";
+                hasIncludes_ = hasIncludes_ || keyword == "include";
+            } else if (keyword == "exclude-ext" || keyword == "include-ext") {
+                auto& set = keyword == "include-ext" ? includeExtensions_ : excludeExtensions_;
+                for (size_t pos = 0; pos <= argument.size();) {
+                    size_t comma = std::min(argument.find(',', pos), argument.size());
+                    std::string extension = Trim(argument.substr(pos, comma - pos));
+                    if (!extension.empty() && extension[0] == '.') {
+                        extension.erase(0, 1);
+                    }
+                    if (!extension.empty()) {
+                        set.insert(Lower(extension.data(), extension.size()));
+                    }
+                    pos = comma + 1;
+                }
+                hasIncludes_ = hasIncludes_ || keyword == "include-ext";
+            } else if (keyword == "min-size") {
+                minSize_ = ParseSize(argument);
+                hasLimits_ = true;
+            } else if (keyword == "max-size") {
+                maxSize_ = ParseSize(argument);
+                hasLimits_ = true;
+            } else if (keyword == "min-age") {
+                minAgeNs_ = ParseDays(argument);
+                hasLimits_ = true;
+            } else if (keyword == "max-age") {
+                maxAgeNs_ = ParseDays(argument);
+                hasLimits_ = true;
+            } else {
+                error = where + "unknown rule '" + keyword + "'";
+                return false;
+            }
+        } catch (const std::exception&) {
+            error = where + "bad value '" + argument + "'";
+            return false;
+        }
+        empty_ = false;
+    }
+
+    // Bytes that appear in a glob and '/' get a class each, the rest share one
+    std::array<bool, 256> literal{};
+    literal['/'] = true;
+    for (size_t i = 0; i < positions.kinds.size(); ++i) {
+        if (positions.kinds[i] == TokenKind::Byte) {
+            literal[positions.bytes[i]] = true;
+        }
+    }
+    std::vector<uint8_t> representative;
+    for (size_t b = 0; b < 256; ++b) {
+        if (!literal[b] && representative.empty()) {
+            representative.push_back(static_cast<uint8_t>(b));
+        }
+    }
+    for (size_t b = 0; b < 256; ++b) {
+        if (literal[b]) {
+            byteClass_[b] = static_cast<uint8_t>(representative.size());
+            representative.push_back(static_cast<uint8_t>(b));
+        }
+    }
+    classCount_ = representative.size();
+
+    // Subset construction; state 0 is the root
+    std::vector<uint32_t> mark(positions.kinds.size(), 0);
+    uint32_t generation = 0;
+    std::map<std::vector<uint32_t>, uint32_t> ids;
+    std::vector<std::vector<uint32_t>> sets;
+    std::vector<uint32_t> start = starts;
+    Close(positions, start, mark, ++generation);
+    ids.emplace(start, 0);
+    sets.push_back(start);
+
+    for (size_t state = 0; state < sets.size(); ++state) {
+        const std::vector<uint32_t> current = sets[state];
+        uint8_t flags = 0;
+        for (uint32_t position : current) {
+            flags |= positions.flags[position];
+        }
+        accept_.push_back(flags);
+
+        for (size_t c = 0; c < classCount_; ++c) {
+            const uint8_t byte = representative[c];
+            std::vector<uint32_t> next;
+            ++generation;
+            auto add = [&](uint32_t position) {
+                if (mark[position] != generation) {
+                    mark[position] = generation;
+                    next.push_back(position);
+                }
+            };
+            for (uint32_t position : current) {
+                switch (positions.kinds[position]) {
+                case TokenKind::Byte:
+                    if (positions.bytes[position] == byte) {
+                        add(position + 1);
+                    }
+                    break;
+                case TokenKind::AnyByte:
+                    if (byte != '/') {
+                        add(position + 1);
+                    }
+                    break;
+                case TokenKind::Star:
+                    if (byte != '/') {
+                        add(position);
+                    }
+                    break;
+                case TokenKind::DirStar:
+                    add(byte == '/' ? position : position + 1);
+                    break;
+                case TokenKind::DirStarInside:
+                    add(byte == '/' ? position - 1 : position);
+                    break;
+                case TokenKind::AnyBytes:
+                    add(position);
+                    break;
+                case TokenKind::End:
+                    break;
+                }
+            }
+            Close(positions, next, mark, generation);
+            auto found = ids.find(next);
+            if (found == ids.end()) {
+                if (sets.size() == MAX_STATES) {
+                    error = "rules too complex: more than " + std::to_string(MAX_STATES) + " matcher states";
+                    return false;
+                }
+                found = ids.emplace(next, static_cast<uint32_t>(sets.size())).first;
+                sets.push_back(std::move(next));
+            }
+            next_.push_back(found->second);
+        }
+    }
+    return true;
+}
+
+ScanFilter::State ScanFilter::Run(State state, const char* name, size_t length) const {
+    for (size_t i = 0; i < length; ++i) {
+        state = next_[state * classCount_ + byteClass_[static_cast<uint8_t>(name[i])]];
+    }
+    return state;
+}
+
+bool ScanFilter::MatchExtension(const char* name, size_t length, const std::unordered_set<std::string>& set) const {
+    if (set.empty()) {
+        return false;
+    }
+    size_t start = length; // of the extension
+    while (start > 0 && name[start - 1] != '.') {
+        --start;
+    }
+    if (start <= 1) {
+        return false; // none, or a dot file
+    }
+    return set.count(Lower(name + start, length - start)) > 0;
+}
+
+bool ScanFilter::EnterDirectory(State state, const char* name, State& child) const {
+    State included = state & INCLUDED;
+    State reached = Run(state & ~INCLUDED, name, std::strlen(name));
+    uint8_t flags = accept_[reached];
+    if (flags & EXCLUDE_DIRECTORY) {
+        return false;
+    }
+    if (flags & INCLUDE_DIRECTORY) {
+        included = INCLUDED;
+    }
+    child = next_[reached * classCount_ + byteClass_['/']] | included;
+    return true;
+}
+
+bool ScanFilter::MatchFile(State state, const char* name) const {
+    size_t length = std::strlen(name);
+    uint8_t flags = accept_[Run(state & ~INCLUDED, name, length)];
+    if ((flags & EXCLUDE_FILE) || MatchExtension(name, length, excludeExtensions_)) {
+        return false;
+    }
+    if (!hasIncludes_) {
+        return true;
+    }
+    return (state & INCLUDED) || (flags & INCLUDE_FILE) || MatchExtension(name, length, includeExtensions_);
+}
+
+bool ScanFilter::MatchPath(const std::string& path) const {
+    State state = Root();
+    size_t start = 0;
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', start)) {
+        if (!EnterDirectory(state, path.substr(start, slash - start).c_str(), state)) {
+            return false;
+        }
+        start = slash + 1;
+    }
+    return MatchFile(state, path.c_str() + start);
+}
+
+bool ScanFilter::MatchLimits(uint64_t size, int64_t mtimeNs, int64_t nowNs) const {
+    if (size < minSize_ || size > maxSize_) {
+        return false;
+    }
+    int64_t age = nowNs - mtimeNs;
+    return age >= minAgeNs_ && age <= maxAgeNs_;
+}
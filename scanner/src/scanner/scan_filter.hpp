@@ -0,0 +1,80 @@
+#pragma once
+#include "scanner_export.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Include/exclude rules of a scan, one per line ('#' starts a comment):
+//   exclude <glob>        skip matching files; a matching directory is pruned
+//                         (never opened)
+//   include <glob>        once there is any include rule, only files matching
+//                         one, or under a matching directory, are scanned
+//   exclude-ext <ext,...> / include-ext <ext,...>   the same by extension
+//                         (case insensitive, without the dot)
+//   min-size <bytes> / max-size <bytes>             K, M and G suffixes
+//   min-age <days> / max-age <days>                 by modification time
+// Globs follow .gitignore: '*' and '?' stay within a path component, '**'
+// spans any number of them; a glob without '/' matches the name at any
+// depth, one with '/' the path from the scan root; a trailing '/' (or
+// '/**') limits it to directories. Exclude wins over include.
+//
+// All globs are compiled into one DFA over path bytes, stepped one path
+// component at a time: a directory keeps the state reached after its path,
+// so an entry costs one table step per byte of its name and one extension
+// lookup, however many rules there are.
+class SCANNER_API ScanFilter {
+public:
+    // DFA state after a directory's path, with INCLUDED set below a directory
+    // matched by an include rule
+    using State = uint32_t;
+
+    static constexpr size_t MAX_STATES = 1 << 16;
+
+    // False with `error` naming the offending rule
+    bool Compile(const std::vector<std::string>& rules, std::string& error);
+    bool Empty() const { return empty_; }
+    // True without root-relative globs and include globs, so that a subtree
+    // is filtered the same whether it is scanned from the root or on its own
+    bool PathIndependent() const { return pathIndependent_; }
+
+    // State of the scan root
+    State Root() const { return 0; }
+    // `name` is a subdirectory of a directory in `state`: false if it is
+    // pruned, otherwise its own state in `child`
+    bool EnterDirectory(State state, const char* name, State& child) const;
+    // Name and extension rules for file `name` in a directory in `state`
+    bool MatchFile(State state, const char* name) const;
+    // Both for a path as given (file lists, watched files), from the root state
+    bool MatchPath(const std::string& path) const;
+
+    // Whether size or age limits need a stat of every file
+    bool NeedsStat() const { return hasLimits_; }
+    bool MatchLimits(uint64_t size, int64_t mtimeNs, int64_t nowNs) const;
+
+private:
+    static constexpr State INCLUDED = 1u << 31;
+
+    State Run(State state, const char* name, size_t length) const;
+    bool MatchExtension(const char* name, size_t length, const std::unordered_set<std::string>& set) const;
+
+    bool empty_ = true;
+    bool hasIncludes_ = false;
+    bool hasLimits_ = false;
+    bool pathIndependent_ = true;
+    uint64_t minSize_ = 0;
+    uint64_t maxSize_ = std::numeric_limits<uint64_t>::max();
+    int64_t minAgeNs_ = 0;
+    int64_t maxAgeNs_ = std::numeric_limits<int64_t>::max();
+    std::unordered_set<std::string> includeExtensions_;
+    std::unordered_set<std::string> excludeExtensions_;
+
+    // Bytes that no glob tells apart share a class
+    std::array<uint8_t, 256> byteClass_{};
+    size_t classCount_ = 0;
+    std::vector<uint32_t> next_;  // [state * classCount_ + class]
+    std::vector<uint8_t> accept_; // rule kinds whose glob ends in the state
+};
@@ -0,0 +1,119 @@
+#include "scan_metrics.hpp"
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// 0 for 0, otherwise the number of significant bits, capped to the last bucket
+size_t Log2Bucket(uint64_t value, size_t buckets) {
+    size_t bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits < buckets ? bits : buckets - 1;
+}
+
+// Upper bound of a histogram bucket that holds `fraction` of all samples
+uint64_t Percentile(const std::array<uint64_t, ScanMetrics::LATENCY_BUCKETS>& buckets, double fraction) {
+    uint64_t total = 0;
+    for (uint64_t count : buckets) {
+        total += count;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (total > 0 && seen >= fraction * total) {
+            return uint64_t(1) << i;
+        }
+    }
+    return 0;
+}
+
+template<size_t N>
+void WriteBuckets(std::ostream& out, const std::array<uint64_t, N>& buckets, const char* countName) {
+    out << "[";
+    bool first = true;
+    for (size_t i = 0; i < N; ++i) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        out << (first ? "" : ", ") << "{\"below\": " << (uint64_t(1) << i)
+            << ", \"" << countName << "\": " << buckets[i] << "}";
+        first = false;
+    }
+    out << "]";
+}
+
+} // namespace
+
+void ThreadMetrics::AddFileSize(uint64_t size) {
+    sizeBuckets[Log2Bucket(size, ScanMetrics::SIZE_BUCKETS)]++;
+}
+
+void ThreadMetrics::AddFileLatency(uint64_t nanoseconds) {
+    latencyBuckets[Log2Bucket(nanoseconds / 1000, ScanMetrics::LATENCY_BUCKETS)]++;
+}
+
+void ThreadMetrics::MergeInto(ScanMetrics& metrics) const {
+    metrics.collected = true;
+    metrics.bytesRead += bytesRead;
+    metrics.filesHashed += filesHashed;
+    metrics.traversalTime += traversalNs / 1e9;
+    metrics.readTime += readNs / 1e9;
+    metrics.hashTime += hashNs / 1e9;
+    metrics.lookupTime += lookupNs / 1e9;
+    metrics.logTime += logNs / 1e9;
+    for (size_t i = 0; i < ScanMetrics::SIZE_BUCKETS; ++i) {
+        metrics.sizeBuckets[i] += sizeBuckets[i];
+    }
+    for (size_t i = 0; i < ScanMetrics::LATENCY_BUCKETS; ++i) {
+        metrics.latencyBuckets[i] += latencyBuckets[i];
+    }
+}
+
+std::string ScanResultToJson(const ScanResult& result) {
+    std::ostringstream out;
+    out << std::setprecision(9);
+    out << "{\n";
+    out << "  \"totalFiles\": " << result.totalFiles << ",\n";
+    out << "  \"maliciousFiles\": " << result.maliciousFiles << ",\n";
+    out << "  \"errorCount\": " << result.errorCount << ",\n";
+    out << "  \"executionTime\": " << result.executionTime << ",\n";
+    out << "  \"skippedBySize\": " << result.skippedBySize << ",\n";
+    out << "  \"bytesSkippedBySize\": " << result.bytesSkippedBySize << ",\n";
+    out << "  \"cacheHits\": " << result.cacheHits << ",\n";
+    out << "  \"dedupedFiles\": " << result.dedupedFiles << ",\n";
+    out << "  \"dedupedBytes\": " << result.dedupedBytes << ",\n";
+    out << "  \"dedupedDirectories\": " << result.dedupedDirectories << ",\n";
+    out << "  \"archiveMembers\": " << result.archiveMembers << ",\n";
+    out << "  \"skippedMembers\": " << result.skippedMembers << ",\n";
+    out << "  \"damagedArchives\": " << result.damagedArchives << ",\n";
+    out << "  \"filteredFiles\": " << result.filteredFiles << ",\n";
+    out << "  \"filteredDirectories\": " << result.filteredDirectories << ",\n";
+    out << "  \"activeWorkers\": " << result.activeWorkers << ",\n";
+    out << "  \"throttledTime\": " << result.throttledTime;
+
+    const ScanMetrics& metrics = result.metrics;
+    if (metrics.collected) {
+        out << ",\n  \"metrics\": {\n";
+        out << "    \"bytesRead\": " << metrics.bytesRead << ",\n";
+        out << "    \"filesHashed\": " << metrics.filesHashed << ",\n";
+        out << "    \"threadSeconds\": {\"traversal\": " << metrics.traversalTime
+            << ", \"read\": " << metrics.readTime
+            << ", \"hash\": " << metrics.hashTime
+            << ", \"lookup\": " << metrics.lookupTime
+            << ", \"log\": " << metrics.logTime << "},\n";
+        out << "    \"fileSizes\": ";
+        WriteBuckets(out, metrics.sizeBuckets, "files");
+        out << ",\n";
+        out << "    \"scanLatencyUs\": {\"p50\": " << Percentile(metrics.latencyBuckets, 0.5)
+            << ", \"p90\": " << Percentile(metrics.latencyBuckets, 0.9)
+            << ", \"p99\": " << Percentile(metrics.latencyBuckets, 0.99)
+            << ", \"buckets\": ";
+        WriteBuckets(out, metrics.latencyBuckets, "files");
+        out << "}\n  }";
+    }
+    out << "\n}\n";
+    return out.str();
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "scanner.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Monotonic time in nanoseconds
+inline uint64_t MetricsNow() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Counters of one thread. Only the owner writes them, so no atomics; each
+// sits on its own cache line and they are merged once the scan is over.
+struct alignas(64) ThreadMetrics {
+    uint64_t bytesRead = 0;
+    uint64_t filesHashed = 0;
+    uint64_t traversalNs = 0;
+    uint64_t readNs = 0;
+    uint64_t hashNs = 0;
+    uint64_t lookupNs = 0;
+    uint64_t logNs = 0;
+    uint64_t sizeBuckets[ScanMetrics::SIZE_BUCKETS] = {};
+    uint64_t latencyBuckets[ScanMetrics::LATENCY_BUCKETS] = {};
+
+    void AddFileSize(uint64_t size);
+    void AddFileLatency(uint64_t nanoseconds);
+    void MergeInto(ScanMetrics& metrics) const;
+};
+
+// Adds the time until the end of the scope to *counter. With a null
+// counter (metrics disabled) the clock is not read at all.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(uint64_t* counter)
+        : counter_(counter), start_(counter ? MetricsNow() : 0) {}
+    ~ScopedTimer() {
+        if (counter_) {
+            *counter_ += MetricsNow() - start_;
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    uint64_t* counter_;
+    uint64_t start_;
+};
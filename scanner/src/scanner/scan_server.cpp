@@ -0,0 +1,398 @@
+#include "scan_server.hpp"
+#ifndef _WIN32
+#include "scan_cache.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// How often the accept loop checks for Stop
+const int ACCEPT_POLL_MS = 200;
+// How often new cache entries are written out while the daemon runs
+const auto CACHE_SAVE_INTERVAL = std::chrono::minutes(1);
+
+bool MakeAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool SendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t count = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+// Line reader over a socket
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd_(fd) {}
+
+    // Next() gives up once `deadline` has passed
+    void SetDeadline(std::chrono::steady_clock::time_point deadline) { deadline_ = deadline; }
+
+    // False at end of stream, on error or past the deadline
+    bool Next(std::string& line) {
+        for (;;) {
+            size_t end = buffer_.find('\n', start_);
+            if (end != std::string::npos) {
+                line.assign(buffer_, start_, end - start_);
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                start_ = end + 1;
+                return true;
+            }
+            buffer_.erase(0, start_);
+            start_ = 0;
+
+            if (deadline_ != std::chrono::steady_clock::time_point::max()) {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                    deadline_ - std::chrono::steady_clock::now()).count();
+                pollfd ready{fd_, POLLIN, 0};
+                int polled = left > 0 ? poll(&ready, 1, static_cast<int>(std::min<long long>(left, INT_MAX))) : 0;
+                if (polled < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (polled <= 0) {
+                    return false;
+                }
+            }
+
+            char chunk[4096];
+            ssize_t count = recv(fd_, chunk, sizeof(chunk), 0);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            buffer_.append(chunk, static_cast<size_t>(count));
+        }
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+    size_t start_ = 0;
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+};
+
+} // namespace
+
+ScanServer::ScanServer(MalwareScanner& scanner, const ScanOptions& options)
+    : scanner_(scanner), options_(options) {
+    size_t threads = options_.threadCount;
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 4;
+    }
+    pool_ = std::make_unique<WorkerPool>(threads);
+
+    if (!options_.cachePath.empty()) {
+        cache_ = std::make_unique<ScanCache>();
+        if (!cache_->Open(options_.cachePath)) {
+            std::cerr << "Warning: Ignoring unreadable scan cache: " << options_.cachePath << std::endl;
+            cache_ = std::make_unique<ScanCache>();
+        }
+    }
+
+    options_.threadCount = 0;
+    options_.pool = pool_.get();
+    options_.cache = cache_.get();
+    options_.collectMetrics = false;
+}
+
+ScanServer::~ScanServer() {
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        unlink(socketPath_.c_str());
+    }
+}
+
+bool ScanServer::Listen(const std::string& socketPath) {
+    sockaddr_un address;
+    if (!MakeAddress(socketPath, address)) {
+        std::cerr << "Error: Invalid socket path: " << socketPath << std::endl;
+        return false;
+    }
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+        return false;
+    }
+    // A socket left behind by a daemon that did not shut down cleanly
+    unlink(socketPath.c_str());
+    mode_t previous = umask(0077);
+    bool bound = bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(previous);
+    if (!bound || listen(listenFd_, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    socketPath_ = socketPath;
+    return true;
+}
+
+void ScanServer::Stop() {
+    stopping_.store(true, std::memory_order_relaxed);
+}
+
+void ScanServer::Run() {
+    auto nextCacheSave = std::chrono::steady_clock::now() + CACHE_SAVE_INTERVAL;
+    while (listenFd_ >= 0 && !stopping_.load(std::memory_order_relaxed)) {
+        pollfd listener{listenFd_, POLLIN, 0};
+        int ready = poll(&listener, 1, ACCEPT_POLL_MS);
+
+        // So a crash loses at most an interval of digests. Compaction waits
+        // for the final save: entries not looked up yet may still be wanted.
+        auto now = std::chrono::steady_clock::now();
+        if (cache_ && now >= nextCacheSave) {
+            if (cache_->Changed() && !cache_->Save(options_.cachePath, false)) {
+                std::cerr << "Warning: Could not save scan cache: " << options_.cachePath << std::endl;
+            }
+            nextCacheSave = now + CACHE_SAVE_INTERVAL;
+        }
+
+        {
+            // Reap connections that have been closed
+            std::lock_guard<std::mutex> lock(connectionsMutex_);
+            for (auto it = connections_.begin(); it != connections_.end();) {
+                if ((*it)->finished) {
+                    (*it)->thread.join();
+                    it = connections_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection* raw = connection.get();
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        connections_.push_back(std::move(connection));
+        raw->thread = std::thread([this, raw] { Serve(*raw); });
+    }
+
+    // No new clients; those waiting for their next request are unblocked,
+    // running scans finish
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+        unlink(socketPath_.c_str());
+    }
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    for (auto& connection : connections_) {
+        shutdown(connection->fd, SHUT_RD);
+    }
+    for (auto& connection : connections_) {
+        connection->thread.join();
+    }
+    connections_.clear();
+
+    if (cache_ && !cache_->Save(options_.cachePath, options_.compactCache)) {
+        std::cerr << "Warning: Could not save scan cache: " << options_.cachePath << std::endl;
+    }
+}
+
+void ScanServer::Serve(Connection& connection) {
+    LineReader reader(connection.fd);
+    std::string line;
+    while (!stopping_.load(std::memory_order_relaxed) && reader.Next(line)) {
+        if (line.compare(0, 5, "SCAN ") == 0) {
+            RunRequest(connection.fd, line.substr(5), nullptr);
+        } else if (line == "FILES") {
+            std::vector<std::string> files;
+            while (reader.Next(line) && !line.empty()) {
+                files.push_back(line);
+            }
+            RunRequest(connection.fd, std::string(), &files);
+        } else if (!line.empty()) {
+            SendAll(connection.fd, "ERROR\tunknown request\n");
+        }
+    }
+    close(connection.fd);
+    connection.finished = true;
+}
+
+void ScanServer::RunRequest(int fd, const std::string& path, const std::vector<std::string>* files) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Workers only append to the outbox; this thread does the (possibly
+    // slow) socket writes, so a slow client never holds up pool threads
+    std::mutex outboxMutex;
+    std::condition_variable outboxReady;
+    std::string outbox;
+    bool finished = false;
+
+    ScanOptions options = options_;
+    options.onDetection = [&](const std::string& filePath, const std::string& hash,
+                              std::string_view verdict) {
+        std::string line = "FOUND\t" + filePath + "\t" + hash + "\t" + std::string(verdict) + "\n";
+        {
+            std::lock_guard<std::mutex> lock(outboxMutex);
+            outbox += line;
+        }
+        outboxReady.notify_one();
+    };
+
+    std::error_code ec;
+    if (!files && !fs::is_directory(path, ec) && !fs::is_regular_file(path, ec)) {
+        SendAll(fd, "ERROR\tno such file or directory: " + path + "\n");
+        return;
+    }
+
+    ScanResult result;
+    std::thread scan([&] {
+        if (files) {
+            result = scanner_.ScanFiles(*files, std::string(), options);
+        } else if (fs::is_directory(path, ec)) {
+            result = scanner_.ScanDirectory(path, std::string(), options);
+        } else {
+            result = scanner_.ScanFiles({path}, std::string(), options);
+        }
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        finished = true;
+        outboxReady.notify_one();
+    });
+
+    bool connected = true;
+    std::string pending;
+    for (;;) {
+        bool done;
+        {
+            std::unique_lock<std::mutex> lock(outboxMutex);
+            outboxReady.wait(lock, [&] { return finished || !outbox.empty(); });
+            pending.swap(outbox);
+            done = finished && pending.empty();
+        }
+        if (done) {
+            break;
+        }
+        // After a client went away the scan still runs to completion
+        connected = connected && SendAll(fd, pending);
+        pending.clear();
+    }
+    scan.join();
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime);
+    std::string summary = "DONE\tfiles=" + std::to_string(result.totalFiles) +
+                          "\tmalicious=" + std::to_string(result.maliciousFiles) +
+                          "\terrors=" + std::to_string(result.errorCount) +
+                          "\tms=" + std::to_string(elapsed.count()) + "\n";
+    if (connected) {
+        SendAll(fd, summary);
+    }
+}
+
+class ScanConnection::Reader : public LineReader {
+public:
+    using LineReader::LineReader;
+};
+
+ScanConnection::ScanConnection() = default;
+
+ScanConnection::~ScanConnection() {
+    Close();
+}
+
+bool ScanConnection::Connect(const std::string& socketPath) {
+    Close();
+    sockaddr_un address;
+    if (!MakeAddress(socketPath, address)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return false;
+    }
+    fd_ = fd;
+    reader_ = std::make_unique<Reader>(fd);
+    return true;
+}
+
+bool ScanConnection::Request(const std::string& request,
+                             const std::function<void(const std::string& line)>& onLine, unsigned timeoutMs) {
+    if (fd_ < 0) {
+        return false;
+    }
+    // A peer that stops reading must not block the send either
+    timeval sendTimeout{static_cast<time_t>(timeoutMs / 1000), static_cast<suseconds_t>(timeoutMs % 1000 * 1000)};
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+    reader_->SetDeadline(timeoutMs ? std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs)
+                                   : std::chrono::steady_clock::time_point::max());
+    if (!SendAll(fd_, request)) {
+        Close();
+        return false;
+    }
+    std::string line;
+    while (reader_->Next(line)) {
+        onLine(line);
+        if (line.compare(0, 5, "DONE\t") == 0) {
+            return true;
+        }
+        if (line.compare(0, 6, "ERROR\t") == 0) {
+            return false;
+        }
+    }
+    Close();
+    return false;
+}
+
+void ScanConnection::Close() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    reader_.reset();
+}
+
+bool SendScanRequest(const std::string& socketPath, const std::string& request, std::ostream& out) {
+    ScanConnection connection;
+    return connection.Connect(socketPath) &&
+           connection.Request(request, [&](const std::string& line) { out << line << "\n"; });
+}
+
+#endif // _WIN32
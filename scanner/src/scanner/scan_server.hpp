@@ -0,0 +1,98 @@
+#pragma once
+#ifndef _WIN32
+#include "scanner_export.hpp"
+#include "scanner.hpp"
+#include <atomic>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Resident scanner behind a Unix domain socket. The base, the worker pool
+// and the scan cache stay loaded between requests, so a small scan costs
+// only its own I/O. Concurrent requests share the pool fairly (see
+// WorkerPool).
+//
+// Line protocol, any number of requests per connection:
+//   SCAN <path>     a directory (recursively) or a single file
+//   FILES           followed by one path per line and an empty line
+// Replies, streamed while the scan runs (fields separated by tabs):
+//   FOUND  path  hash  verdict
+//   DONE  files=N  malicious=N  errors=N  ms=T
+//   ERROR  message
+class SCANNER_API ScanServer {
+public:
+    // `options` apply to every request: threadCount is the pool size,
+    // cachePath the resident cache (loaded now, saved every minute it has
+    // changed and when Run returns)
+    ScanServer(MalwareScanner& scanner, const ScanOptions& options);
+    ~ScanServer();
+
+    ScanServer(const ScanServer&) = delete;
+    ScanServer& operator=(const ScanServer&) = delete;
+
+    // Creates the socket (owner access only), replacing a stale one
+    bool Listen(const std::string& socketPath);
+    // Serves connections, each on its own thread, until Stop
+    void Run();
+    // Async-signal-safe
+    void Stop();
+
+private:
+    struct Connection {
+        std::thread thread;
+        int fd = -1;
+        std::atomic<bool> finished{false};
+    };
+
+    void Serve(Connection& connection);
+    void RunRequest(int fd, const std::string& path, const std::vector<std::string>* files);
+
+    MalwareScanner& scanner_;
+    ScanOptions options_;
+    std::unique_ptr<WorkerPool> pool_;
+    std::unique_ptr<ScanCache> cache_;
+
+    std::string socketPath_;
+    int listenFd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::mutex connectionsMutex_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+};
+
+// Client side of the protocol over one connection; requests go one after
+// another, each answered up to its DONE or ERROR line
+class SCANNER_API ScanConnection {
+public:
+    ScanConnection();
+    ~ScanConnection();
+
+    ScanConnection(const ScanConnection&) = delete;
+    ScanConnection& operator=(const ScanConnection&) = delete;
+
+    bool Connect(const std::string& socketPath);
+    bool IsConnected() const { return fd_ >= 0; }
+    // Sends `request` and passes every reply line to `onLine`. False if the
+    // connection broke or the whole reply took longer than `timeoutMs` (0 -
+    // no limit; it is closed then), or the reply was ERROR.
+    bool Request(const std::string& request, const std::function<void(const std::string& line)>& onLine,
+                 unsigned timeoutMs = 0);
+    void Close();
+
+private:
+    class Reader;
+
+    int fd_ = -1;
+    std::unique_ptr<Reader> reader_;
+};
+
+// Client side: sends `request` (protocol lines, newline terminated) and copies
+// every reply line to `out` until DONE or ERROR. False if the daemon could not
+// be reached, the connection broke or the request failed.
+SCANNER_API bool SendScanRequest(const std::string& socketPath, const std::string& request,
+                                 std::ostream& out);
+
+#endif // _WIN32
@@ -0,0 +1,230 @@
+#include "scan_throttle.hpp"
+#include "scan_metrics.hpp"
+#include <algorithm>
+#include <thread>
+
+#ifndef _WIN32
+#include <ctime>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int64_t TICK_NS = 250000000;   // controller interval
+const double TOLERANCE = 0.05;       // throughput changes below this are noise
+const unsigned HOLD_STEPS = 8;       // steps spent at a settled count before probing again
+const uint64_t FILE_COST = 4096;     // per-file work besides its bytes, like FILE_OPEN_COST
+const double BURST_SECONDS = 0.1;    // how much of a cap may be saved up
+
+uint64_t ThreadCpuNs() {
+#ifndef _WIN32
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+#else
+    // Wall time instead: the cap can only get stricter
+    return MetricsNow();
+#endif
+}
+
+} // namespace
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate), burst_(burst), tokens_(burst), last_(std::chrono::steady_clock::now()) {}
+
+std::chrono::nanoseconds TokenBucket::Take(double amount) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    tokens_ = std::min(burst_, tokens_ + rate_ * std::chrono::duration<double>(now - last_).count());
+    last_ = now;
+    tokens_ -= amount;
+    if (tokens_ >= 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    return std::chrono::nanoseconds(static_cast<int64_t>(-tokens_ / rate_ * 1e9));
+}
+
+ScanThrottle::ScanThrottle(const ThrottleOptions& options, size_t workers, std::function<bool()> starved)
+    : workers_(workers ? workers : 1),
+      adaptive_(options.adaptive),
+      starved_(std::move(starved)),
+      active_(options.adaptive ? 1 : workers_),
+      nextTickNs_(static_cast<int64_t>(MetricsNow()) + TICK_NS),
+      lastTickNs_(static_cast<int64_t>(MetricsNow())),
+      step_(std::max<size_t>(1, workers_ / 4)) {
+    if (options.maxBytesPerSecond > 0) {
+        double rate = static_cast<double>(options.maxBytesPerSecond);
+        readBucket_ = std::make_unique<TokenBucket>(rate, rate * BURST_SECONDS);
+    }
+    if (options.maxCpuShare > 0.0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        double rate = options.maxCpuShare * (cores ? cores : 1) * 1e9;
+        cpuBucket_ = std::make_unique<TokenBucket>(rate, rate * BURST_SECONDS);
+    }
+}
+
+bool ScanThrottle::Enabled(const ThrottleOptions& options) {
+    return options.adaptive || options.maxBytesPerSecond > 0 || options.maxCpuShare > 0.0;
+}
+
+ScanThrottle::Worker ScanThrottle::StartWorker() const {
+    Worker worker;
+    worker.cpuNs = cpuBucket_ ? ThreadCpuNs() : 0;
+    return worker;
+}
+
+void ScanThrottle::Pace(Worker& worker, uint64_t bytes, size_t files) {
+    std::chrono::nanoseconds delay(0);
+    if (readBucket_ && bytes > 0) {
+        delay = std::max(delay, readBucket_->Take(static_cast<double>(bytes)));
+    }
+    if (cpuBucket_) {
+        uint64_t cpuNs = ThreadCpuNs();
+        delay = std::max(delay, cpuBucket_->Take(static_cast<double>(cpuNs - worker.cpuNs)));
+        worker.cpuNs = cpuNs;
+    }
+    if (delay.count() > 0) {
+        std::this_thread::sleep_for(delay);
+        throttledNs_ += static_cast<uint64_t>(delay.count());
+    }
+
+    if (adaptive_) {
+        work_ += bytes + files * FILE_COST;
+        if (static_cast<int64_t>(MetricsNow()) >= nextTickNs_.load(std::memory_order_relaxed)) {
+            Tick();
+        }
+    }
+}
+
+void ScanThrottle::Tick() {
+    std::unique_lock<std::mutex> lock(tickMutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return; // another worker is stepping
+    }
+    int64_t now = static_cast<int64_t>(MetricsNow());
+    if (now < nextTickNs_.load()) {
+        return;
+    }
+    nextTickNs_ = now + TICK_NS;
+    uint64_t work = work_.load();
+    double throughput = static_cast<double>(work - lastWork_) / ((now - lastTickNs_) / 1e9);
+    lastWork_ = work;
+    lastTickNs_ = now;
+    if (starved_ && starved_()) {
+        // The workers wait for the traversal; measure again once they do not
+        previous_ = -1.0;
+        return;
+    }
+    Adjust(throughput);
+}
+
+size_t ScanThrottle::Adjust(double throughput) {
+    size_t active = Active();
+    if (hold_ > 0) {
+        // Settled; once the hold is over, probe the next count from here
+        previous_ = throughput;
+        if (--hold_ > 0) {
+            return active;
+        }
+    } else if (previous_ >= 0 && throughput <= previous_ * (1 + TOLERANCE)) {
+        bool worse = throughput < previous_ * (1 - TOLERANCE);
+        previous_ = throughput;
+        step_ = 1;
+        hold_ = HOLD_STEPS;
+        if (direction_ < 0 && !worse) {
+            // Fewer workers did as well: stay, and probe further down later
+            return active;
+        }
+        // More workers did not pay off, or fewer cost throughput: go back
+        direction_ = -direction_;
+    } else {
+        previous_ = throughput;
+    }
+
+    size_t next = direction_ > 0 ? std::min(workers_, active + step_) : active - std::min(active - 1, step_);
+    if (next == active) {
+        // At a bound: the next probe goes the other way
+        direction_ = -direction_;
+        next = direction_ > 0 ? std::min(workers_, active + step_) : active - std::min(active - 1, step_);
+    }
+    SetActive(next);
+    return next;
+}
+
+void ScanThrottle::SetActive(size_t active) {
+    {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        active_ = active;
+    }
+    activated_.notify_all();
+}
+
+bool ScanThrottle::Park(size_t slot, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(parkMutex_);
+    activated_.wait_for(lock, timeout, [&] { return Finished() || slot < Active(); });
+    return !Finished() && slot < Active();
+}
+
+void ScanThrottle::Finish() {
+    {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        finished_ = true;
+    }
+    activated_.notify_all();
+}
+
+#ifdef __linux__
+
+namespace {
+
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_SHIFT = 13;
+const int IOPRIO_CLASS_IDLE = 3;
+const int LOWEST_NICE = 19;
+
+} // namespace
+
+BackgroundPriority::BackgroundPriority(bool enable) {
+    if (!enable) {
+        return;
+    }
+    // Thread ids address single threads for both calls
+    id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, tid);
+    if (errno != 0) {
+        return;
+    }
+    nice_ = nice;
+    ioPriority_ = static_cast<int>(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid));
+    setpriority(PRIO_PROCESS, tid, LOWEST_NICE);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    enabled_ = true;
+}
+
+BackgroundPriority::~BackgroundPriority() {
+    if (!enabled_) {
+        return;
+    }
+    // Raising the priority again may need CAP_SYS_NICE; then it stays low
+    id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+    setpriority(PRIO_PROCESS, tid, nice_);
+    if (ioPriority_ >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioPriority_);
+    }
+}
+
+#else
+
+BackgroundPriority::BackgroundPriority(bool enable) {
+    (void)enable;
+}
+
+BackgroundPriority::~BackgroundPriority() = default;
+
+#endif // __linux__
@@ -0,0 +1,117 @@
+#pragma once
+#include "scanner_export.hpp"
+#include "scanner.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Rate limit with a small burst; a taker may run into debt and is told how
+// long to sleep it off
+class TokenBucket {
+public:
+    // `rate` units per second, at most `burst` saved up
+    TokenBucket(double rate, double burst);
+
+    // Takes `amount` units; the returned delay is zero while the bucket covers it
+    std::chrono::nanoseconds Take(double amount);
+
+private:
+    std::mutex mutex_;
+    double rate_;
+    double burst_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+// Paces the workers of one scan within ThrottleOptions. Reads and worker
+// CPU time are charged to token buckets after every round of buffers and
+// the worker sleeps while it is over a cap. With `adaptive` a hill climber
+// moves the number of active workers towards the best measured throughput
+// (bytes plus a per-file cost), preferring fewer workers when more do not
+// help; the workers beyond that number park. I/O concurrency follows the
+// worker count, since every worker keeps one read in flight per hash lane.
+class SCANNER_API ScanThrottle {
+public:
+    // State a worker keeps between calls
+    struct Worker {
+        uint64_t cpuNs = 0; // thread CPU time at the last Pace
+    };
+
+    // `workers` slots; `starved` (may be empty) tells whether the job queue
+    // ran dry, in which case throughput says nothing about the worker count
+    ScanThrottle(const ThrottleOptions& options, size_t workers, std::function<bool()> starved = nullptr);
+
+    // Whether the options ask for any pacing at all
+    static bool Enabled(const ThrottleOptions& options);
+
+    size_t Active() const { return active_.load(std::memory_order_relaxed); }
+
+    Worker StartWorker() const;
+    // Charges a round of `bytes` from `files` finished files, sleeps while a
+    // cap is exceeded and steps the controller when its interval is up
+    void Pace(Worker& worker, uint64_t bytes, size_t files);
+
+    // Blocks worker `slot` while it is not active, at most `timeout`. True
+    // once it may work again; false on timeout or at the end of the scan.
+    bool Park(size_t slot, std::chrono::milliseconds timeout);
+    // No work is left; parked workers return
+    void Finish();
+    bool Finished() const { return finished_.load(std::memory_order_relaxed); }
+
+    // One controller step with the throughput measured since the last one;
+    // returns the new number of active workers
+    size_t Adjust(double throughput);
+
+    double ThrottledSeconds() const { return throttledNs_.load() / 1e9; }
+
+private:
+    void SetActive(size_t active);
+    void Tick();
+
+    const size_t workers_;
+    const bool adaptive_;
+    std::function<bool()> starved_;
+    std::unique_ptr<TokenBucket> readBucket_; // bytes
+    std::unique_ptr<TokenBucket> cpuBucket_;  // CPU nanoseconds
+
+    std::atomic<size_t> active_;
+    std::atomic<bool> finished_{false};
+    std::mutex parkMutex_;
+    std::condition_variable activated_;
+
+    // Controller state, touched by one worker at a time under tickMutex_
+    std::mutex tickMutex_;
+    std::atomic<uint64_t> work_{0};
+    std::atomic<int64_t> nextTickNs_;
+    uint64_t lastWork_ = 0;
+    int64_t lastTickNs_ = 0;
+    double previous_ = -1.0; // throughput at the previous count, < 0 - none yet
+    int direction_ = 1;
+    size_t step_ = 1;
+    unsigned hold_ = 0;      // steps left before the next probe
+
+    std::atomic<uint64_t> throttledNs_{0};
+};
+
+// Nice 19 and the idle I/O class for the calling thread while in scope
+// (Linux). Only the thread itself is changed, so it composes with whatever
+// cgroup limits the service runs under. The old values come back on exit
+// where the process may raise its priority again.
+class BackgroundPriority {
+public:
+    explicit BackgroundPriority(bool enable);
+    ~BackgroundPriority();
+
+    BackgroundPriority(const BackgroundPriority&) = delete;
+    BackgroundPriority& operator=(const BackgroundPriority&) = delete;
+
+private:
+    bool enabled_ = false;
+    int nice_ = 0;
+    int ioPriority_ = -1;
+};
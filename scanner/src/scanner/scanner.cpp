@@ -1,6 +1,24 @@
 #include "scanner.hpp"
-#include <windows.h>
-#include <wincrypt.h>
+#include "md5.hpp"
+#include "file_reader.hpp"
+#include "hash_base.hpp"
+#include "versioned_base.hpp"
+#include "base_loader.hpp"
+#include "scan_cache.hpp"
+#include "inode_table.hpp"
+#include "detection_log.hpp"
+#include "directory.hpp"
+#include "scan_metrics.hpp"
+#include "worker_pool.hpp"
+#include "work_stealing_queue.hpp"
+#include "bounded_queue.hpp"
+#include "file_watcher.hpp"
+#include "archive_reader.hpp"
+#include "pattern_matcher.hpp"
+#include "small_file_batch.hpp"
+#include "scan_throttle.hpp"
+#include "scan_checkpoint.hpp"
+#include "scan_filter.hpp"
 #include <fstream>
 #include <iostream>
 #include <filesystem>
@@ -14,257 +32,1346 @@
 #include <iomanip>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
 
 namespace fs = std::filesystem;
 
-class ThreadPool {
-public:
-    ThreadPool(size_t threads) : stop(false) {
-        for (size_t i = 0; i < threads; ++i) {
-            workers.emplace_back([this] {
-                while (true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this] {
-                            return this->stop || !this->tasks.empty();
-                        });
-                        if (this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
+class Directory;
+
+MalwareScanner::MalwareScanner() : base_(std::make_unique<VersionedBase>()) {}
+MalwareScanner::~MalwareScanner() = default;
+
+bool MalwareScanner::LoadMalwareBase(const std::string& csvFilePath, size_t threadCount) {
+    return LoadMalwareBase(csvFilePath, threadCount, BaseFilterOptions());
+}
+
+bool MalwareScanner::LoadMalwareBase(const std::string& csvFilePath, size_t threadCount,
+                                     const BaseFilterOptions& filter) {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    loadReport_ = BaseLoadReport();
+
+    // Built aside; running scans keep using the current snapshot meanwhile
+    std::shared_ptr<const HashBase> base;
+    if (HashBase::IsCompiled(csvFilePath)) {
+        base = HashBase::Map(csvFilePath);
+    } else {
+        base = LoadCsvBase(csvFilePath, threadCount, filter, loadReport_);
+    }
+    if (!base) {
+        return false;
+    }
+
+    loadReport_.signatures = base->Size();
+    loadReport_.filterBytes = base->FilterBytes();
+    base_->Publish(std::move(base));
+    auto endTime = std::chrono::high_resolution_clock::now();
+    loadReport_.loadTime = std::chrono::duration<double>(endTime - startTime).count();
+    return true;
+}
+
+BaseLoadReport MalwareScanner::GetLoadReport() const {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    return loadReport_;
+}
+
+bool MalwareScanner::LoadPatternBase(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    patternReport_ = BaseLoadReport();
+    std::shared_ptr<const PatternMatcher> patterns = ::LoadPatternBase(filePath, patternReport_);
+    if (!patterns) {
+        return false;
+    }
+    std::atomic_store(&patterns_, std::move(patterns));
+    auto endTime = std::chrono::high_resolution_clock::now();
+    patternReport_.loadTime = std::chrono::duration<double>(endTime - startTime).count();
+    return true;
+}
+
+BaseLoadReport MalwareScanner::GetPatternReport() const {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    return patternReport_;
+}
+
+bool MalwareScanner::SaveCompiledBase(const std::string& filePath) const {
+    std::shared_ptr<const HashBase> base = base_->Load();
+    return base && base->Save(filePath);
+}
+
+namespace {
+
+const size_t BUFFER_SIZE = 65536;
+
+// Per-file overhead (open/close) added to the size when balancing work
+const uint64_t FILE_OPEN_COST = 4096;
+
+// Read position and hash state of a file that has been started
+struct FileProgress {
+    explicit FileProgress(DigestSet types) : hasher(types) {}
+
+    std::unique_ptr<FileReader> reader;
+    MultiHasher hasher;
+    std::unique_ptr<ArchiveReader> archive; // with ScanOptions::archiveDepth only
+    const PatternMatcher* patterns = nullptr; // with a pattern base only
+    PatternMatcher::Cursor patternCursor;
+    uint64_t bytesRead = 0;
+    uint64_t startNs = 0; // when the file was opened, with metrics only
+};
+
+// Unit of work for the hash workers
+struct FileJob {
+    std::string path;
+    uint64_t size = 0;
+    FileIdentity identity;  // valid when hasIdentity is set
+    bool hasIdentity = false;
+    bool sizeKnown = false;    // `size` came from a stat
+    bool inodePrimary = false; // other hardlinks wait for this job's digest
+    bool identifyOnOpen = false; // listed without a stat, hardlinks are found once it is open
+    std::unique_ptr<FileProgress> progress; // set once hashing has started
+    size_t nameOffset = 0; // start of the last component in `path` (parallel traversal)
+    ScanCheckpoint::NodePtr checkpointDir; // directory the job belongs to, with checkpoints only
+
+    // Directory to expand instead of a file (parallel traversal)
+    bool isDirectory = false;
+    std::shared_ptr<Directory> parent; // open parent, nullptr for the scan root
+    ScanFilter::State filterState = 0; // matcher state after `path`, with a filter only
+};
+
+// An MD5 lane of a worker together with the job it is hashing
+struct LaneStream {
+    FileJob job;
+    uint64_t sliceBytes = 0; // bytes hashed since the lane took the job
+    bool busy = false;
+};
+
+// Hashes the jobs handed out by `next` several at a time, one file per MD5
+// SIMD lane, and reports the digests through `done` (nullptr on read
+// failure). `start(job)` sets up the hash state when a file is opened; every
+// digest it asks for is computed from the same buffers, as are pattern
+// matches if it attaches a matcher. Members of an attached archive reader
+// go through `member(job, name, digests)`.
+// A job with `identifyOnOpen` goes to `opened(job, identity)` once its file
+// is open (identity nullptr if unknown); if that returns false, the file is
+// not hashed and `opened` has finished the job itself.
+// `next(job, wait)` may only block when `wait` is set, i.e. no lane is busy.
+// A job that hashed `chunkSize` bytes without finishing goes to `yield`, so
+// its next chunk can be picked up by whichever worker is free.
+// Files that may be small are read `smallFileBatch` at a time instead (0 -
+// never) and hashed straight from the batch buffers, MD5 again across the
+// lanes; the ones that turn out larger go to a lane after all.
+// `pace(bytes, files)` follows every round of buffers and may sleep.
+// `metrics` (may be null) receives read and hash times and per-file latency.
+template<class NextFn, class DoneFn, class YieldFn, class StartFn, class OpenedFn, class MemberFn, class PaceFn>
+void HashFileStreams(NextFn&& next, DoneFn&& done, YieldFn&& yield, StartFn&& start, OpenedFn&& opened,
+                     MemberFn&& member, PaceFn&& pace, uint64_t chunkSize, size_t smallFileBatch,
+                     ReadBackend backend, ThreadMetrics* metrics) {
+    std::vector<LaneStream> streams(MD5LaneCount());
+
+    std::vector<MultiHasher*> hashers;
+    std::vector<MD5*> contexts;
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    std::vector<LaneStream*> finished;
+    std::vector<LaneStream*> yielded;
+    std::vector<std::pair<FileJob*, size_t>> contentScans; // job and index into data
+
+    std::unique_ptr<SmallFileBatch> batch;
+    if (smallFileBatch > 0) {
+        batch = std::make_unique<SmallFileBatch>(smallFileBatch);
+    }
+    std::vector<FileJob> batchJobs;
+    std::vector<FileJob> largeJobs; // queued as small, read through a lane instead
+
+    // MD5 runs across the lanes in lockstep, the other digests, patterns
+    // and archive members one buffer after another while it is still in cache
+    auto hashBuffers = [&] {
+        for (const auto& scan : contentScans) {
+            const FileJob& job = *scan.first;
+            FileProgress& progress = *job.progress;
+            if (progress.patterns) {
+                progress.patterns->Scan(progress.patternCursor, data[scan.second], sizes[scan.second]);
+            }
+            if (progress.archive) {
+                progress.archive->Feed(data[scan.second], sizes[scan.second],
+                    [&](const std::string& name, const FileDigests& digests) { member(job, name, digests); });
+            }
+        }
+        // Files opened around a base reload may want different digests
+        size_t md5Count = 0;
+        for (size_t i = 0; i < hashers.size(); ++i) {
+            if (hashers[i]->Types() & DigestBit(DigestType::MD5)) {
+                std::swap(hashers[md5Count], hashers[i]);
+                std::swap(data[md5Count], data[i]);
+                std::swap(sizes[md5Count], sizes[i]);
+                contexts.push_back(&hashers[md5Count]->MD5Context());
+                ++md5Count;
+            }
+        }
+        MD5UpdateMany(contexts.data(), data.data(), sizes.data(), md5Count);
+        for (size_t i = 0; i < hashers.size(); ++i) {
+            hashers[i]->UpdateExceptMD5(data[i], sizes[i]);
+        }
+    };
+    auto timedHashBuffers = [&](uint64_t readStart) {
+        if (metrics) {
+            uint64_t hashStart = MetricsNow();
+            metrics->readNs += hashStart - readStart;
+            hashBuffers();
+            metrics->hashNs += MetricsNow() - hashStart;
+            for (size_t size : sizes) {
+                metrics->bytesRead += size;
+            }
+        } else {
+            hashBuffers();
+        }
+    };
+    auto clearBuffers = [&] {
+        hashers.clear();
+        contexts.clear();
+        data.clear();
+        sizes.clear();
+        contentScans.clear();
+    };
+    auto finishFile = [&](FileJob& job) {
+        FileDigests digests;
+        FileProgress& progress = *job.progress;
+        if (progress.archive) {
+            progress.archive->Finish(
+                [&](const std::string& name, const FileDigests& found) { member(job, name, found); });
+        }
+        progress.hasher.Final(digests);
+        if (metrics) {
+            metrics->filesHashed++;
+            metrics->AddFileLatency(MetricsNow() - progress.startNs);
+        }
+        done(job, &digests);
+    };
+
+    auto hashBatch = [&] {
+        uint64_t readStart = metrics ? MetricsNow() : 0;
+        batch->Read();
+        clearBuffers();
+        uint64_t batchBytes = 0;
+        size_t batchFiles = 0;
+        for (size_t i = 0; i < batchJobs.size(); ++i) {
+            FileJob& job = batchJobs[i];
+            const uint8_t* bytes = nullptr;
+            size_t size = 0;
+            SmallFileBatch::Status status = batch->Result(i, bytes, size);
+            if (status == SmallFileBatch::Status::Read) {
+                if (job.identifyOnOpen) {
+                    FileIdentity identity;
+                    if (!opened(job, batch->Identify(i, identity) ? &identity : nullptr)) {
+                        continue;
+                    }
+                }
+                job.progress = start(job);
+                job.progress->startNs = readStart;
+                job.progress->bytesRead = size;
+                if (size > 0) {
+                    if (job.progress->archive || job.progress->patterns) {
+                        contentScans.emplace_back(&job, data.size());
+                    }
+                    hashers.push_back(&job.progress->hasher);
+                    data.push_back(bytes);
+                    sizes.push_back(size);
+                }
+                batchBytes += size;
+                batchFiles++;
+            } else if (status == SmallFileBatch::Status::TooLarge) {
+                largeJobs.push_back(std::move(job));
+                job = FileJob();
+            } else {
+                done(job, nullptr);
+            }
+        }
+        timedHashBuffers(readStart);
+        for (auto& job : batchJobs) {
+            if (job.progress) {
+                finishFile(job);
+            }
+        }
+        batchJobs.clear();
+        batch->Clear();
+        pace(batchBytes, batchFiles);
+    };
+
+    for (;;) {
+        // Refill idle lanes, blocking only when there is nothing else to hash
+        bool anyBusy = false;
+        for (auto& stream : streams) {
+            anyBusy = anyBusy || stream.busy;
+        }
+        for (auto& stream : streams) {
+            while (!stream.busy) {
+                FileJob& job = stream.job;
+                if (!largeJobs.empty()) {
+                    job = std::move(largeJobs.back());
+                    largeJobs.pop_back();
+                } else if (!next(job, !anyBusy && batchJobs.empty())) {
+                    break;
+                } else if (batch && !job.progress && (!job.sizeKnown || job.size <= SmallFileBatch::FILE_LIMIT)) {
+                    batch->Add(job.path);
+                    batchJobs.push_back(std::move(job));
+                    job = FileJob();
+                    if (batch->Full()) {
+                        hashBatch();
                     }
-                    task();
+                    continue;
                 }
-            });
+                if (!job.progress) {
+                    ScopedTimer timer(metrics ? &metrics->readNs : nullptr);
+                    job.progress = start(job);
+                    job.progress->startNs = metrics ? MetricsNow() : 0;
+                    job.progress->reader = CreateFileReader(backend);
+                    if (!job.progress->reader->Open(job.path)) {
+                        done(job, nullptr);
+                        continue;
+                    }
+                    if (job.identifyOnOpen) {
+                        FileIdentity identity;
+                        if (!opened(job, job.progress->reader->Identify(identity) ? &identity : nullptr)) {
+                            job = FileJob();
+                            continue;
+                        }
+                    }
+                }
+                stream.sliceBytes = 0;
+                stream.busy = true;
+                anyBusy = true;
+            }
         }
+        if (!batchJobs.empty()) {
+            hashBatch();
+            if (!anyBusy) {
+                continue; // lanes for the files that were too large, or more work
+            }
+        }
+        if (!anyBusy) {
+            break;
+        }
+
+        clearBuffers();
+        finished.clear();
+        yielded.clear();
+        uint64_t readStart = metrics ? MetricsNow() : 0;
+        for (auto& stream : streams) {
+            if (!stream.busy) {
+                continue;
+            }
+            FileProgress& progress = *stream.job.progress;
+            const uint8_t* chunk = nullptr;
+            size_t count = 0;
+            if (!progress.reader->Next(chunk, count)) {
+                stream.busy = false;
+                done(stream.job, nullptr);
+                stream.job = FileJob();
+                continue;
+            }
+            if (count > 0) {
+                if (progress.archive || progress.patterns) {
+                    contentScans.emplace_back(&stream.job, data.size());
+                }
+                hashers.push_back(&progress.hasher);
+                data.push_back(chunk);
+                sizes.push_back(count);
+            }
+            progress.bytesRead += count;
+            stream.sliceBytes += count;
+            if (progress.reader->Finished()) {
+                finished.push_back(&stream);
+            } else if (chunkSize > 0 && stream.sliceBytes >= chunkSize) {
+                yielded.push_back(&stream);
+            }
+        }
+        timedHashBuffers(readStart);
+
+        for (LaneStream* stream : finished) {
+            stream->busy = false;
+            finishFile(stream->job);
+            stream->job = FileJob();
+        }
+        for (LaneStream* stream : yielded) {
+            stream->busy = false;
+            yield(std::move(stream->job));
+            stream->job = FileJob();
+        }
+        uint64_t roundBytes = 0;
+        for (size_t size : sizes) {
+            roundBytes += size;
+        }
+        pace(roundBytes, finished.size());
     }
+}
 
-    template<class F>
-    void Enqueue(F&& f) {
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            tasks.emplace(std::forward<F>(f));
+// Counters of one scan, updated from every thread
+struct ScanCounters {
+    std::atomic<size_t> filesFound{0};
+    std::atomic<size_t> maliciousFound{0};
+    std::atomic<size_t> errors{0};
+    std::atomic<size_t> skippedFiles{0};
+    std::atomic<uint64_t> skippedBytes{0};
+    std::atomic<size_t> cacheHits{0};
+    std::atomic<size_t> dedupedFiles{0};
+    std::atomic<uint64_t> dedupedBytes{0};
+    std::atomic<size_t> archiveMembers{0};
+    std::atomic<size_t> skippedMembers{0};
+    std::atomic<size_t> damagedArchives{0};
+    std::atomic<size_t> filteredFiles{0};
+    std::atomic<size_t> filteredDirectories{0};
+
+    // Adds these counts to `counts`
+    void AddTo(ScanResult& counts) const {
+        counts.totalFiles += filesFound;
+        counts.maliciousFiles += maliciousFound;
+        counts.errorCount += errors;
+        counts.skippedBySize += skippedFiles;
+        counts.bytesSkippedBySize += skippedBytes;
+        counts.cacheHits += cacheHits;
+        counts.dedupedFiles += dedupedFiles;
+        counts.dedupedBytes += dedupedBytes;
+        counts.archiveMembers += archiveMembers;
+        counts.skippedMembers += skippedMembers;
+        counts.damagedArchives += damagedArchives;
+        counts.filteredFiles += filteredFiles;
+        counts.filteredDirectories += filteredDirectories;
+    }
+};
+
+// False for a directory inode walked before (bind mount)
+using DirectoryVisitFn = std::function<bool(const std::string& path, const FileIdentity& identity)>;
+// Size gate, dedupe and cache for a file `slot` found: true if it has to be hashed
+using FileAdmitFn = std::function<bool(size_t slot, FileJob& job)>;
+
+// Size and age rules of `filter` (may be null) for a file that was stat'ed
+bool WithinLimits(const ScanFilter* filter, const FileJob& job, int64_t nowNs) {
+    return !filter || !job.hasIdentity || filter->MatchLimits(job.identity.size, job.identity.mtimeNs, nowNs);
+}
+
+#ifdef __linux__
+// Parallel traversal: every directory is a deferred job on the hash
+// workers. Expanding one reads its entries in getdents64 batches, stats
+// only what d_type cannot tell or what the size gate, cache and size or
+// age rules need (hardlinks are found once a file is open), and queues its
+// files ahead of any further directories. Directories and files the filter
+// rules out are skipped as they are listed; with a checkpoint, so are those
+// done before a restart.
+class ParallelWalker {
+public:
+    // `filter`, `checkpoint` and `firstVisit` (no dedupe) may be null.
+    // Files are stat'ed with `needStat`, age rules count from `nowNs`.
+    ParallelWalker(WorkStealingQueue<FileJob>& jobs, ScanCounters& counters, const ScanFilter* filter,
+                   ScanCheckpoint* checkpoint, int64_t nowNs, bool needStat, DirectoryVisitFn firstVisit,
+                   FileAdmitFn admit)
+        : jobs_(jobs), counters_(counters), filter_(filter), checkpoint_(checkpoint), nowNs_(nowNs),
+          needStat_(needStat), firstVisit_(std::move(firstVisit)), admit_(std::move(admit)) {}
+
+    // Queues the scan root; closes the queue if the checkpoint has all of it done
+    void Start(const std::string& root) {
+        FileJob job;
+        job.isDirectory = true;
+        job.path = root;
+        if (checkpoint_) {
+            job.checkpointDir = checkpoint_->Root();
+            if (!job.checkpointDir) {
+                jobs_.Close();
+                return;
+            }
         }
-        condition.notify_one();
+        pendingDirectories_ = 1;
+        jobs_.Defer(0, std::move(job));
     }
 
-    void WaitAll() {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        condition_empty.wait(lock, [this]() {
-            return tasks.empty();
-        });
+    // Lists directory job `task`, taken off the queue by `slot`, and queues
+    // what it holds. The queue is closed after the last directory.
+    void Expand(size_t slot, FileJob& task, ThreadMetrics* metrics) {
+        try {
+            ScopedTimer timer(metrics ? &metrics->traversalNs : nullptr);
+            List(slot, task);
+        } catch (const std::exception& e) {
+            counters_.errors++;
+        }
+        if (checkpoint_) {
+            checkpoint_->Listed(task.checkpointDir);
+        }
+        task = FileJob();
+        jobs_.Done();
+        if (--pendingDirectories_ == 0) {
+            jobs_.Close();
+        }
     }
 
-    ~ThreadPool() {
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            stop = true;
+private:
+    void List(size_t slot, FileJob& task) {
+        std::shared_ptr<Directory> dir = task.parent
+            ? task.parent->OpenChild(task.path.c_str() + task.nameOffset, task.path)
+            : Directory::Open(task.path);
+        task.parent.reset(); // the parent stays open only until its last child is
+        if (!dir) {
+            counters_.errors++;
+            return;
         }
-        condition.notify_all();
-        for (std::thread &worker : workers) {
-            if (worker.joinable()) {
-                worker.join();
+        if (firstVisit_) {
+            FileIdentity identity;
+            if (dir->Stat(identity) && !firstVisit_(dir->Path(), identity)) {
+                return;
             }
         }
+
+        bool complete = dir->ForEach([&](const char* name, Directory::EntryType type) {
+            FileJob job;
+            if (type == Directory::EntryType::Unknown) {
+                if (!dir->Stat(name, false, job.identity, type)) {
+                    counters_.errors++;
+                    return;
+                }
+                job.hasIdentity = type == Directory::EntryType::File;
+            }
+            if (type == Directory::EntryType::Directory) {
+                FileJob child;
+                if (filter_ && !filter_->EnterDirectory(task.filterState, name, child.filterState)) {
+                    counters_.filteredDirectories++;
+                    return;
+                }
+                child.isDirectory = true;
+                child.path = dir->Join(name);
+                child.nameOffset = child.path.size() - std::strlen(name);
+                child.parent = dir;
+                if (checkpoint_) {
+                    child.checkpointDir = checkpoint_->Enter(task.checkpointDir, child.path, child.nameOffset);
+                    if (!child.checkpointDir) {
+                        return; // done before the restart
+                    }
+                }
+                pendingDirectories_++;
+                jobs_.Defer(slot, std::move(child));
+                return;
+            }
+            if (type == Directory::EntryType::Symlink) {
+                // Like is_regular_file(), a symlink to a file is scanned
+                if (!dir->Stat(name, true, job.identity, type)) {
+                    return;
+                }
+                job.hasIdentity = true;
+            }
+            if (type != Directory::EntryType::File) {
+                return;
+            }
+            if (filter_ && !filter_->MatchFile(task.filterState, name)) {
+                counters_.filteredFiles++;
+                return;
+            }
+            if (checkpoint_ && checkpoint_->Skip(task.checkpointDir, name)) {
+                return;
+            }
+
+            job.path = dir->Join(name);
+            job.nameOffset = job.path.size() - std::strlen(name);
+            if (!job.hasIdentity && needStat_) {
+                job.hasIdentity = dir->Stat(name, true, job.identity, type);
+            }
+            job.size = job.hasIdentity ? job.identity.size : 0;
+            job.sizeKnown = job.hasIdentity;
+            if (!WithinLimits(filter_, job, nowNs_)) {
+                counters_.filteredFiles++;
+                return;
+            }
+            try {
+                bool queued = admit_(slot, job);
+                if (checkpoint_) {
+                    if (queued) {
+                        checkpoint_->Queued(task.checkpointDir);
+                        job.checkpointDir = task.checkpointDir;
+                    } else {
+                        checkpoint_->FileDone(task.checkpointDir, name, false, slot);
+                    }
+                }
+                if (queued) {
+                    uint64_t weight = job.size + FILE_OPEN_COST;
+                    jobs_.PushOwn(slot, std::move(job), weight);
+                }
+            } catch (const std::exception& e) {
+                counters_.errors++;
+            }
+        });
+        if (!complete) {
+            counters_.errors++;
+        }
     }
 
-private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    std::condition_variable condition_empty;
-    bool stop;
+    WorkStealingQueue<FileJob>& jobs_;
+    ScanCounters& counters_;
+    const ScanFilter* filter_;
+    ScanCheckpoint* checkpoint_;
+    const int64_t nowNs_;
+    const bool needStat_;
+    DirectoryVisitFn firstVisit_;
+    FileAdmitFn admit_;
+    std::atomic<size_t> pendingDirectories_{0};
 };
+#endif
 
-MalwareScanner::MalwareScanner() = default;
-MalwareScanner::~MalwareScanner() = default;
+// Walks on the scanning thread: the tree through std::filesystem, or the
+// paths of a file list as given. Files go to the workers through Push,
+// which blocks while the queue is full; the queue is closed at the end.
+class SerialWalker {
+public:
+    // `filter` and `firstVisit` (no dedupe) may be null. Files are stat'ed
+    // with `needStat`, age rules count from `nowNs`. Files are admitted as
+    // `slot`, whose `metrics` (may be null) get the traversal time.
+    SerialWalker(WorkStealingQueue<FileJob>& jobs, ScanCounters& counters, const ScanFilter* filter,
+                 int64_t nowNs, bool needStat, DirectoryVisitFn firstVisit, FileAdmitFn admit,
+                 size_t slot, ThreadMetrics* metrics)
+        : jobs_(jobs), counters_(counters), filter_(filter), nowNs_(nowNs), needStat_(needStat),
+          firstVisit_(std::move(firstVisit)), admit_(std::move(admit)), slot_(slot), metrics_(metrics) {}
 
-bool MalwareScanner::LoadMalwareBase(const std::string& csvFilePath) {
-    malwareHashes_.clear();
-    
-    std::ifstream file(csvFilePath);
-    if (!file.is_open()) {
-        return false;
+    void Walk(const std::string& root) {
+        uint64_t start = metrics_ ? MetricsNow() : 0;
+        try {
+            FileIdentity rootIdentity;
+            if (firstVisit_ && GetFileIdentity(root, rootIdentity)) {
+                firstVisit_(root, rootIdentity);
+            }
+            fs::recursive_directory_iterator it(root), end;
+            // Matcher state of each directory on the current path, by depth
+            std::vector<ScanFilter::State> filterStates(1, filter_ ? filter_->Root() : 0);
+            for (; it != end; ++it) {
+                const auto& entry = *it;
+                if (filter_) {
+                    size_t depth = static_cast<size_t>(it.depth());
+                    std::string name = entry.path().filename().string();
+                    if (entry.is_directory() && !entry.is_symlink()) {
+                        filterStates.resize(depth + 2);
+                        if (!filter_->EnterDirectory(filterStates[depth], name.c_str(), filterStates[depth + 1])) {
+                            counters_.filteredDirectories++;
+                            it.disable_recursion_pending();
+                            continue;
+                        }
+                    } else if (entry.is_regular_file() && !filter_->MatchFile(filterStates[depth], name.c_str())) {
+                        counters_.filteredFiles++;
+                        continue;
+                    }
+                }
+                if (firstVisit_ && entry.is_directory() && !entry.is_symlink()) {
+                    FileIdentity identity;
+                    if (GetFileIdentity(entry.path().string(), identity) &&
+                        !firstVisit_(entry.path().string(), identity)) {
+                        it.disable_recursion_pending();
+                    }
+                    continue;
+                }
+                if (entry.is_regular_file()) {
+                    try {
+                        FileJob job;
+                        job.path = entry.path().string();
+                        Push(job, [&](std::error_code& sizeError) { return entry.file_size(sizeError); });
+                    } catch (const std::exception& e) {
+                        counters_.errors++;
+                    }
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error scanning directory: " << e.what() << std::endl;
+            counters_.errors++;
+        }
+        Finish(start);
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        // Remove carriage return if present (for Windows line endings)
-        if (!line.empty() && line.back() == '\r') {
-            line.pop_back();
+    void WalkFiles(const std::function<bool(std::string& path)>& nextFile) {
+        uint64_t start = metrics_ ? MetricsNow() : 0;
+        for (std::string path; nextFile(path);) {
+            try {
+                std::error_code ec;
+                if (!fs::is_regular_file(path, ec)) {
+                    counters_.errors++;
+                    continue;
+                }
+                if (filter_ && !filter_->MatchPath(path)) {
+                    counters_.filteredFiles++;
+                    continue;
+                }
+                FileJob job;
+                job.path = path;
+                Push(job, [&](std::error_code& sizeError) { return fs::file_size(path, sizeError); });
+            } catch (const std::exception& e) {
+                counters_.errors++;
+            }
         }
-        
-        size_t pos = line.find(';');
-        if (pos != std::string::npos) {
-            std::string hash = line.substr(0, pos);
-            std::string verdict = line.substr(pos + 1);
-            malwareHashes_[hash] = verdict;
+        Finish(start);
+    }
+
+private:
+    template<class SizeFn>
+    void Push(FileJob& job, SizeFn&& fileSize) {
+        std::error_code ec;
+        if (needStat_ && GetFileIdentity(job.path, job.identity)) {
+            job.hasIdentity = true;
+            job.size = job.identity.size;
+        } else {
+            job.size = fileSize(ec);
+        }
+        if (ec) {
+            job.size = 0;
+        }
+        job.sizeKnown = !ec;
+        if (!WithinLimits(filter_, job, nowNs_)) {
+            counters_.filteredFiles++;
+            return;
+        }
+        if (admit_(slot_, job)) {
+            uint64_t weight = job.size + FILE_OPEN_COST;
+            ScopedTimer timer(metrics_ ? &pushNs_ : nullptr);
+            jobs_.Push(std::move(job), weight);
         }
     }
 
-    return true;
-}
+    // Time blocked on a full queue is not traversal
+    void Finish(uint64_t start) {
+        if (metrics_) {
+            metrics_->traversalNs += MetricsNow() - start - pushNs_;
+        }
+        jobs_.Close();
+    }
 
-std::string CalculateMD5(const std::string& filePath) {
-    HCRYPTPROV hProv = 0;
-    HCRYPTHASH hHash = 0;
-    BYTE rgbHash[16];
-    DWORD cbHash = 16;
-    CHAR rgbDigits[] = "0123456789abcdef";
-    std::string result;
-
-    if (!CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT)) {
-        return "";
+    WorkStealingQueue<FileJob>& jobs_;
+    ScanCounters& counters_;
+    const ScanFilter* filter_;
+    const int64_t nowNs_;
+    const bool needStat_;
+    DirectoryVisitFn firstVisit_;
+    FileAdmitFn admit_;
+    const size_t slot_;
+    ThreadMetrics* metrics_;
+    uint64_t pushNs_ = 0;
+};
+
+std::string WithTrailingSeparator(std::string path) {
+    const char separator = static_cast<char>(fs::path::preferred_separator);
+    if (path.empty() || (path.back() != separator && path.back() != '/')) {
+        path += separator;
     }
+    return path;
+}
+
+} // namespace
 
-    if (!CryptCreateHash(hProv, CALG_MD5, 0, 0, &hHash)) {
-        CryptReleaseContext(hProv, 0);
+std::string CalculateMD5(const std::string& filePath) {
+    FileDigests digests;
+    if (!CalculateDigests(filePath, DigestBit(DigestType::MD5), digests)) {
         return "";
     }
+    return digests.ToHex(DigestType::MD5);
+}
 
+bool CalculateDigests(const std::string& filePath, DigestSet types, FileDigests& digests) {
     std::ifstream file(filePath, std::ios::binary);
     if (!file) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProv, 0);
-        return "";
+        return false;
     }
 
-    const size_t BUFFER_SIZE = 8192;
-    char buffer[BUFFER_SIZE];
-
-    while (file.read(buffer, BUFFER_SIZE) || file.gcount() > 0) {
-        if (!CryptHashData(hHash, (BYTE*)buffer, (DWORD)file.gcount(), 0)) {
-            CryptDestroyHash(hHash);
-            CryptReleaseContext(hProv, 0);
-            return "";
-        }
+    MultiHasher hasher(types);
+    std::vector<char> buffer(BUFFER_SIZE);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        hasher.Update(buffer.data(), static_cast<size_t>(file.gcount()));
     }
-
-    if (CryptGetHashParam(hHash, HP_HASHVAL, rgbHash, &cbHash, 0)) {
-        for (DWORD i = 0; i < cbHash; i++) {
-            result += rgbDigits[rgbHash[i] >> 4];
-            result += rgbDigits[rgbHash[i] & 0xf];
-        }
+    if (file.bad()) {
+        return false;
     }
 
-    CryptDestroyHash(hHash);
-    CryptReleaseContext(hProv, 0);
-    return result;
+    hasher.Final(digests);
+    return true;
+}
+
+bool MalwareScanner::HasSignatures() const {
+    std::shared_ptr<const HashBase> base = base_->Load();
+    return base && base->Size() > 0;
 }
 
 ScanResult MalwareScanner::ScanDirectory(const std::string& directoryPath, 
                                        const std::string& logFilePath,
                                        size_t threadCount) {
-    auto startTime = std::chrono::high_resolution_clock::now();
-    ScanResult result;
+    ScanOptions options;
+    options.threadCount = threadCount;
+    return ScanDirectory(directoryPath, logFilePath, options);
+}
 
-    if (malwareHashes_.empty()) {
+ScanResult MalwareScanner::ScanDirectory(const std::string& directoryPath,
+                                       const std::string& logFilePath,
+                                       const ScanOptions& options) {
+    if (!HasSignatures()) {
         std::cerr << "Warning: Malware base is empty" << std::endl;
-        return result;
+        return ScanResult();
     }
 
     // Validate directory exists
     if (!fs::exists(directoryPath) || !fs::is_directory(directoryPath)) {
         std::cerr << "Error: Directory does not exist: " << directoryPath << std::endl;
+        ScanResult result;
         result.errorCount++;
         return result;
     }
 
-    if (threadCount == 0) {
-        threadCount = std::thread::hardware_concurrency();
-        if (threadCount == 0) threadCount = 4;
+    return RunScan(directoryPath, nullptr, logFilePath, options);
+}
+
+ScanResult MalwareScanner::ScanFiles(const std::vector<std::string>& filePaths,
+                                     const std::string& logFilePath,
+                                     const ScanOptions& options) {
+    if (!HasSignatures()) {
+        std::cerr << "Warning: Malware base is empty" << std::endl;
+        return ScanResult();
     }
+    size_t next = 0;
+    FileSource nextFile = [&](std::string& path) {
+        if (next == filePaths.size()) {
+            return false;
+        }
+        path = filePaths[next++];
+        return true;
+    };
+    return RunScan(std::string(), &nextFile, logFilePath, options);
+}
 
-    std::ofstream logFile(logFilePath);
-    if (!logFile.is_open()) {
-        std::cerr << "Error: Could not open log file: " << logFilePath << std::endl;
+ScanResult MalwareScanner::Watch(const std::string& directoryPath,
+                                 const std::string& logFilePath,
+                                 const ScanOptions& options,
+                                 const WatchOptions& watchOptions,
+                                 const std::atomic<bool>& stop) {
+    if (!HasSignatures()) {
+        std::cerr << "Warning: Malware base is empty" << std::endl;
+        return ScanResult();
+    }
+    ScanResult result;
+#ifdef __linux__
+    FileWatcher watcher{std::chrono::milliseconds(watchOptions.settleMs)};
+    if (!fs::is_directory(directoryPath) || !watcher.Start(directoryPath, watchOptions.initialScan)) {
+        std::cerr << "Error: Could not watch directory: " << directoryPath << std::endl;
         result.errorCount++;
         return result;
     }
 
-    // Collect file paths
-    std::vector<std::string> filePaths;
-    std::atomic<size_t> filesProcessed{0};
-    std::atomic<size_t> maliciousFound{0};
-    std::atomic<size_t> errors{0};
+    // The watcher thread feeds settled files to the scan as if they came
+    // from a file list; closing the queue ends the scan
+    BoundedQueue<std::string> changed(options.queueDepth);
+    std::atomic<bool> scanEnded{false};
+    std::thread watcherThread([&] {
+        std::vector<std::string> ready;
+        while (!stop.load(std::memory_order_relaxed) && !scanEnded.load(std::memory_order_relaxed)) {
+            watcher.Poll(100, ready);
+            for (auto& path : ready) {
+                std::error_code ec;
+                if (fs::is_regular_file(path, ec)) {
+                    changed.Push(std::move(path));
+                }
+            }
+            ready.clear();
+        }
+        changed.Close();
+    });
 
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(directoryPath)) {
-            if (entry.is_regular_file()) {
-                try {
-                    filePaths.push_back(entry.path().string());
-                } catch (const std::exception& e) {
-                    errors++;
+    // A file rewritten in place keeps its inode, so digests remembered per
+    // inode would be stale; hardlinks are simply hashed again
+    ScanOptions watchScan = options;
+    watchScan.dedupeInodes = false;
+    FileSource nextFile = [&](std::string& path) { return changed.Pop(path); };
+    result = RunScan(std::string(), &nextFile, logFilePath, watchScan);
+    // Only reached early if the scan failed to start
+    scanEnded = true;
+    changed.Close();
+    watcherThread.join();
+#else
+    (void)directoryPath;
+    (void)logFilePath;
+    (void)options;
+    (void)watchOptions;
+    (void)stop;
+    std::cerr << "Error: Watch mode is not supported on this platform" << std::endl;
+    result.errorCount++;
+#endif
+    return result;
+}
+
+ScanResult MalwareScanner::RunScan(const std::string& directoryPath,
+                                   const FileSource* nextFile,
+                                   const std::string& logFilePath,
+                                   const ScanOptions& options) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ScanResult result;
+
+    // Workers run on the caller's resident pool or on one made for this scan.
+    // A low-priority scan always gets threads of its own: a reniced thread may
+    // not be allowed to raise its priority again, and pool threads outlive the scan.
+    WorkerPool* pool = options.throttle.lowPriority ? nullptr : options.pool;
+    std::unique_ptr<WorkerPool> ownPool;
+    size_t threadCount = options.threadCount;
+    if (pool) {
+        if (threadCount == 0) {
+            threadCount = pool->ThreadCount();
+        }
+    } else {
+        if (threadCount == 0 && options.pool) {
+            threadCount = options.pool->ThreadCount();
+        }
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+            if (threadCount == 0) threadCount = 4;
+        }
+        ownPool = std::make_unique<WorkerPool>(threadCount);
+        pool = ownPool.get();
+    }
+
+    // Workers use producer slots 0..threadCount-1, the scanning thread the last one
+    const size_t traversalSlot = threadCount;
+    DetectionLog logFile;
+    if (!logFilePath.empty() && !logFile.Open(logFilePath, threadCount + 1, options.logFlush)) {
+        std::cerr << "Error: Could not open log file: " << logFilePath << std::endl;
+        result.errorCount++;
+        return result;
+    }
+
+    // Progress is saved now and then so that a scan that dies can go on
+    // where it stopped. Only the parallel walk knows when a directory is done.
+    std::unique_ptr<ScanCheckpoint> checkpoint;
+    if (!options.checkpointPath.empty()) {
+#ifdef __linux__
+        const bool canCheckpoint = options.parallelTraversal && !nextFile;
+#else
+        const bool canCheckpoint = false;
+#endif
+        if (canCheckpoint) {
+            checkpoint = std::make_unique<ScanCheckpoint>(directoryPath, threadCount + 1);
+            if (options.resume && !checkpoint->Load(options.checkpointPath)) {
+                std::cerr << "Warning: No usable checkpoint in " << options.checkpointPath
+                          << ", scanning from the start" << std::endl;
+            }
+            // The log is written again, starting with what was found before
+            if (logFile.IsOpen()) {
+                for (const auto& detection : checkpoint->RestoredDetections()) {
+                    logFile.Write(traversalSlot, detection.path, detection.hash, detection.verdict);
                 }
             }
+        } else {
+            std::cerr << "Warning: Checkpoints need the parallel directory walk (Linux), scanning without"
+                      << std::endl;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
-        errors++;
     }
 
-    result.totalFiles = filePaths.size();
+    // Every slot looks signatures up in its own snapshot reference and moves
+    // to a reloaded base between files
+    std::vector<VersionedBase::Reader> bases(threadCount + 1, VersionedBase::Reader(*base_));
+    // Pattern signatures stay as loaded when the scan started
+    std::shared_ptr<const PatternMatcher> patterns = std::atomic_load(&patterns_);
+    if (patterns && patterns->Size() == 0) {
+        patterns.reset();
+    }
+    ScanCounters counters;
 
-    if (filePaths.empty()) {
-        auto endTime = std::chrono::high_resolution_clock::now();
-        result.executionTime = std::chrono::duration<double>(endTime - startTime).count();
-        return result;
+    // Digests of unchanged files come from the cache instead of the disk
+    // (not with pattern signatures, which need the content; it is still updated)
+    ScanCache* cache = options.cache;
+    std::unique_ptr<ScanCache> ownCache;
+    if (!cache && !options.cachePath.empty()) {
+        ownCache = std::make_unique<ScanCache>();
+        if (!ownCache->Open(options.cachePath)) {
+            std::cerr << "Warning: Ignoring unreadable scan cache: " << options.cachePath << std::endl;
+            ownCache = std::make_unique<ScanCache>();
+        }
+        cache = ownCache.get();
     }
 
-    std::mutex logMutex;
+    // Hardlinks are hashed once per inode. A directory reached a second time
+    // (bind mount) is not walked again; detections under its first path are
+    // repeated for the alias once the scan is done. Only digests are kept
+    // per inode, so with pattern signatures every path is read. Checkpoints
+    // do not keep per-inode digests either.
+    const bool dedupe = options.dedupeInodes && !patterns && !checkpoint;
+    InodeTable inodes;
+    std::vector<std::vector<std::pair<std::string, FileDigests>>> detections(threadCount + 1);
+
+    // Per-thread counters, indexed like the log slots; null pointers when disabled
+    std::vector<ThreadMetrics> threadMetrics(options.collectMetrics ? threadCount + 1 : 0);
+    auto metricsOf = [&](size_t slot) {
+        return threadMetrics.empty() ? nullptr : &threadMetrics[slot];
+    };
 
-    // Use simpler approach without ThreadPool class
-    std::vector<std::thread> threads;
-    size_t filesPerThread = (filePaths.size() + threadCount - 1) / threadCount;
+    // Every file is hashed with each digest type the base lists (or the
+    // caller asked for) in one read pass
+    auto digestTypes = [&](size_t slot) {
+        return options.digestTypes ? options.digestTypes : bases[slot].Get().Types();
+    };
 
-    for (size_t i = 0; i < threadCount; ++i) {
-        threads.emplace_back([&, i]() {
-            size_t start = i * filesPerThread;
-            size_t end = std::min(start + filesPerThread, filePaths.size());
+    auto report = [&](size_t slot, const std::string& filePath, const std::string& hash,
+                      std::string_view verdict) {
+        counters.maliciousFound++;
+        if (checkpoint) {
+            checkpoint->Found(slot, {filePath, hash, std::string(verdict)});
+        }
+        if (logFile.IsOpen()) {
+            logFile.Write(slot, filePath, hash, verdict);
+        }
+        if (options.onDetection) {
+            options.onDetection(filePath, hash, verdict);
+        }
+    };
+
+    auto checkDigest = [&](size_t slot, const std::string& filePath, const FileDigests& digests) {
+        ThreadMetrics* metrics = metricsOf(slot);
+        std::string_view verdict;
+        DigestType matched;
+        bool found;
+        {
+            ScopedTimer timer(metrics ? &metrics->lookupNs : nullptr);
+            found = bases[slot].Get().Find(digests, matched, verdict);
+        }
+        if (found) {
+            ScopedTimer timer(metrics ? &metrics->logNs : nullptr);
+            if (dedupe) {
+                detections[slot].emplace_back(filePath, digests);
+            }
+            report(slot, filePath, digests.ToHex(matched), verdict);
+        }
+        return found;
+    };
+
+    // A file whose digests are not in the base may still hold a byte
+    // pattern; it is reported with where the pattern starts instead of a hash
+    auto checkPatterns = [&](size_t slot, const std::string& filePath, const FileProgress& progress) {
+        const PatternMatcher::Cursor& cursor = progress.patternCursor;
+        if (progress.patterns && cursor.match != PatternMatcher::NO_MATCH) {
+            ThreadMetrics* metrics = metricsOf(slot);
+            ScopedTimer timer(metrics ? &metrics->logNs : nullptr);
+            report(slot, filePath, "pattern@" + std::to_string(cursor.matchOffset),
+                   progress.patterns->Verdict(cursor.match));
+        }
+    };
+
+    // Rules are checked as the walk goes: a pruned directory is never
+    // opened, a file left out is not queued (nor stat'ed, for name rules)
+    const ScanFilter* filter = options.filter && !options.filter->Empty() ? options.filter.get() : nullptr;
+    const int64_t scanStartNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    // Stat for sizes only if the base at the start has a size index; a
+    // reloaded base without one passes every size through MayMatchSize.
+    // Any file may be an archive with matching members or hold a pattern,
+    // so none is gated when members or patterns are scanned.
+    const bool sizeGating = options.sizeGating && options.archiveDepth == 0 && !patterns &&
+                            bases[traversalSlot].Get().HasSizeIndex();
+    // Dedupe alone needs no stat: files not stat'ed anyway are identified once open
+    const bool needIdentity = cache || (filter && filter->NeedsStat());
+
+    // First path of every directory inode, and directories found again as (alias, first path)
+    std::mutex directoriesMutex;
+    std::unordered_map<std::pair<uint64_t, uint64_t>, std::string, FileKeyHash> directories;
+    std::vector<std::pair<std::string, std::string>> directoryAliases;
+    auto firstVisit = [&](const std::string& path, const FileIdentity& identity) {
+        std::lock_guard<std::mutex> lock(directoriesMutex);
+        auto inserted = directories.emplace(std::make_pair(identity.device, identity.inode), path);
+        if (!inserted.second) {
+            directoryAliases.emplace_back(path, inserted.first->second);
+        }
+        return inserted.second;
+    };
+
+    // Hardlink dedupe of a file with an identity: false if another path to
+    // its inode is hashed, that digest is then checked for this path as well
+    auto claimInode = [&](size_t slot, FileJob& job) {
+        if (!dedupe || job.identity.links <= 1) {
+            return true;
+        }
+        FileDigests digest;
+        auto claim = inodes.Claim(job.identity.device, job.identity.inode, job.path, digest);
+        if (claim == InodeTable::ClaimResult::Primary) {
+            job.inodePrimary = true;
+            return true;
+        }
+        counters.dedupedFiles++;
+        counters.dedupedBytes += job.size;
+        if (claim == InodeTable::ClaimResult::Hashed) {
+            checkDigest(slot, job.path, digest);
+        } else if (claim == InodeTable::ClaimResult::Failed) {
+            counters.errors++;
+        }
+        return false;
+    };
 
-            for (size_t j = start; j < end; ++j) {
-                const auto& filePath = filePaths[j];
-                
+    // Everything a regular file goes through before it is read: size gate,
+    // hardlink dedupe and the cache. True if the job still has to be hashed.
+    auto admitFile = [&](size_t slot, FileJob& job) {
+        counters.filesFound++;
+        // Sizes not known yet are counted once the file is open or read
+        ThreadMetrics* metrics = metricsOf(slot);
+        if (metrics && job.sizeKnown) {
+            metrics->AddFileSize(job.size);
+        }
+        if (job.sizeKnown && sizeGating && !bases[slot].Get().MayMatchSize(job.size)) {
+            // No signature has this size, the file cannot match
+            counters.skippedFiles++;
+            counters.skippedBytes += job.size;
+            return false;
+        }
+
+        if (!job.hasIdentity) {
+            job.identifyOnOpen = dedupe;
+        } else if (!claimInode(slot, job)) {
+            return false;
+        }
+
+        FileDigests cached;
+        uint32_t cacheFlags = 0;
+        if (cache && !patterns && job.hasIdentity && cache->Lookup(job.identity, digestTypes(slot), cached, &cacheFlags) &&
+            !(options.archiveDepth > 0 && (cacheFlags & ScanCache::ARCHIVE))) {
+            counters.cacheHits++;
+            if (job.inodePrimary) {
+                for (const auto& link : inodes.Complete(job.identity.device, job.identity.inode, &cached)) {
+                    checkDigest(slot, link, cached);
+                }
+            }
+            checkDigest(slot, job.path, cached);
+            return false;
+        }
+        return true;
+    };
+
+    // Traversal feeds the workers through bounded per-worker deques, so hashing
+    // starts with the first file found and memory depends on queue depth only.
+    // Idle workers steal from the busiest one, large files are hashed in
+    // chunks that can move between workers.
+    WorkStealingQueue<FileJob> jobs(threadCount, options.queueDepth);
+
+    // Caps and the adaptive worker count; workers beyond Active() park
+    std::unique_ptr<ScanThrottle> throttle;
+    if (ScanThrottle::Enabled(options.throttle)) {
+        throttle = std::make_unique<ScanThrottle>(options.throttle, threadCount,
+                                                  [&jobs] { return jobs.Queued() == 0; });
+    }
+
+#ifdef __linux__
+    const bool parallelTraversal = options.parallelTraversal && !nextFile;
+    std::unique_ptr<ParallelWalker> walker;
+    if (parallelTraversal) {
+        walker = std::make_unique<ParallelWalker>(jobs, counters, filter, checkpoint.get(), scanStartNs,
+                                                  needIdentity || sizeGating,
+                                                  dedupe ? DirectoryVisitFn(firstVisit) : nullptr, admitFile);
+    }
+#else
+    const bool parallelTraversal = false;
+#endif
+
+    // This run's counters on top of those carried over from a checkpoint
+    auto countsSoFar = [&] {
+        ScanResult counts = checkpoint ? checkpoint->Restored() : ScanResult();
+        counters.AddTo(counts);
+        return counts;
+    };
+    std::unique_ptr<CheckpointSaver> saver;
+    if (checkpoint) {
+        saver = std::make_unique<CheckpointSaver>(*checkpoint, options.checkpointPath,
+                                                  options.checkpointIntervalMs, countsSoFar);
+    }
+
+    auto workers = pool->Submit(threadCount, [&](size_t i) {
+        // Each worker keeps several files in flight, one per MD5 lane.
+        // On a shared pool every slot but the first gives its thread up while
+        // another scan waits for one; its queued work is stolen meanwhile.
+        bool yielded = false;
+        BackgroundPriority priority(options.throttle.lowPriority);
+        ScanThrottle::Worker pacing = throttle ? throttle->StartWorker() : ScanThrottle::Worker();
+        HashFileStreams(
+            [&](FileJob& job, bool wait) {
+                if (yielded || (i != 0 && pool->ShouldYield())) {
+                    yielded = true;
+                    return false;
+                }
+                // An inactive slot finishes its lanes, then parks (slot 0 never does)
+                while (throttle && i >= throttle->Active()) {
+                    if (!wait) {
+                        return false;
+                    }
+                    if (throttle->Park(i, std::chrono::milliseconds(50))) {
+                        break;
+                    }
+                    if (throttle->Finished()) {
+                        break; // drains the own deque below, if anything is left
+                    }
+                    if (pool->ShouldYield()) {
+                        yielded = true;
+                        return false;
+                    }
+                }
+                while (jobs.Pop(i, job, wait)) {
+                    if (!job.isDirectory) {
+                        return true;
+                    }
+#ifdef __linux__
+                    walker->Expand(i, job, metricsOf(i));
+#endif
+                }
+                if (wait && throttle) {
+                    throttle->Finish(); // closed and drained
+                }
+                return false;
+            },
+            [&](const FileJob& job, const FileDigests* digest) {
                 try {
-                    std::string hash = CalculateMD5(filePath);
-                    if (hash.empty()) {
-                        errors++;
-                        continue;
+                    const ArchiveReader* archive = job.progress ? job.progress->archive.get() : nullptr;
+                    if (archive) {
+                        counters.archiveMembers += archive->Members();
+                        counters.skippedMembers += archive->SkippedMembers();
+                        counters.damagedArchives += archive->DamagedArchives();
                     }
-
-                    auto it = malwareHashes_.find(hash);
-                    if (it != malwareHashes_.end()) {
-                        maliciousFound++;
-                        
-                        std::lock_guard<std::mutex> lock(logMutex);
-                        logFile << "File: " << filePath << "\n";
-                        logFile << "Hash: " << hash << "\n";
-                        logFile << "Verdict: " << it->second << "\n";
-                        logFile << "----------------------------------------\n";
+                    std::vector<std::string> links;
+                    if (job.inodePrimary) {
+                        links = inodes.Complete(job.identity.device, job.identity.inode, digest);
+                    }
+                    if (!digest) {
+                        counters.errors += 1 + links.size();
+                    } else {
+                        ThreadMetrics* metrics = metricsOf(i);
+                        if (metrics && !job.sizeKnown) {
+                            metrics->AddFileSize(job.progress->bytesRead);
+                        }
+                        if (cache && job.hasIdentity) {
+                            bool isArchive = archive && archive->GetFormat() != ArchiveReader::Format::Unknown;
+                            cache->Store(job.identity, *digest, isArchive ? ScanCache::ARCHIVE : 0);
+                        }
+                        if (!checkDigest(i, job.path, *digest)) {
+                            checkPatterns(i, job.path, *job.progress);
+                        }
+                        for (const auto& link : links) {
+                            checkDigest(i, link, *digest);
+                        }
                     }
                 } catch (const std::exception& e) {
-                    errors++;
+                    counters.errors++;
+                }
+                if (checkpoint) {
+                    checkpoint->FileDone(job.checkpointDir, job.path.c_str() + job.nameOffset, true, i);
+                }
+                jobs.Done();
+            },
+            [&](FileJob job) {
+                uint64_t done = job.progress->bytesRead;
+                uint64_t left = job.size > done ? job.size - done : 0;
+                jobs.Requeue(i, std::move(job), left);
+            },
+            [&](const FileJob& job) {
+                auto progress = std::make_unique<FileProgress>(digestTypes(i));
+                progress->patterns = patterns.get();
+                if (options.archiveDepth > 0) {
+                    size_t slash = job.path.find_last_of("/\\");
+                    progress->archive = std::make_unique<ArchiveReader>(
+                        progress->hasher.Types(), options.archiveDepth,
+                        slash == std::string::npos ? job.path : job.path.substr(slash + 1));
                 }
+                return progress;
+            },
+            [&](FileJob& job, const FileIdentity* identity) {
+                job.identifyOnOpen = false;
+                if (!identity) {
+                    return true;
+                }
+                job.identity = *identity;
+                job.hasIdentity = true;
+                if (!job.sizeKnown) {
+                    job.size = identity->size;
+                    job.sizeKnown = true;
+                    if (ThreadMetrics* metrics = metricsOf(i)) {
+                        metrics->AddFileSize(job.size);
+                    }
+                }
+                if (claimInode(i, job)) {
+                    return true;
+                }
+                if (checkpoint) {
+                    checkpoint->FileDone(job.checkpointDir, job.path.c_str() + job.nameOffset, true, i);
+                }
+                jobs.Done();
+                return false;
+            },
+            [&](const FileJob& job, const std::string& name, const FileDigests& digests) {
+                try {
+                    checkDigest(i, job.path + "!" + name, digests);
+                } catch (const std::exception& e) {
+                    counters.errors++;
+                }
+            },
+            [&](uint64_t bytes, size_t files) {
+                if (throttle) {
+                    throttle->Pace(pacing, bytes, files);
+                }
+            },
+            options.chunkSize, options.smallFileBatch, options.readBackend, metricsOf(i));
+        return !yielded;
+    });
 
-                filesProcessed++;
-            }
-        });
+    if (parallelTraversal) {
+#ifdef __linux__
+        walker->Start(directoryPath);
+#endif
+    } else {
+        SerialWalker serial(jobs, counters, filter, scanStartNs, needIdentity,
+                            dedupe ? DirectoryVisitFn(firstVisit) : nullptr, admitFile,
+                            traversalSlot, metricsOf(traversalSlot));
+        if (nextFile) {
+            serial.WalkFiles(*nextFile);
+        } else {
+            serial.Walk(directoryPath);
+        }
     }
 
-    // Wait for all threads to complete
-    for (auto& thread : threads) {
-        if (thread.joinable()) {
-            thread.join();
+    pool->Wait(workers);
+    saver.reset();
+
+    // Every detection under a directory's first path also exists under its
+    // aliases. Detections added here are visited too, so nested aliases are
+    // covered; paths inside the alias itself are skipped (self bind mount).
+    auto& found = detections[traversalSlot];
+    for (size_t slot = 0; slot < threadCount; ++slot) {
+        found.insert(found.end(), detections[slot].begin(), detections[slot].end());
+    }
+    for (const auto& alias : directoryAliases) {
+        std::string prefix = WithTrailingSeparator(alias.second);
+        std::string aliasPrefix = WithTrailingSeparator(alias.first);
+        for (size_t i = 0; i < found.size(); ++i) {
+            std::string path = found[i].first;
+            if (path.compare(0, prefix.size(), prefix) != 0 ||
+                path.compare(0, aliasPrefix.size(), aliasPrefix) == 0) {
+                continue;
+            }
+            checkDigest(traversalSlot, aliasPrefix + path.substr(prefix.size()), FileDigests(found[i].second));
         }
     }
 
-    result.maliciousFiles = maliciousFound;
-    result.errorCount = errors;
+    if (logFile.IsOpen() && !logFile.Close()) {
+        std::cerr << "Error: Could not write log file: " << logFilePath << std::endl;
+        counters.errors++;
+    }
+
+    if (ownCache && !ownCache->Save(options.cachePath, options.compactCache)) {
+        std::cerr << "Warning: Could not save scan cache: " << options.cachePath << std::endl;
+    }
+
+    // The scan is complete, nothing is left to resume
+    if (checkpoint) {
+        std::remove(options.checkpointPath.c_str());
+    }
+
+    result = countsSoFar();
+    result.dedupedDirectories = directoryAliases.size();
+    result.activeWorkers = throttle ? throttle->Active() : threadCount;
+    result.throttledTime = throttle ? throttle->ThrottledSeconds() : 0.0;
+    for (const auto& metrics : threadMetrics) {
+        metrics.MergeInto(result.metrics);
+    }
 
     auto endTime = std::chrono::high_resolution_clock::now();
     result.executionTime = std::chrono::duration<double>(endTime - startTime).count();
 
     return result;
-}
\ No newline at end of file
+}
@@ -1,15 +1,160 @@
 #pragma once
 #include "scanner_export.hpp"
+#include "digest.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
+#include <memory>
+#include <mutex>
 #include <functional>
 
+class HashBase;
+class VersionedBase;
+class PatternMatcher;
+class WorkerPool;
+class ScanCache;
+class ScanFilter;
+
+// How file contents are read for hashing
+enum class ReadBackend {
+    Stream, // std::ifstream, portable
+    Mmap,   // read-only mapping with sequential read-ahead (POSIX); a file
+            // truncated while it is being hashed raises SIGBUS
+    Direct  // O_DIRECT with double-buffered io_uring reads (Linux)
+};
+
+// When buffered detections reach the log file. The file is always synced
+// to disk before ScanDirectory returns.
+struct LogFlushPolicy {
+    unsigned intervalMs = 100;      // longest time an entry stays buffered, 0 - write at once
+    size_t bufferSize = 256 << 10;  // per thread; the writer is woken when one is half full
+    bool syncEachBatch = false;     // fsync after every write, not only at the end
+};
+
+// Keeps a scan within an impact budget on a host that has other work to do
+struct ThrottleOptions {
+    // Tune the number of active workers (up to threadCount) at runtime: more
+    // while throughput grows, fewer while it holds
+    bool adaptive = false;
+    uint64_t maxBytesPerSecond = 0; // read rate cap, 0 - none
+    double maxCpuShare = 0.0;       // share of all hardware threads the workers may use, 0 - no cap
+    // Workers at nice 19 with idle I/O priority (Linux), on threads made for
+    // the scan even where ScanOptions::pool is set
+    bool lowPriority = false;
+};
+
+struct ScanOptions {
+    size_t threadCount = 0;    // 0 - use all hardware threads
+    size_t queueDepth = 4096;  // paths buffered between traversal and hash workers (serial traversal)
+    uint64_t chunkSize = 64ull << 20; // large files yield to other work after each chunk, 0 - never
+    ReadBackend readBackend = ReadBackend::Stream;
+    // Files of up to 16 KB are read this many at a time into reused buffers
+    // (one io_uring submission per batch on Linux) whatever the backend;
+    // 0 - every file goes through readBackend
+    size_t smallFileBatch = 32;
+    bool sizeGating = true;    // skip files whose size no signature has (sized bases only)
+    std::string cachePath;     // persistent digest cache, empty - disabled
+    bool compactCache = false; // drop cache entries of files not seen in this scan
+    bool dedupeInodes = true;  // hash hardlinked files and bind-mounted directories once
+    LogFlushPolicy logFlush;
+    bool parallelTraversal = true; // directories are expanded by the hash workers (Linux)
+    bool collectMetrics = false;   // fill ScanResult::metrics
+    // Digests computed for every file in the same read pass, 0 - the types the
+    // base has signatures for
+    DigestSet digestTypes = 0;
+    // Archive levels whose members are hashed and looked up as well, read in
+    // the same pass as the archive (tar, gzip, zip; a .tar.gz takes two).
+    // Members are reported as "archive!member"; size gating is off since any
+    // file may hold a member of a signature's size. 0 - archives are only
+    // hashed as a whole.
+    unsigned archiveDepth = 0;
+    ThrottleOptions throttle;
+    // Include/exclude rules (see ScanFilter); excluded directories are not
+    // walked at all. nullptr - every file is scanned.
+    std::shared_ptr<const ScanFilter> filter;
+    // Progress (finished subtrees and files, counters, detections) is saved
+    // to this file every checkpointIntervalMs so that a scan that dies can be
+    // resumed, and removed once the scan is done; empty - none. Needs the
+    // parallel traversal; hardlinks are then hashed once per path.
+    std::string checkpointPath;
+    unsigned checkpointIntervalMs = 5000;
+    bool resume = false; // go on from checkpointPath if it holds a scan of the same directory
+
+    // Resident state of a long-running caller such as the daemon. Workers run
+    // on `pool` instead of threads of their own (threadCount 0 - all pool
+    // threads); `cache` replaces cachePath and is saved by its owner.
+    WorkerPool* pool = nullptr;
+    ScanCache* cache = nullptr;
+    // Called from worker threads for every detection, besides the log file
+    std::function<void(const std::string& filePath, const std::string& hash,
+                       std::string_view verdict)> onDetection;
+};
+
+// Continuous scanning of a directory tree (see MalwareScanner::Watch)
+struct WatchOptions {
+    unsigned settleMs = 500;  // quiet time after the last write before a file is hashed
+    bool initialScan = false; // also scan the files present when watching starts
+};
+
+// Blocked Bloom filter in front of the exact signature lookup. Nearly all
+// lookups miss, and a miss then costs one cache line instead of a probe of
+// the signature table. Built while a CSV base is loaded and kept in the
+// compiled form; a compiled base always uses the filter it was saved with.
+struct BaseFilterOptions {
+    unsigned bitsPerKey = 16;        // 0 - no filter; 16 gives about 0.1% false positives
+    size_t minSignatures = 1 << 20;  // smaller bases fit in cache and get none
+};
+
+// Outcome of the last LoadMalwareBase call
+struct BaseLoadReport {
+    size_t signatures = 0;      // distinct digests in the loaded base
+    size_t filterBytes = 0;     // size of the Bloom filter, 0 - none
+    size_t lines = 0;           // lines read from a CSV base
+    size_t malformedLines = 0;  // lines skipped because they could not be parsed
+    std::vector<std::string> malformedSamples; // "line N: reason" for the first few
+    double loadTime = 0.0;
+};
+
+// Where the time of a scan went. Times are summed over all threads.
+struct ScanMetrics {
+    static constexpr size_t SIZE_BUCKETS = 41;    // [0] empty files, [k] sizes below 2^k bytes
+    static constexpr size_t LATENCY_BUCKETS = 32; // [k] files hashed in under 2^k microseconds
+
+    bool collected = false;
+    uint64_t bytesRead = 0;
+    size_t filesHashed = 0;
+    double traversalTime = 0.0; // listing directories and deciding what to read
+    double readTime = 0.0;
+    double hashTime = 0.0;
+    double lookupTime = 0.0;    // base lookups of computed digests
+    double logTime = 0.0;       // handing detections to the log
+    std::array<uint64_t, SIZE_BUCKETS> sizeBuckets{};       // every file found
+    std::array<uint64_t, LATENCY_BUCKETS> latencyBuckets{}; // open to digest, hashed files only
+};
+
 struct ScanResult {
     size_t totalFiles = 0;
     size_t maliciousFiles = 0;
     size_t errorCount = 0;
     double executionTime = 0.0;
+    size_t skippedBySize = 0;        // files not read because no signature has their size
+    uint64_t bytesSkippedBySize = 0;
+    size_t cacheHits = 0;            // files whose digest came from the scan cache
+    size_t dedupedFiles = 0;         // extra hardlinks of an inode that was hashed once
+    uint64_t dedupedBytes = 0;
+    size_t dedupedDirectories = 0;   // directories already reached by another path, not walked
+    size_t archiveMembers = 0;       // members hashed inside archives, nested ones included
+    size_t skippedMembers = 0;       // encrypted or compressed with an unsupported method
+    size_t damagedArchives = 0;      // cut off or corrupt; members before the damage are scanned
+    size_t filteredFiles = 0;        // left out by ScanOptions::filter
+    size_t filteredDirectories = 0;  // pruned by ScanOptions::filter, nothing below them counted
+    size_t activeWorkers = 0;        // workers hashing at the end (as tuned with ThrottleOptions::adaptive)
+    double throttledTime = 0.0;      // seconds workers slept to stay within the caps, summed
+    ScanMetrics metrics;             // with ScanOptions::collectMetrics only
 };
 
 class SCANNER_API MalwareScanner {
@@ -17,14 +162,67 @@ public:
     MalwareScanner();
     ~MalwareScanner();
 
-    bool LoadMalwareBase(const std::string& csvFilePath);
+    // Accepts a CSV base or a compiled one (see SaveCompiledBase).
+    // CSV bases are parsed on `threadCount` threads (0 - all hardware threads).
+    // May be called while scans run: they move to the new base at their next
+    // file without pausing. If loading fails the current base stays in use.
+    bool LoadMalwareBase(const std::string& csvFilePath, size_t threadCount = 0);
+    bool LoadMalwareBase(const std::string& csvFilePath, size_t threadCount,
+                         const BaseFilterOptions& filter);
+    // Reports of the last load, copied: a reload may rewrite them at any time
+    BaseLoadReport GetLoadReport() const;
+    // Byte-pattern signatures ("hexbytes;verdict" lines), matched against the
+    // content of every file in the same read pass that hashes it; a file
+    // whose digests are not in the base is reported as "pattern@<offset>".
+    // A scan keeps the patterns loaded when it started. Files are then always
+    // read: size gating, cache hits and hardlink dedupe are left out.
+    bool LoadPatternBase(const std::string& filePath);
+    BaseLoadReport GetPatternReport() const;
+    // Writes the loaded base in the compiled binary form, which later loads
+    // are able to memory-map instead of parsing
+    bool SaveCompiledBase(const std::string& filePath) const;
     ScanResult ScanDirectory(const std::string& directoryPath, 
                            const std::string& logFilePath,
                            size_t threadCount = 0);
+    ScanResult ScanDirectory(const std::string& directoryPath,
+                           const std::string& logFilePath,
+                           const ScanOptions& options);
+    // Scans the listed regular files only. With either method an empty log
+    // path means no log file (results through ScanOptions::onDetection).
+    ScanResult ScanFiles(const std::vector<std::string>& filePaths,
+                         const std::string& logFilePath,
+                         const ScanOptions& options);
+    // Watches the tree under `directoryPath` (inotify, Linux only) and scans
+    // files as they are written or moved in, without walking the tree again,
+    // until `stop` is set. Detections reach the log as they are found.
+    ScanResult Watch(const std::string& directoryPath,
+                     const std::string& logFilePath,
+                     const ScanOptions& options,
+                     const WatchOptions& watchOptions,
+                     const std::atomic<bool>& stop);
 
 private:
-    std::unordered_map<std::string, std::string> malwareHashes_;
+    // Next path to scan; false once there are no more
+    using FileSource = std::function<bool(std::string& path)>;
+
+    // Walks `directoryPath`, or scans the files from `nextFile` if given
+    ScanResult RunScan(const std::string& directoryPath,
+                       const FileSource* nextFile,
+                       const std::string& logFilePath,
+                       const ScanOptions& options);
+    bool HasSignatures() const;
+
+    std::unique_ptr<VersionedBase> base_;
+    mutable std::mutex loadMutex_; // one reload at a time, guards the reports
+    BaseLoadReport loadReport_;
+    std::shared_ptr<const PatternMatcher> patterns_; // std::atomic_load / atomic_store
+    BaseLoadReport patternReport_;
 };
 
 // Экспортируем функцию CalculateMD5 для тестирования
-SCANNER_API std::string CalculateMD5(const std::string& filePath);
\ No newline at end of file
+SCANNER_API std::string CalculateMD5(const std::string& filePath);
+// Every digest in `types` from one read of the file; false on read errors
+SCANNER_API bool CalculateDigests(const std::string& filePath, DigestSet types, FileDigests& digests);
+
+// Result and, if collected, metrics as a JSON object
+SCANNER_API std::string ScanResultToJson(const ScanResult& result);
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 
+#ifdef _WIN32
 #ifdef SCANNER_EXPORTS
 #define SCANNER_API __declspec(dllexport)
 #else
 #define SCANNER_API __declspec(dllimport)
-#endif
\ No newline at end of file
+#endif
+#else
+#define SCANNER_API __attribute__((visibility("default")))
+#endif
@@ -0,0 +1,405 @@
+#include "sha.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHA_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define SHA_X86 0
+#endif
+
+#if SHA_X86 && (defined(__GNUC__) || defined(__clang__))
+#define SHA_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+#else
+#define SHA_TARGET
+#endif
+
+namespace {
+
+const uint32_t SHA1_INIT[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+const uint32_t SHA256_INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+alignas(16) const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t Rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+inline uint32_t Rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t LoadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+inline void StoreBE32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+void CompressSHA1Scalar(uint32_t* state, const uint8_t* blocks, size_t count) {
+    uint32_t w[80];
+    for (; count > 0; --count, blocks += 64) {
+        for (int t = 0; t < 16; ++t) {
+            w[t] = LoadBE32(blocks + 4 * t);
+        }
+        for (int t = 16; t < 80; ++t) {
+            w[t] = Rotl(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int t = 0; t < 80; ++t) {
+            uint32_t f, k;
+            if (t < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (t < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (t < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = Rotl(a, 5) + f + e + k + w[t];
+            e = d;
+            d = c;
+            c = Rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+void CompressSHA256Scalar(uint32_t* state, const uint8_t* blocks, size_t count) {
+    uint32_t w[64];
+    for (; count > 0; --count, blocks += 64) {
+        for (int t = 0; t < 16; ++t) {
+            w[t] = LoadBE32(blocks + 4 * t);
+        }
+        for (int t = 16; t < 64; ++t) {
+            uint32_t s0 = Rotr(w[t - 15], 7) ^ Rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = Rotr(w[t - 2], 17) ^ Rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; ++t) {
+            uint32_t s1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t temp1 = h + s1 + ch + SHA256_K[t] + w[t];
+            uint32_t s0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if SHA_X86
+
+// Four SHA-1 rounds; G is the group index 0..19. The message schedule for
+// later groups is advanced alongside, four words at a time.
+template<int G>
+SHA_TARGET inline void SHA1Group(__m128i& abcd, __m128i& e0, __m128i& e1, __m128i* msg) {
+    __m128i& current = msg[G % 4];
+    if constexpr (G == 0) {
+        e0 = _mm_add_epi32(e0, current);
+        e1 = abcd;
+    } else if constexpr (G % 2 == 0) {
+        e0 = _mm_sha1nexte_epu32(e0, current);
+        e1 = abcd;
+    } else {
+        e1 = _mm_sha1nexte_epu32(e1, current);
+        e0 = abcd;
+    }
+    if constexpr (G >= 3 && G <= 18) {
+        msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], current);
+    }
+    abcd = _mm_sha1rnds4_epu32(abcd, G % 2 == 0 ? e0 : e1, G / 5);
+    if constexpr (G >= 1 && G <= 16) {
+        msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], current);
+    }
+    if constexpr (G >= 2 && G <= 17) {
+        msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], current);
+    }
+}
+
+template<int... G>
+SHA_TARGET inline void SHA1Groups(__m128i& abcd, __m128i& e0, __m128i& e1, __m128i* msg,
+                                  std::integer_sequence<int, G...>) {
+    (SHA1Group<G>(abcd, e0, e1, msg), ...);
+}
+
+SHA_TARGET void CompressSHA1Ni(uint32_t* state, const uint8_t* blocks, size_t count) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; count > 0; --count, blocks += 64) {
+        __m128i abcdSave = abcd;
+        __m128i e0Save = e0;
+        __m128i e1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byteSwap);
+        }
+        SHA1Groups(abcd, e0, e1, msg, std::make_integer_sequence<int, 20>());
+        e0 = _mm_sha1nexte_epu32(e0, e0Save);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+// Four SHA-256 rounds; G is the group index 0..15
+template<int G>
+SHA_TARGET inline void SHA256Group(__m128i& state0, __m128i& state1, __m128i* msg) {
+    __m128i& current = msg[G % 4];
+    __m128i words = _mm_add_epi32(current, _mm_load_si128(reinterpret_cast<const __m128i*>(SHA256_K + 4 * G)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+    if constexpr (G >= 3 && G <= 14) {
+        __m128i& next = msg[(G + 1) % 4];
+        next = _mm_add_epi32(next, _mm_alignr_epi8(current, msg[(G + 3) % 4], 4));
+        next = _mm_sha256msg2_epu32(next, current);
+    }
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(words, 0x0E));
+    if constexpr (G >= 1 && G <= 12) {
+        msg[(G + 3) % 4] = _mm_sha256msg1_epu32(msg[(G + 3) % 4], current);
+    }
+}
+
+template<int... G>
+SHA_TARGET inline void SHA256Groups(__m128i& state0, __m128i& state1, __m128i* msg,
+                                    std::integer_sequence<int, G...>) {
+    (SHA256Group<G>(state0, state1, msg), ...);
+}
+
+SHA_TARGET void CompressSHA256Ni(uint32_t* state, const uint8_t* blocks, size_t count) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions keep the state as ABEF / CDGH
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i state1 = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (; count > 0; --count, blocks += 64) {
+        __m128i state0Save = state0;
+        __m128i state1Save = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byteSwap);
+        }
+        SHA256Groups(state0, state1, msg, std::make_integer_sequence<int, 16>());
+        state0 = _mm_add_epi32(state0, state0Save);
+        state1 = _mm_add_epi32(state1, state1Save);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+bool QueryCpu() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    bool sse41 = (regs[2] & (1 << 19)) != 0;
+    bool ssse3 = (regs[2] & (1 << 9)) != 0;
+    __cpuidex(regs, 7, 0);
+    return sse41 && ssse3 && (regs[1] & (1 << 29)) != 0;
+#else
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+#endif
+}
+
+bool CpuSupportsSha() {
+    static const bool supported = QueryCpu();
+    return supported;
+}
+
+#else
+
+bool CpuSupportsSha() {
+    return false;
+}
+
+#endif // SHA_X86
+
+bool UseShaNi(SHAEngine engine) {
+    return engine != SHAEngine::Scalar && CpuSupportsSha();
+}
+
+// Buffering shared by both contexts: whole blocks go straight to `compress`
+template<class CompressFn>
+void Absorb(uint8_t* buffer, size_t& buffered, uint64_t& length, const uint8_t* data, size_t size,
+            CompressFn&& compress) {
+    length += size;
+    if (buffered > 0) {
+        size_t take = std::min(size, 64 - buffered);
+        std::memcpy(buffer + buffered, data, take);
+        buffered += take;
+        data += take;
+        size -= take;
+        if (buffered < 64) {
+            return;
+        }
+        compress(buffer, 1);
+        buffered = 0;
+    }
+    if (size >= 64) {
+        compress(data, size / 64);
+        data += size / 64 * 64;
+        size %= 64;
+    }
+    std::memcpy(buffer, data, size);
+    buffered = size;
+}
+
+// Appends the 0x80 marker and the big-endian bit length
+template<class CompressFn>
+void Pad(uint8_t* buffer, size_t buffered, uint64_t length, CompressFn&& compress) {
+    buffer[buffered++] = 0x80;
+    if (buffered > 56) {
+        std::memset(buffer + buffered, 0, 64 - buffered);
+        compress(buffer, 1);
+        buffered = 0;
+    }
+    std::memset(buffer + buffered, 0, 56 - buffered);
+    uint64_t bits = length * 8;
+    StoreBE32(buffer + 56, static_cast<uint32_t>(bits >> 32));
+    StoreBE32(buffer + 60, static_cast<uint32_t>(bits));
+    compress(buffer, 1);
+}
+
+} // namespace
+
+SHAEngine DetectSHAEngine() {
+    return CpuSupportsSha() ? SHAEngine::SHANI : SHAEngine::Scalar;
+}
+
+const char* SHAEngineName(SHAEngine engine) {
+    return UseShaNi(engine) ? "sha-ni" : "scalar";
+}
+
+SHA1::SHA1(SHAEngine engine) : accelerated_(UseShaNi(engine)) {
+    Reset();
+}
+
+void SHA1::Reset() {
+    std::memcpy(state_, SHA1_INIT, sizeof(state_));
+    length_ = 0;
+    buffered_ = 0;
+}
+
+void SHA1::Compress(const uint8_t* blocks, size_t count) {
+#if SHA_X86
+    if (accelerated_) {
+        CompressSHA1Ni(state_, blocks, count);
+        return;
+    }
+#endif
+    CompressSHA1Scalar(state_, blocks, count);
+}
+
+void SHA1::Update(const void* data, size_t size) {
+    Absorb(buffer_, buffered_, length_, static_cast<const uint8_t*>(data), size,
+           [this](const uint8_t* blocks, size_t count) { Compress(blocks, count); });
+}
+
+SHA1Digest SHA1::Final() {
+    Pad(buffer_, buffered_, length_, [this](const uint8_t* blocks, size_t count) { Compress(blocks, count); });
+    SHA1Digest digest;
+    for (int i = 0; i < 5; ++i) {
+        StoreBE32(digest.data() + 4 * i, state_[i]);
+    }
+    Reset();
+    return digest;
+}
+
+SHA256::SHA256(SHAEngine engine) : accelerated_(UseShaNi(engine)) {
+    Reset();
+}
+
+void SHA256::Reset() {
+    std::memcpy(state_, SHA256_INIT, sizeof(state_));
+    length_ = 0;
+    buffered_ = 0;
+}
+
+void SHA256::Compress(const uint8_t* blocks, size_t count) {
+#if SHA_X86
+    if (accelerated_) {
+        CompressSHA256Ni(state_, blocks, count);
+        return;
+    }
+#endif
+    CompressSHA256Scalar(state_, blocks, count);
+}
+
+void SHA256::Update(const void* data, size_t size) {
+    Absorb(buffer_, buffered_, length_, static_cast<const uint8_t*>(data), size,
+           [this](const uint8_t* blocks, size_t count) { Compress(blocks, count); });
+}
+
+SHA256Digest SHA256::Final() {
+    Pad(buffer_, buffered_, length_, [this](const uint8_t* blocks, size_t count) { Compress(blocks, count); });
+    SHA256Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        StoreBE32(digest.data() + 4 * i, state_[i]);
+    }
+    Reset();
+    return digest;
+}
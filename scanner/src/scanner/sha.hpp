@@ -0,0 +1,56 @@
+#pragma once
+#include "scanner_export.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+using SHA1Digest = std::array<uint8_t, 20>;
+using SHA256Digest = std::array<uint8_t, 32>;
+
+// Implementation used for the SHA block compression functions
+enum class SHAEngine {
+    Auto,   // SHA extensions if the CPU has them
+    Scalar,
+    SHANI   // x86 SHA extensions (sha1rnds4 / sha256rnds2)
+};
+
+SCANNER_API SHAEngine DetectSHAEngine();
+SCANNER_API const char* SHAEngineName(SHAEngine engine);
+
+// Incremental SHA-1 context (FIPS 180-4)
+class SCANNER_API SHA1 {
+public:
+    explicit SHA1(SHAEngine engine = SHAEngine::Auto);
+
+    void Reset();
+    void Update(const void* data, size_t size);
+    SHA1Digest Final();
+
+private:
+    void Compress(const uint8_t* blocks, size_t count);
+
+    bool accelerated_;
+    uint32_t state_[5];
+    uint64_t length_;
+    uint8_t buffer_[64];
+    size_t buffered_;
+};
+
+// Incremental SHA-256 context (FIPS 180-4)
+class SCANNER_API SHA256 {
+public:
+    explicit SHA256(SHAEngine engine = SHAEngine::Auto);
+
+    void Reset();
+    void Update(const void* data, size_t size);
+    SHA256Digest Final();
+
+private:
+    void Compress(const uint8_t* blocks, size_t count);
+
+    bool accelerated_;
+    uint32_t state_[8];
+    uint64_t length_;
+    uint8_t buffer_[64];
+    size_t buffered_;
+};
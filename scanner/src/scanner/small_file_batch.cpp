@@ -0,0 +1,231 @@
+#include "small_file_batch.hpp"
+#include "io_uring.hpp"
+#include "scan_cache.hpp"
+#include <fstream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+// Submission entries per file: openat, statx, read, close
+enum Op : unsigned { OP_OPEN, OP_STATX, OP_READ, OP_CLOSE, OP_COUNT };
+#endif
+
+} // namespace
+
+struct SmallFileBatch::Slot {
+    std::string path;
+    Status status = Status::Failed;
+    size_t size = 0;
+    FileIdentity identity;
+    bool hasIdentity = false;
+#ifdef __linux__
+    struct statx stat;
+    int results[OP_COUNT];
+#endif
+};
+
+SmallFileBatch::SmallFileBatch(size_t capacity)
+    : capacity_(capacity), buffer_(capacity * FILE_LIMIT), slots_(capacity) {
+#ifdef __linux__
+    ring_ = std::make_unique<IoUring>();
+    if (!ring_->Init(static_cast<unsigned>(capacity * OP_COUNT)) ||
+        !ring_->RegisterFileSlots(static_cast<unsigned>(capacity))) {
+        ring_.reset();
+    }
+#endif
+}
+
+SmallFileBatch::~SmallFileBatch() = default;
+
+bool SmallFileBatch::UsesRing() const {
+#ifdef __linux__
+    return ring_ != nullptr;
+#else
+    return false;
+#endif
+}
+
+void SmallFileBatch::Add(const std::string& path) {
+    Slot& slot = slots_[count_++];
+    slot.path = path; // keeps the string's capacity from earlier batches
+    slot.status = Status::Failed;
+    slot.size = 0;
+    slot.hasIdentity = false;
+}
+
+void SmallFileBatch::Read() {
+#ifdef __linux__
+    if (ring_ && ReadRing()) {
+        return;
+    }
+    // Kernel without direct descriptors; nothing of this batch was kept
+    ring_.reset();
+#endif
+    for (size_t i = 0; i < count_; ++i) {
+        ReadSync(i);
+    }
+}
+
+SmallFileBatch::Status SmallFileBatch::Result(size_t i, const uint8_t*& data, size_t& size) const {
+    data = buffer_.data() + i * FILE_LIMIT;
+    size = slots_[i].size;
+    return slots_[i].status;
+}
+
+bool SmallFileBatch::Identify(size_t i, FileIdentity& identity) const {
+    const Slot& slot = slots_[i];
+    if (slot.status != Status::Read || !slot.hasIdentity) {
+        return false;
+    }
+    identity = slot.identity;
+    return true;
+}
+
+void SmallFileBatch::Clear() {
+    count_ = 0;
+}
+
+#ifdef __linux__
+
+bool SmallFileBatch::ReadRing() {
+    // The whole chain runs even if a step fails (hard links), so every
+    // entry completes and the fixed-file slot is always closed again
+    for (size_t i = 0; i < count_; ++i) {
+        Slot& slot = slots_[i];
+        io_uring_sqe* sqes[OP_COUNT];
+        for (unsigned op = 0; op < OP_COUNT; ++op) {
+            sqes[op] = ring_->GetSqe();
+            if (!sqes[op]) {
+                return false;
+            }
+            sqes[op]->user_data = i * OP_COUNT + op;
+            sqes[op]->flags = op + 1 < OP_COUNT ? IOSQE_IO_HARDLINK : 0;
+            slot.results[op] = -ECANCELED;
+        }
+        const unsigned fixed = static_cast<unsigned>(i);
+
+        sqes[OP_OPEN]->opcode = IORING_OP_OPENAT;
+        sqes[OP_OPEN]->fd = AT_FDCWD;
+        sqes[OP_OPEN]->addr = reinterpret_cast<uint64_t>(slot.path.c_str());
+        sqes[OP_OPEN]->open_flags = O_RDONLY; // O_CLOEXEC does not apply to direct descriptors
+        sqes[OP_OPEN]->file_index = fixed + 1;
+
+        sqes[OP_STATX]->opcode = IORING_OP_STATX;
+        sqes[OP_STATX]->fd = AT_FDCWD;
+        sqes[OP_STATX]->addr = reinterpret_cast<uint64_t>(slot.path.c_str());
+        sqes[OP_STATX]->len = STATX_SIZE | STATX_INO | STATX_NLINK | STATX_MTIME | STATX_CTIME;
+        sqes[OP_STATX]->addr2 = reinterpret_cast<uint64_t>(&slot.stat);
+
+        sqes[OP_READ]->opcode = IORING_OP_READ;
+        sqes[OP_READ]->flags |= IOSQE_FIXED_FILE;
+        sqes[OP_READ]->fd = static_cast<int>(fixed);
+        sqes[OP_READ]->addr = reinterpret_cast<uint64_t>(Buffer(i));
+        sqes[OP_READ]->len = FILE_LIMIT;
+
+        sqes[OP_CLOSE]->opcode = IORING_OP_CLOSE;
+        sqes[OP_CLOSE]->file_index = fixed + 1;
+    }
+
+    const size_t expected = count_ * OP_COUNT;
+    if (ring_->Submit(static_cast<unsigned>(expected)) < 0) {
+        return false;
+    }
+    for (size_t seen = 0; seen < expected; ++seen) {
+        io_uring_cqe* cqe;
+        if (!ring_->PeekCqe(cqe) && !ring_->WaitCqe(cqe)) {
+            return false;
+        }
+        slots_[cqe->user_data / OP_COUNT].results[cqe->user_data % OP_COUNT] = cqe->res;
+        ring_->SeenCqe();
+    }
+
+    for (size_t i = 0; i < count_; ++i) {
+        Slot& slot = slots_[i];
+        if (slot.results[OP_OPEN] == -EINVAL) {
+            return false;
+        }
+        if (slot.results[OP_OPEN] < 0 || slot.results[OP_STATX] < 0 || slot.results[OP_READ] < 0) {
+            slot.status = Status::Failed;
+            continue;
+        }
+        slot.size = static_cast<size_t>(slot.results[OP_READ]);
+        const struct statx& stat = slot.stat;
+        slot.identity.device = static_cast<uint64_t>(makedev(stat.stx_dev_major, stat.stx_dev_minor));
+        slot.identity.inode = stat.stx_ino;
+        slot.identity.size = stat.stx_size;
+        slot.identity.mtimeNs = int64_t(stat.stx_mtime.tv_sec) * 1000000000 + stat.stx_mtime.tv_nsec;
+        slot.identity.ctimeNs = int64_t(stat.stx_ctime.tv_sec) * 1000000000 + stat.stx_ctime.tv_nsec;
+        slot.identity.links = stat.stx_nlink;
+        slot.hasIdentity = true;
+        bool whole = slot.stat.stx_size <= FILE_LIMIT && slot.size == slot.stat.stx_size;
+        slot.status = whole ? Status::Read : Status::TooLarge;
+    }
+    return true;
+}
+
+#endif // __linux__
+
+void SmallFileBatch::ReadSync(size_t i) {
+    Slot& slot = slots_[i];
+    uint8_t* buffer = Buffer(i);
+    slot.status = Status::Failed;
+    slot.size = 0;
+#ifndef _WIN32
+    int fd = open(slot.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+    FileIdentityFromStat(st, slot.identity);
+    slot.hasIdentity = true;
+    if (static_cast<uint64_t>(st.st_size) > FILE_LIMIT) {
+        slot.status = Status::TooLarge;
+        close(fd);
+        return;
+    }
+    size_t total = 0;
+    while (total < FILE_LIMIT) {
+        ssize_t n = read(fd, buffer + total, FILE_LIMIT - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            close(fd);
+            return;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    close(fd);
+    slot.size = total;
+    slot.status = total == static_cast<size_t>(st.st_size) ? Status::Read : Status::TooLarge;
+#else
+    std::ifstream file(slot.path, std::ios::binary);
+    if (!file) {
+        return;
+    }
+    file.read(reinterpret_cast<char*>(buffer), FILE_LIMIT);
+    if (file.bad()) {
+        return;
+    }
+    slot.size = static_cast<size_t>(file.gcount());
+    slot.status = file.peek() == std::ifstream::traits_type::eof() ? Status::Read : Status::TooLarge;
+#endif
+}
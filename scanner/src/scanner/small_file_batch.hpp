@@ -0,0 +1,65 @@
+#pragma once
+#include "scanner_export.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct FileIdentity;
+
+#ifdef __linux__
+class IoUring;
+#endif
+
+// Reads whole small files several at a time into buffers that are reused
+// from one batch to the next, so a file costs no allocation and, on Linux,
+// no syscall of its own: every file is one linked io_uring chain (openat
+// into a fixed-file slot, statx, read, close) and the whole batch is a
+// single io_uring_enter. Without io_uring or direct descriptors the same
+// steps run as plain syscalls. Not thread safe: each worker owns one.
+class SCANNER_API SmallFileBatch {
+public:
+    static constexpr size_t FILE_LIMIT = 16 << 10; // largest file read this way
+
+    enum class Status {
+        Read,     // the whole file is in the buffer
+        TooLarge, // larger than FILE_LIMIT or changed while read; nothing was kept
+        Failed    // could not be opened or read
+    };
+
+    explicit SmallFileBatch(size_t capacity);
+    ~SmallFileBatch();
+
+    SmallFileBatch(const SmallFileBatch&) = delete;
+    SmallFileBatch& operator=(const SmallFileBatch&) = delete;
+
+    size_t Size() const { return count_; }
+    bool Full() const { return count_ == capacity_; }
+    bool UsesRing() const;
+
+    // Queues a file for the next Read
+    void Add(const std::string& path);
+    // Reads every queued file
+    void Read();
+    // Outcome of the i-th queued file; the bytes stay valid until Clear
+    Status Result(size_t i, const uint8_t*& data, size_t& size) const;
+    // Identity of a file that was Read, from the stat taken along with it
+    bool Identify(size_t i, FileIdentity& identity) const;
+    void Clear();
+
+private:
+    struct Slot;
+
+    void ReadSync(size_t i);
+    uint8_t* Buffer(size_t i) { return buffer_.data() + i * FILE_LIMIT; }
+
+    size_t capacity_;
+    size_t count_ = 0;
+    std::vector<uint8_t> buffer_;
+    std::vector<Slot> slots_;
+#ifdef __linux__
+    bool ReadRing();
+    std::unique_ptr<IoUring> ring_; // nullptr - plain syscalls
+#endif
+};
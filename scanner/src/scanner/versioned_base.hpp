@@ -0,0 +1,51 @@
+#pragma once
+#include "hash_base.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// The loaded signature base as a sequence of immutable snapshots. A reload
+// builds the next snapshot off to the side and publishes it with one
+// pointer swap; every scan thread holds its own reference to the snapshot
+// it is using and swaps it at a file boundary once the version moved, so
+// lookups never wait. A snapshot is freed when its last reader lets go.
+class VersionedBase {
+public:
+    void Publish(std::shared_ptr<const HashBase> base) {
+        std::atomic_store_explicit(&current_, std::move(base), std::memory_order_release);
+        version_.fetch_add(1, std::memory_order_release);
+    }
+
+    std::shared_ptr<const HashBase> Load() const {
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    uint64_t Version() const { return version_.load(std::memory_order_acquire); }
+
+    // One thread's view. The version check is a single atomic load; the
+    // shared pointer itself is only reloaded after a publish.
+    class Reader {
+    public:
+        explicit Reader(const VersionedBase& source)
+            : source_(&source), version_(source.Version()), base_(source.Load()) {}
+
+        const HashBase& Get() {
+            uint64_t version = source_->Version();
+            if (version != version_) {
+                // Version first: a publish in between is picked up next time
+                version_ = version;
+                base_ = source_->Load();
+            }
+            return *base_;
+        }
+
+    private:
+        const VersionedBase* source_;
+        uint64_t version_;
+        std::shared_ptr<const HashBase> base_;
+    };
+
+private:
+    std::shared_ptr<const HashBase> current_;
+    std::atomic<uint64_t> version_{0};
+};
@@ -0,0 +1,241 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Per-worker deques with size-aware placement and stealing.
+// Every item carries a weight (bytes left to hash). New items go to the
+// least loaded worker, an idle worker steals from the most loaded one.
+// Owners take from the front, thieves from the back, so a requeued
+// continuation of a large file is the first thing another worker picks up.
+// Deferred items (directories to expand) are handed out only when no
+// regular item is left anywhere, so expanding the tree never runs far
+// ahead of hashing: the owner takes its newest one (depth first), a thief
+// the oldest one, which usually holds the largest subtree.
+// A popped item stays outstanding until it is requeued or reported Done,
+// so no worker is told the queue ran dry while another may still put a
+// continuation back.
+template<class T>
+class WorkStealingQueue {
+public:
+    WorkStealingQueue(size_t workers, size_t capacity)
+        : capacity_(capacity ? capacity : 1) {
+        for (size_t i = 0; i < (workers ? workers : 1); ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+    }
+
+    size_t WorkerCount() const {
+        return workers_.size();
+    }
+
+    // Adds a new item, blocking while `capacity` items are queued.
+    // Returns false if the queue was closed.
+    bool Push(T item, uint64_t weight) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex_);
+            spaceAvailable_.wait(lock, [this] { return closed_ || queued_ < capacity_; });
+            if (closed_) {
+                return false;
+            }
+        }
+
+        size_t target = 0;
+        uint64_t lowest = UINT64_MAX;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            std::lock_guard<std::mutex> lock(workers_[i]->mutex);
+            if (workers_[i]->pending < lowest) {
+                lowest = workers_[i]->pending;
+                target = i;
+            }
+        }
+        Insert(target, std::move(item), weight);
+        return true;
+    }
+
+    // Adds a new item found by `worker` itself to its own deque; never blocks
+    void PushOwn(size_t worker, T item, uint64_t weight) {
+        Insert(worker, std::move(item), weight);
+    }
+
+    // Puts a popped, partially processed item back on `worker`'s deque; never blocks
+    void Requeue(size_t worker, T item, uint64_t weight) {
+        Insert(worker, std::move(item), weight);
+        Done();
+    }
+
+    // A popped item was processed completely
+    void Done() {
+        bool drained;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex_);
+            drained = --outstanding_ == 0 && closed_ && queued_ == 0;
+        }
+        if (drained) {
+            workAvailable_.notify_all();
+        }
+    }
+
+    // Adds a low priority item for `worker`; never blocks
+    void Defer(size_t worker, T item) {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex_);
+            queued_++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers_[worker]->mutex);
+            workers_[worker]->deferred.push_back(std::move(item));
+        }
+        workAvailable_.notify_one();
+    }
+
+    // Takes the next item for `worker`, stealing if its own deque is empty.
+    // With `wait` set blocks until an item arrives; returns false once the
+    // queue is closed, empty and no popped item can come back (or
+    // immediately when nothing is available and `wait` is not set).
+    bool Pop(size_t worker, T& item, bool wait) {
+        for (;;) {
+            if (TakeOwn(worker, item) || Steal(worker, item) ||
+                TakeOwnDeferred(worker, item) || StealDeferred(worker, item)) {
+                {
+                    std::lock_guard<std::mutex> lock(stateMutex_);
+                    queued_--;
+                    outstanding_++;
+                }
+                spaceAvailable_.notify_one();
+                return true;
+            }
+            if (!wait) {
+                return false;
+            }
+
+            std::unique_lock<std::mutex> lock(stateMutex_);
+            workAvailable_.wait(lock, [this] { return (closed_ && outstanding_ == 0) || queued_ > 0; });
+            if (queued_ == 0) {
+                return false;
+            }
+        }
+    }
+
+    // Items waiting, deferred ones included
+    size_t Queued() {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        return queued_;
+    }
+
+    // No more new items; workers drain what is left and then stop
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex_);
+            closed_ = true;
+        }
+        workAvailable_.notify_all();
+        spaceAvailable_.notify_all();
+    }
+
+private:
+    struct Entry {
+        T item;
+        uint64_t weight;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Entry> items;
+        std::deque<T> deferred;
+        uint64_t pending = 0;
+    };
+
+    void Insert(size_t worker, T item, uint64_t weight) {
+        // Count first so the counter never drops below the number of items
+        {
+            std::lock_guard<std::mutex> lock(stateMutex_);
+            queued_++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers_[worker]->mutex);
+            workers_[worker]->items.push_back(Entry{std::move(item), weight});
+            workers_[worker]->pending += weight;
+        }
+        workAvailable_.notify_one();
+    }
+
+    bool TakeOwn(size_t worker, T& item) {
+        Worker& self = *workers_[worker];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (self.items.empty()) {
+            return false;
+        }
+        item = std::move(self.items.front().item);
+        self.pending -= self.items.front().weight;
+        self.items.pop_front();
+        return true;
+    }
+
+    bool Steal(size_t worker, T& item) {
+        // Pick the victim with the most bytes waiting
+        size_t victim = worker;
+        uint64_t highest = 0;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (i == worker) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(workers_[i]->mutex);
+            if (!workers_[i]->items.empty() && workers_[i]->pending >= highest) {
+                highest = workers_[i]->pending;
+                victim = i;
+            }
+        }
+        if (victim == worker) {
+            return false;
+        }
+
+        Worker& other = *workers_[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (other.items.empty()) {
+            return false;
+        }
+        item = std::move(other.items.back().item);
+        other.pending -= other.items.back().weight;
+        other.items.pop_back();
+        return true;
+    }
+
+    bool TakeOwnDeferred(size_t worker, T& item) {
+        Worker& self = *workers_[worker];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (self.deferred.empty()) {
+            return false;
+        }
+        item = std::move(self.deferred.back());
+        self.deferred.pop_back();
+        return true;
+    }
+
+    bool StealDeferred(size_t worker, T& item) {
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            Worker& other = *workers_[(worker + i) % workers_.size()];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.deferred.empty()) {
+                item = std::move(other.deferred.front());
+                other.deferred.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    const size_t capacity_;
+
+    std::mutex stateMutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable spaceAvailable_;
+    size_t queued_ = 0;
+    size_t outstanding_ = 0; // popped, neither requeued nor done
+    bool closed_ = false;
+};
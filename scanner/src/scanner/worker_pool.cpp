@@ -0,0 +1,90 @@
+#include "worker_pool.hpp"
+
+WorkerPool::WorkerPool(size_t threads) {
+    for (size_t i = 0; i < (threads ? threads : 1); ++i) {
+        threads_.emplace_back([this] { ThreadLoop(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    workAvailable_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+std::shared_ptr<WorkerPool::Job> WorkerPool::Submit(size_t slots, std::function<bool(size_t)> body) {
+    auto job = std::make_shared<Job>();
+    job->body = std::move(body);
+    for (size_t slot = slots ? slots : 1; slot-- > 0;) {
+        job->freeSlots.push_back(slot);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(job);
+        starved_++;
+    }
+    workAvailable_.notify_all();
+    return job;
+}
+
+void WorkerPool::Wait(const std::shared_ptr<Job>& job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobComplete_.wait(lock, [&] { return job->complete; });
+}
+
+std::shared_ptr<WorkerPool::Job> WorkerPool::NextJob() {
+    for (size_t i = 0; i < jobs_.size(); ++i) {
+        std::shared_ptr<Job> job = jobs_.front();
+        jobs_.pop_front();
+        jobs_.push_back(job);
+        if (!job->finished && !job->freeSlots.empty()) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void WorkerPool::ThreadLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        std::shared_ptr<Job> job;
+        workAvailable_.wait(lock, [&] { return stopping_ || (job = NextJob()) != nullptr; });
+        if (!job) {
+            return;
+        }
+
+        size_t slot = job->freeSlots.back();
+        job->freeSlots.pop_back();
+        if (job->running++ == 0) {
+            starved_--;
+        }
+
+        lock.unlock();
+        bool done = job->body(slot);
+        lock.lock();
+
+        job->running--;
+        if (done) {
+            job->finished = true;
+        } else {
+            job->freeSlots.push_back(slot);
+        }
+        if (job->finished && job->running == 0) {
+            job->complete = true;
+            for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+                if (*it == job) {
+                    jobs_.erase(it);
+                    break;
+                }
+            }
+            jobComplete_.notify_all();
+        } else if (job->running == 0) {
+            starved_++;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads shared by concurrent scans. A scan submits a body that the pool
+// runs once per worker slot. While some scan has not got a single thread,
+// bodies of other scans are asked to yield (all but slot 0, so every scan
+// keeps making progress); a yielded slot is restarted later. Free threads
+// take scans round-robin, so a large scan cannot hold back small ones.
+class WorkerPool {
+public:
+    struct Job;
+
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t ThreadCount() const { return threads_.size(); }
+
+    // body(slot) returns true once the scan has no work left for any slot,
+    // false if it yielded and has to run again. A slot never runs twice at once.
+    std::shared_ptr<Job> Submit(size_t slots, std::function<bool(size_t)> body);
+    // Blocks until every started body of `job` has returned and no more will start
+    void Wait(const std::shared_ptr<Job>& job);
+
+    // True while another scan is waiting for its first thread
+    bool ShouldYield() const { return starved_.load(std::memory_order_relaxed) > 0; }
+
+    struct Job {
+        std::function<bool(size_t)> body;
+        std::vector<size_t> freeSlots; // slot 0 last, so it starts first
+        size_t running = 0;
+        bool finished = false; // a body reported the work done
+        bool complete = false; // finished and no body running
+    };
+
+private:
+    void ThreadLoop();
+    std::shared_ptr<Job> NextJob();
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable jobComplete_;
+    std::deque<std::shared_ptr<Job>> jobs_; // round-robin order
+    std::atomic<size_t> starved_{0};
+    bool stopping_ = false;
+};
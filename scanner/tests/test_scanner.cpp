@@ -1,9 +1,38 @@
 #include <gtest/gtest.h>
 #include "scanner/scanner.hpp"
+#include "scanner/md5.hpp"
+#include "scanner/hash_base.hpp"
+#include "scanner/scan_server.hpp"
+#include "scanner/scan_coordinator.hpp"
+#include "scanner/archive_reader.hpp"
+#include "scanner/pattern_matcher.hpp"
+#include "scanner/small_file_batch.hpp"
+#include "scanner/scan_throttle.hpp"
+#include "scanner/scan_checkpoint.hpp"
+#include "scanner/scan_cache.hpp"
+#include "scanner/scan_filter.hpp"
+#include "scanner/work_stealing_queue.hpp"
+#include "scanner/worker_pool.hpp"
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 #include <iostream>
 #include <sstream>
+#include <random>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -99,4 +128,1484 @@ TEST_F(MalwareScannerTest, ScanInvalidDirectory) {
     ScanResult result = scanner.ScanDirectory("nonexistent_dir_12345", "test_log2.log");
     
     EXPECT_GT(result.errorCount, 0);
-}
\ No newline at end of file
+}
+
+TEST_F(MalwareScannerTest, StreamingScanWithShallowQueue) {
+    for (int i = 0; i < 50; ++i) {
+        std::ofstream file("test_dir/subdir/extra" + std::to_string(i) + ".txt", std::ios::binary);
+        file << "extra " << i;
+    }
+    std::ofstream copy("test_dir/subdir/copy.txt", std::ios::binary);
+    copy.write("Hello World", 11);
+    copy.close();
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 3;
+    options.queueDepth = 1;
+    ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+
+    EXPECT_EQ(result.totalFiles, 54);
+    EXPECT_EQ(result.maliciousFiles, 2);
+    EXPECT_EQ(result.errorCount, 0);
+}
+
+TEST(WorkStealingQueueTest, DrainedOnlyWhenNothingCanComeBack) {
+    WorkStealingQueue<int> queue(2, 8);
+    ASSERT_TRUE(queue.Push(1, 100));
+    queue.Close();
+    int item = 0;
+    ASSERT_TRUE(queue.Pop(0, item, true));
+
+    // Worker 0 still holds the item and may requeue a continuation of it
+    std::atomic<bool> returned{false};
+    bool popped = false;
+    int stolen = 0;
+    std::thread other([&] {
+        popped = queue.Pop(1, stolen, true);
+        returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(returned);
+    queue.Requeue(0, 2, 50);
+    other.join();
+    EXPECT_TRUE(popped);
+    EXPECT_EQ(stolen, 2);
+
+    queue.Done();
+    EXPECT_FALSE(queue.Pop(0, item, true));
+}
+
+TEST_F(MalwareScannerTest, LargeFilesHashedInChunks) {
+    // Files several chunks long whose continuations get requeued and stolen
+    std::ofstream base("test_base.csv", std::ios::binary | std::ios::app);
+    base << "\n";
+    for (int i = 0; i < 4; ++i) {
+        std::string content(700000 + i * 1000, static_cast<char>('a' + i));
+        std::ofstream file("test_dir/big" + std::to_string(i) + ".bin", std::ios::binary);
+        file.write(content.data(), content.size());
+        if (i % 2 == 0) {
+            MD5 md5;
+            md5.Update(content.data(), content.size());
+            base << MD5::ToHex(md5.Final()) << ";BigMalware\n";
+        }
+    }
+    base.close();
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    for (ReadBackend backend : {ReadBackend::Stream, ReadBackend::Mmap, ReadBackend::Direct}) {
+        ScanOptions options;
+        options.threadCount = 3;
+        options.chunkSize = 65536;
+        options.readBackend = backend;
+        ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+
+        EXPECT_EQ(result.totalFiles, 7);
+        EXPECT_EQ(result.maliciousFiles, 3) << "backend " << static_cast<int>(backend);
+        EXPECT_EQ(result.errorCount, 0);
+    }
+}
+
+TEST_F(MalwareScannerTest, SmallFilesReadInBatches) {
+    const size_t limit = SmallFileBatch::FILE_LIMIT;
+    std::ofstream base("test_base.csv", std::ios::binary | std::ios::app);
+    base << "\n";
+    for (size_t size : {limit, limit + 1}) {
+        std::string content(size, static_cast<char>('a' + size % 7));
+        std::ofstream file("test_dir/edge" + std::to_string(size) + ".bin", std::ios::binary);
+        file.write(content.data(), content.size());
+        MD5 md5;
+        md5.Update(content.data(), content.size());
+        base << MD5::ToHex(md5.Final()) << ";EdgeMalware\n";
+    }
+    base.close();
+    std::ofstream("test_dir/empty.bin").close();
+
+    SmallFileBatch batch(4);
+    const std::string exact = "test_dir/edge" + std::to_string(limit) + ".bin";
+    for (const std::string& path : {exact, "test_dir/edge" + std::to_string(limit + 1) + ".bin",
+                                    std::string("test_dir/missing.bin"), std::string("test_dir/empty.bin")}) {
+        batch.Add(path);
+    }
+    EXPECT_TRUE(batch.Full());
+    batch.Read();
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    EXPECT_EQ(batch.Result(0, data, size), SmallFileBatch::Status::Read);
+    EXPECT_EQ(size, limit);
+    EXPECT_EQ(data[limit - 1], 'a' + limit % 7);
+    EXPECT_EQ(batch.Result(1, data, size), SmallFileBatch::Status::TooLarge);
+    EXPECT_EQ(batch.Result(2, data, size), SmallFileBatch::Status::Failed);
+    EXPECT_EQ(batch.Result(3, data, size), SmallFileBatch::Status::Read);
+    EXPECT_EQ(size, 0);
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    // Without size gating the parallel walk stats nothing, so the larger
+    // file is only found out by the batch
+    for (size_t batchSize : {size_t(0), size_t(2), size_t(32)}) {
+        for (bool parallel : {false, true}) {
+            ScanOptions options;
+            options.threadCount = 2;
+            options.smallFileBatch = batchSize;
+            options.parallelTraversal = parallel;
+            options.sizeGating = false;
+            ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+
+            EXPECT_EQ(result.totalFiles, 6) << "batch " << batchSize;
+            EXPECT_EQ(result.maliciousFiles, 3) << "batch " << batchSize;
+            EXPECT_EQ(result.errorCount, 0);
+        }
+    }
+}
+
+TEST(ScanThrottleTest, AdaptiveCountSettlesWhereThroughputPeaks) {
+    ThrottleOptions options;
+    options.adaptive = true;
+    // Count the controller spends most of its late steps at
+    auto settle = [&](double (*throughputAt)(double)) {
+        ScanThrottle throttle(options, 8);
+        std::map<size_t, int> visits;
+        size_t active = throttle.Active();
+        for (int step = 0; step < 200; ++step) {
+            active = throttle.Adjust(throughputAt(static_cast<double>(active)));
+            EXPECT_GE(active, 1u);
+            EXPECT_LE(active, 8u);
+            if (step >= 100) {
+                visits[active]++;
+            }
+        }
+        return std::max_element(visits.begin(), visits.end(),
+                                [](const auto& a, const auto& b) { return a.second < b.second; })->first;
+    };
+    EXPECT_EQ(settle([](double n) { return 100.0 - 10.0 * (n - 3) * (n - 3); }), 3u);
+    EXPECT_EQ(settle([](double n) { return 100.0 * n; }), 8u);
+    // More workers that do not help are not kept
+    EXPECT_EQ(settle([](double) { return 100.0; }), 1u);
+}
+
+TEST_F(MalwareScannerTest, ThrottledScanStaysWithinReadRate) {
+    std::string content(1 << 20, 'r');
+    std::ofstream("test_dir/large.bin", std::ios::binary).write(content.data(), content.size());
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    ScanOptions options;
+    options.threadCount = 4;
+    options.throttle.adaptive = true;
+    options.throttle.maxBytesPerSecond = 4 << 20;
+    options.throttle.lowPriority = true;
+    ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+
+    EXPECT_EQ(result.totalFiles, 4);
+    EXPECT_EQ(result.maliciousFiles, 1);
+    EXPECT_EQ(result.errorCount, 0);
+    EXPECT_GE(result.activeWorkers, 1u);
+    EXPECT_LE(result.activeWorkers, 4u);
+    // 1 MB at 4 MB/s with a 0.4 MB burst
+    EXPECT_GT(result.throttledTime, 0.0);
+    EXPECT_GE(result.executionTime, 0.1);
+}
+
+#ifdef __linux__
+TEST_F(MalwareScannerTest, LowPriorityScanLeavesPoolThreadsAlone) {
+    // Pool threads outlive the scan and may not get their priority back
+    WorkerPool pool(2);
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    ScanOptions options;
+    options.pool = &pool;
+    options.throttle.lowPriority = true;
+    ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(result.totalFiles, 3);
+    EXPECT_EQ(result.maliciousFiles, 1);
+
+    // On Linux PRIO_PROCESS 0 is the calling thread
+    const int nice = getpriority(PRIO_PROCESS, 0);
+    std::atomic<int> reniced{0};
+    pool.Wait(pool.Submit(2, [&](size_t) {
+        if (getpriority(PRIO_PROCESS, 0) != nice) reniced++;
+        return true;
+    }));
+    EXPECT_EQ(reniced.load(), 0);
+}
+#endif
+
+TEST_F(MalwareScannerTest, ResumeSkipsWorkDoneBeforeCheckpoint) {
+    // A scan that died after finishing subdir/ and file1.txt
+    ScanCheckpoint progress("test_dir");
+    ScanCheckpoint::NodePtr root = progress.Root();
+    ScanCheckpoint::NodePtr subdir = progress.Enter(root, "test_dir/subdir", 9);
+    ASSERT_TRUE(root && subdir);
+    progress.Queued(subdir);
+    progress.FileDone(subdir, "file3.txt", true, 0);
+    progress.Listed(subdir);
+    progress.Found(0, {"test_dir/file1.txt", "saved-digest", "TestMalware"});
+    progress.Queued(root);
+    progress.FileDone(root, "file1.txt", true, 0);
+    ASSERT_TRUE(progress.Save("test_scan.ckpt", [] { return ScanResult(); }));
+
+    ScanCheckpoint other("elsewhere");
+    EXPECT_FALSE(other.Load("test_scan.ckpt"));
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    ScanOptions options;
+    options.threadCount = 2;
+    options.checkpointPath = "test_scan.ckpt";
+    options.resume = true;
+    ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+
+    // Only file2.txt was read again; the detection comes from the checkpoint
+    EXPECT_EQ(result.totalFiles, 3);
+    EXPECT_EQ(result.maliciousFiles, 1);
+    EXPECT_EQ(result.errorCount, 0);
+    std::ifstream log("test_log.log");
+    std::string content((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+    size_t entry = content.find("File: ");
+    EXPECT_NE(content.find("saved-digest"), std::string::npos);
+    EXPECT_EQ(content.find("File: ", entry + 1), std::string::npos);
+    EXPECT_FALSE(fs::exists("test_scan.ckpt"));
+}
+
+TEST_F(MalwareScannerTest, CompiledBaseRoundTrip) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    ASSERT_TRUE(scanner.SaveCompiledBase("test_base.db"));
+
+    MalwareScanner compiled;
+    ASSERT_TRUE(compiled.LoadMalwareBase("test_base.db"));
+    ScanResult result = compiled.ScanDirectory("test_dir", "test_log.log", 1);
+    EXPECT_EQ(result.totalFiles, 3);
+    EXPECT_EQ(result.maliciousFiles, 1);
+
+    // Same with a Bloom filter forced onto the tiny base
+    BaseFilterOptions filter;
+    filter.minSignatures = 0;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv", 1, filter));
+    EXPECT_EQ(scanner.GetLoadReport().filterBytes, HashBase::FILTER_BLOCK_SIZE);
+    ASSERT_TRUE(scanner.SaveCompiledBase("test_base.db"));
+    ASSERT_TRUE(compiled.LoadMalwareBase("test_base.db"));
+    EXPECT_EQ(compiled.GetLoadReport().filterBytes, HashBase::FILTER_BLOCK_SIZE);
+    EXPECT_EQ(compiled.ScanDirectory("test_dir", "test_log.log", 1).maliciousFiles, 1);
+
+    // A truncated image must be rejected rather than mapped
+    fs::resize_file("test_base.db", 100);
+    EXPECT_FALSE(compiled.LoadMalwareBase("test_base.db"));
+    fs::remove("test_base.db");
+}
+
+TEST(HashBaseTest, LookupAcrossBuckets) {
+    std::mt19937 rng(7);
+    std::vector<MD5Digest> digests(5000);
+    HashBaseBuilder builder;
+    for (size_t i = 0; i < digests.size(); ++i) {
+        for (auto& byte : digests[i]) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        builder.Add(digests[i], i % 3 == 0 ? "Trojan" : "Worm");
+    }
+    builder.Add(digests[1], "Override");
+    auto base = builder.Build();
+    ASSERT_TRUE(base);
+    EXPECT_EQ(base->Size(), digests.size());
+    EXPECT_EQ(base->VerdictCount(), 3);
+
+    std::string_view verdict;
+    for (size_t i = 0; i < digests.size(); ++i) {
+        ASSERT_TRUE(base->Find(digests[i], verdict));
+        EXPECT_EQ(verdict, i == 1 ? "Override" : (i % 3 == 0 ? "Trojan" : "Worm"));
+    }
+    MD5Digest missing = digests[0];
+    missing[15] ^= 1;
+    EXPECT_FALSE(base->Find(missing, verdict));
+
+    MD5Digest parsed;
+    EXPECT_TRUE(ParseMD5Hex("B10A8DB164E0754105B7A99BE72E3FE5", parsed));
+    EXPECT_FALSE(ParseMD5Hex("b10a8db164e0754105b7a99be72e3fe", parsed));
+    EXPECT_FALSE(ParseMD5Hex("x10a8db164e0754105b7a99be72e3fe5", parsed));
+}
+
+TEST(HashBaseTest, RejectsTablesOutOfOrder) {
+    std::mt19937 rng(5);
+    HashBaseBuilder builder;
+    for (size_t i = 0; i < 5000; ++i) {
+        MD5Digest digest;
+        for (auto& byte : digest) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        builder.Add(digest, i % 3 == 0 ? "Trojan" : "Worm");
+    }
+    ASSERT_TRUE(builder.Build()->Save("test_order_base.db"));
+    std::ifstream in("test_order_base.db", std::ios::binary);
+    const std::vector<char> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    ASSERT_TRUE(HashBase::Map("test_order_base.db"));
+
+    // Header fields of the version 4 layout; the MD5 table comes first
+    auto field = [&](size_t offset) {
+        uint64_t value = 0;
+        std::memcpy(&value, image.data() + offset, sizeof(value));
+        return value;
+    };
+    const uint64_t verdictOffsets = field(32);
+    const uint64_t bucketBits = field(112) & UINT32_MAX;
+    const uint64_t buckets = field(144);
+    auto rejectsWith = [&](uint64_t at, uint32_t value) {
+        std::vector<char> corrupt = image;
+        std::memcpy(corrupt.data() + at, &value, sizeof(value));
+        std::ofstream("test_order_base.db", std::ios::binary).write(corrupt.data(), corrupt.size());
+        return !HashBase::Map("test_order_base.db");
+    };
+    // A bucket that starts before the one in front of it
+    EXPECT_TRUE(rejectsWith(buckets + (uint64_t(1) << (bucketBits - 1)) * sizeof(uint32_t), 0));
+    // A verdict that would end past the strings
+    EXPECT_TRUE(rejectsWith(verdictOffsets + sizeof(uint32_t), UINT32_MAX));
+    fs::remove("test_order_base.db");
+}
+
+TEST_F(MalwareScannerTest, TypedSignaturesMatchInOnePass) {
+    std::ofstream base("test_typed_base.csv", std::ios::binary);
+    base << "sha256:a591a6d40bf420404a011733cfb7b190d62c65bf0bcda32b57b277d9ad9f146e;Sha256Malware\n";
+    base << "2A88CBD84213B7A1DFA99FCC01CD88BECFA4EA7F;Sha1Malware\n";
+    base << MD5::ToHex([] { MD5 md5; md5.Update("Another file", 12); return md5.Final(); }()) << ";Md5Malware\n";
+    base << "sha1:2d7b141433885598043efab600b0a582fc3921c3d2a0b67d8fcdae45dac3f27b;WrongType\n";
+    base.close();
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_typed_base.csv"));
+    EXPECT_EQ(scanner.GetLoadReport().signatures, 3);
+    EXPECT_EQ(scanner.GetLoadReport().malformedLines, 1);
+    ASSERT_TRUE(scanner.SaveCompiledBase("test_typed_base.db"));
+
+    MalwareScanner compiled;
+    ASSERT_TRUE(compiled.LoadMalwareBase("test_typed_base.db"));
+    for (MalwareScanner* instance : {&scanner, &compiled}) {
+        std::mutex mutex;
+        std::map<std::string, std::pair<std::string, std::string>> found;
+        ScanOptions options;
+        options.threadCount = 2;
+        options.collectMetrics = true;
+        options.onDetection = [&](const std::string& filePath, const std::string& hash, std::string_view verdict) {
+            std::lock_guard<std::mutex> lock(mutex);
+            found[fs::path(filePath).filename().string()] = {hash, std::string(verdict)};
+        };
+        ScanResult result = instance->ScanDirectory("test_dir", "", options);
+        EXPECT_EQ(result.maliciousFiles, 3);
+        // All three digests came from a single read of every file
+        EXPECT_EQ(result.metrics.bytesRead, 11 + 17 + 12);
+
+        ASSERT_EQ(found.size(), 3);
+        EXPECT_EQ(found["file1.txt"].first, "a591a6d40bf420404a011733cfb7b190d62c65bf0bcda32b57b277d9ad9f146e");
+        EXPECT_EQ(found["file1.txt"].second, "Sha256Malware");
+        EXPECT_EQ(found["file2.txt"].first, "2a88cbd84213b7a1dfa99fcc01cd88becfa4ea7f");
+        EXPECT_EQ(found["file2.txt"].second, "Sha1Malware");
+        EXPECT_EQ(found["file3.txt"].second, "Md5Malware");
+    }
+
+    FileDigests digests;
+    ASSERT_TRUE(CalculateDigests("test_dir/file1.txt", ALL_DIGESTS, digests));
+    EXPECT_EQ(digests.ToHex(DigestType::MD5), "b10a8db164e0754105b7a99be72e3fe5");
+    EXPECT_EQ(digests.ToHex(DigestType::SHA1), "0a4d55a8d778e5022fab701977c5d840bbc486d0");
+
+    fs::remove("test_typed_base.csv");
+    fs::remove("test_typed_base.db");
+}
+
+TEST(HashBaseTest, BloomFilterRejectsMisses) {
+    std::mt19937_64 rng(11);
+    auto randomDigest = [&](uint8_t* digest, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            digest[i] = static_cast<uint8_t>(rng());
+        }
+    };
+    std::vector<MD5Digest> md5(20000);
+    std::vector<SHA256Digest> sha256(5000);
+    HashBaseBuilder builder;
+    builder.SetFilterBitsPerKey(16);
+    for (auto& digest : md5) {
+        randomDigest(digest.data(), digest.size());
+        builder.Add(digest, "Md5");
+    }
+    for (auto& digest : sha256) {
+        randomDigest(digest.data(), digest.size());
+        builder.Add(DigestType::SHA256, digest.data(), "Sha256");
+    }
+    auto built = builder.Build();
+    ASSERT_TRUE(built);
+    EXPECT_EQ(built->FilterBytes(), (25000 * 16 / 512 + 1) * 64);
+    ASSERT_TRUE(built->Save("test_filter_base.db"));
+    auto mapped = HashBase::Map("test_filter_base.db");
+    ASSERT_TRUE(mapped);
+    EXPECT_EQ(mapped->FilterBytes(), built->FilterBytes());
+
+    for (const HashBase* base : {built.get(), mapped.get()}) {
+        std::string_view verdict;
+        for (const auto& digest : md5) {
+            ASSERT_TRUE(base->Find(digest, verdict));
+        }
+        for (const auto& digest : sha256) {
+            ASSERT_TRUE(base->Find(DigestType::SHA256, digest.data(), verdict));
+        }
+        size_t passed = 0;
+        const size_t misses = 100000;
+        for (size_t i = 0; i < misses; ++i) {
+            MD5Digest digest;
+            randomDigest(digest.data(), digest.size());
+            passed += base->MayContain(DigestType::MD5, digest.data());
+            EXPECT_FALSE(base->Find(digest, verdict));
+        }
+        EXPECT_LT(passed, misses / 200); // under 0.5%
+    }
+    fs::remove("test_filter_base.db");
+
+    HashBaseBuilder plain;
+    plain.Add(md5[0], "Md5");
+    auto unfiltered = plain.Build();
+    EXPECT_EQ(unfiltered->FilterBytes(), 0);
+    EXPECT_TRUE(unfiltered->MayContain(DigestType::MD5, md5[1].data()));
+}
+
+TEST_F(MalwareScannerTest, SizeGatedSignatures) {
+    std::ofstream base("test_sized_base.csv", std::ios::binary);
+    base << "b10a8db164e0754105b7a99be72e3fe5;11;TestMalware\n";
+    base << "ac6204ffeb36d2320e52f1d551cfa370;4096;Dropper\n";
+    base.close();
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_sized_base.csv"));
+    ASSERT_TRUE(scanner.SaveCompiledBase("test_sized_base.db"));
+
+    MalwareScanner compiled;
+    ASSERT_TRUE(compiled.LoadMalwareBase("test_sized_base.db"));
+    for (MalwareScanner* current : {&scanner, &compiled}) {
+        ScanResult result = current->ScanDirectory("test_dir", "test_log.log", 1);
+        EXPECT_EQ(result.totalFiles, 3);
+        EXPECT_EQ(result.maliciousFiles, 1);
+        EXPECT_EQ(result.skippedBySize, 2);
+        EXPECT_EQ(result.bytesSkippedBySize, 29);
+    }
+
+    ScanOptions options;
+    options.sizeGating = false;
+    EXPECT_EQ(scanner.ScanDirectory("test_dir", "test_log.log", options).skippedBySize, 0);
+
+    // One signature without a size makes every size a possible match
+    base.open("test_sized_base.csv", std::ios::binary | std::ios::app);
+    base << "8ee70903f43b227eeb971262268af5a8;Downloader\n";
+    base.close();
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_sized_base.csv"));
+    ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", 1);
+    EXPECT_EQ(result.skippedBySize, 0);
+    EXPECT_EQ(result.maliciousFiles, 1);
+
+    fs::remove("test_sized_base.csv");
+    fs::remove("test_sized_base.db");
+}
+
+TEST_F(MalwareScannerTest, ScanCacheSkipsUnchangedFiles) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 2;
+    options.cachePath = "test_scan.cache";
+    ScanResult first = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(first.cacheHits, 0);
+    EXPECT_EQ(first.maliciousFiles, 1);
+
+    ScanResult second = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(second.cacheHits, 3);
+    EXPECT_EQ(second.maliciousFiles, 1);
+
+    // A rewritten file is hashed again
+    std::ofstream file2("test_dir/file2.txt", std::ios::binary);
+    file2.write("Hello World", 11);
+    file2.close();
+    ScanResult third = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(third.cacheHits, 2);
+    EXPECT_EQ(third.maliciousFiles, 2);
+
+    // A new base applies to cached digests without reading the files
+    std::ofstream base("test_base2.csv", std::ios::binary);
+    base << "b10a8db164e0754105b7a99be72e3fe5;TestMalware\n";
+    base << MD5::ToHex([] { MD5 md5; md5.Update("Another file", 12); return md5.Final(); }()) << ";Other\n";
+    base.close();
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base2.csv"));
+    ScanResult fourth = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(fourth.cacheHits, 3);
+    EXPECT_EQ(fourth.maliciousFiles, 3);
+
+    // Compaction keeps only what this scan saw
+    EXPECT_EQ(fs::file_size("test_scan.cache"), 24 + 3 * 120);
+    ScanOptions subdir = options;
+    subdir.compactCache = true;
+    scanner.ScanDirectory("test_dir/subdir", "test_log.log", subdir);
+    EXPECT_EQ(fs::file_size("test_scan.cache"), 24 + 1 * 120);
+
+    fs::remove("test_scan.cache");
+    fs::remove("test_base2.csv");
+}
+
+TEST_F(MalwareScannerTest, ScanCacheSavesOnlyWhatChanged) {
+    fs::remove("test_changed.cache");
+    ScanCache cache;
+    ASSERT_TRUE(cache.Open("test_changed.cache"));
+    EXPECT_FALSE(cache.Changed());
+
+    FileIdentity identity;
+    identity.device = 1;
+    identity.inode = 2;
+    identity.size = 11;
+    FileDigests digests;
+    ASSERT_TRUE(CalculateDigests("test_dir/file1.txt", DigestBit(DigestType::MD5), digests));
+    cache.Store(identity, digests);
+    EXPECT_TRUE(cache.Changed());
+    ASSERT_TRUE(cache.Save("test_changed.cache", false));
+    EXPECT_FALSE(cache.Changed());
+    EXPECT_FALSE(fs::exists("test_changed.cache.tmp"));
+
+    ScanCache reopened;
+    ASSERT_TRUE(reopened.Open("test_changed.cache"));
+    FileDigests found;
+    ASSERT_TRUE(reopened.Lookup(identity, DigestBit(DigestType::MD5), found));
+    EXPECT_EQ(found.ToHex(DigestType::MD5), "b10a8db164e0754105b7a99be72e3fe5");
+    fs::remove("test_changed.cache");
+}
+
+TEST_F(MalwareScannerTest, HardlinksHashedOnce) {
+    std::string large(20000, 'l');
+    std::ofstream("test_dir/large.bin", std::ios::binary).write(large.data(), large.size());
+    fs::create_hard_link("test_dir/file1.txt", "test_dir/subdir/link1.txt");
+    fs::create_hard_link("test_dir/file2.txt", "test_dir/subdir/link2.txt");
+    fs::create_hard_link("test_dir/large.bin", "test_dir/subdir/large_link.bin");
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 2;
+    // The parallel walk leaves hardlinks to be found once a file is open,
+    // through the small-file batch or through each read backend
+    for (bool parallel : {false, true}) {
+        for (size_t batchSize : {size_t(0), size_t(32)}) {
+            for (ReadBackend backend : {ReadBackend::Stream, ReadBackend::Mmap, ReadBackend::Direct}) {
+                options.parallelTraversal = parallel;
+                options.smallFileBatch = batchSize;
+                options.readBackend = backend;
+                ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+                EXPECT_EQ(result.totalFiles, 7);
+                EXPECT_EQ(result.maliciousFiles, 2);
+                EXPECT_EQ(result.errorCount, 0);
+                EXPECT_EQ(result.dedupedFiles, 3);
+                EXPECT_EQ(result.dedupedBytes, 11 + 17 + 20000);
+
+                // Every path of the malicious inode is reported
+                std::ifstream log("test_log.log");
+                std::string content((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+                EXPECT_NE(content.find("file1.txt"), std::string::npos);
+                EXPECT_NE(content.find("link1.txt"), std::string::npos);
+            }
+        }
+    }
+
+    options.dedupeInodes = false;
+    ScanResult plain = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(plain.maliciousFiles, 2);
+    EXPECT_EQ(plain.dedupedFiles, 0);
+}
+
+TEST_F(MalwareScannerTest, DetectionLogKeepsEveryEntry) {
+    // Many hits and small buffers, so entries also take the overflow path
+    const size_t copies = 400;
+    fs::create_directories("test_dir/many");
+    for (size_t i = 0; i < copies; ++i) {
+        std::ofstream file("test_dir/many/sample" + std::to_string(i) + ".bin", std::ios::binary);
+        file.write("Hello World", 11);
+    }
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 3;
+    options.logFlush.intervalMs = 1000;
+    options.logFlush.bufferSize = 4096;
+    ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_EQ(result.maliciousFiles, copies + 1);
+
+    std::ifstream log("test_log.log");
+    size_t entries = 0;
+    size_t separators = 0;
+    for (std::string line; std::getline(log, line);) {
+        entries += line.rfind("File: ", 0) == 0;
+        separators += line == "----------------------------------------";
+    }
+    EXPECT_EQ(entries, copies + 1);
+    EXPECT_EQ(separators, copies + 1);
+}
+
+TEST_F(MalwareScannerTest, ParallelTraversalMatchesSerial) {
+    // A few levels of directories, a symlink to a malicious file (scanned)
+    // and a symlink to a directory (not descended into)
+    for (int a = 0; a < 4; ++a) {
+        for (int b = 0; b < 3; ++b) {
+            std::string dir = "test_dir/tree/d" + std::to_string(a) + "/e" + std::to_string(b);
+            fs::create_directories(dir);
+            for (int c = 0; c < 5; ++c) {
+                std::ofstream file(dir + "/f" + std::to_string(c), std::ios::binary);
+                if (c == 0) {
+                    file.write("Hello World", 11);
+                } else {
+                    file << dir << c;
+                }
+            }
+        }
+    }
+    fs::create_symlink(fs::absolute("test_dir/file1.txt"), "test_dir/tree/link.txt");
+    fs::create_directory_symlink(fs::absolute("test_dir/tree/d0"), "test_dir/tree/loop");
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 3;
+    options.parallelTraversal = false;
+    ScanResult serial = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    options.parallelTraversal = true;
+    ScanResult parallel = scanner.ScanDirectory("test_dir", "test_log.log", options);
+
+    EXPECT_EQ(serial.totalFiles, 3 + 4 * 3 * 5 + 1);
+    EXPECT_EQ(serial.maliciousFiles, 1 + 4 * 3 + 1);
+    EXPECT_EQ(parallel.totalFiles, serial.totalFiles);
+    EXPECT_EQ(parallel.maliciousFiles, serial.maliciousFiles);
+    EXPECT_EQ(parallel.errorCount, 0);
+}
+
+TEST_F(MalwareScannerTest, MetricsCollectedOnRequest) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 2;
+    ScanResult plain = scanner.ScanDirectory("test_dir", "test_log.log", options);
+    EXPECT_FALSE(plain.metrics.collected);
+    EXPECT_EQ(plain.metrics.bytesRead, 0);
+
+    for (bool parallel : {false, true}) {
+        options.collectMetrics = true;
+        options.parallelTraversal = parallel;
+        ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+        const ScanMetrics& metrics = result.metrics;
+        ASSERT_TRUE(metrics.collected);
+        EXPECT_EQ(metrics.bytesRead, 11 + 17 + 12);
+        EXPECT_EQ(metrics.filesHashed, 3);
+
+        uint64_t sized = 0;
+        for (uint64_t count : metrics.sizeBuckets) {
+            sized += count;
+        }
+        EXPECT_EQ(sized, 3);
+        // 11 and 12 bytes are below 16, 17 below 32
+        EXPECT_EQ(metrics.sizeBuckets[4], 2);
+        EXPECT_EQ(metrics.sizeBuckets[5], 1);
+
+        uint64_t timed = 0;
+        for (uint64_t count : metrics.latencyBuckets) {
+            timed += count;
+        }
+        EXPECT_EQ(timed, 3);
+        EXPECT_GT(metrics.hashTime + metrics.readTime, 0.0);
+
+        std::string json = ScanResultToJson(result);
+        EXPECT_NE(json.find("\"bytesRead\": 40"), std::string::npos);
+        EXPECT_NE(json.find("\"scanLatencyUs\""), std::string::npos);
+    }
+}
+
+TEST_F(MalwareScannerTest, ScanFilesReportsThroughCallback) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    std::vector<std::string> found;
+    std::mutex foundMutex;
+    ScanOptions options;
+    options.threadCount = 2;
+    options.onDetection = [&](const std::string& path, const std::string& hash, std::string_view verdict) {
+        std::lock_guard<std::mutex> lock(foundMutex);
+        found.push_back(path + " " + hash + " " + std::string(verdict));
+    };
+    ScanResult result = scanner.ScanFiles({"test_dir/file1.txt", "test_dir/subdir/file3.txt", "test_dir/missing"},
+                                          "", options);
+    EXPECT_EQ(result.totalFiles, 2);
+    EXPECT_EQ(result.maliciousFiles, 1);
+    EXPECT_EQ(result.errorCount, 1);
+    ASSERT_EQ(found.size(), 1);
+    EXPECT_EQ(found[0], "test_dir/file1.txt b10a8db164e0754105b7a99be72e3fe5 TestMalware");
+}
+
+TEST_F(MalwareScannerTest, ReloadWhileScanning) {
+    std::ofstream("reload_a.csv") << "b10a8db164e0754105b7a99be72e3fe5;OldVerdict\n";
+    std::ofstream("reload_b.csv") << "b10a8db164e0754105b7a99be72e3fe5;NewVerdict\n"
+                                  << "dc7dfdf284828015f78cde17675fb67e;Second\n";
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("reload_a.csv"));
+
+    // Every scan sees whole snapshots only: one of the two bases per file
+    std::atomic<bool> done{false};
+    std::thread reloading([&] {
+        for (int i = 0; !done; ++i) {
+            EXPECT_TRUE(scanner.LoadMalwareBase(i % 2 ? "reload_a.csv" : "reload_b.csv", 1));
+        }
+    });
+    ScanOptions options;
+    options.threadCount = 2;
+    for (int i = 0; i < 50; ++i) {
+        ScanResult result = scanner.ScanDirectory("test_dir", "", options);
+        EXPECT_EQ(result.totalFiles, 3);
+        EXPECT_GE(result.maliciousFiles, 1);
+        EXPECT_LE(result.maliciousFiles, 2);
+        EXPECT_EQ(result.errorCount, 0);
+        // The report is one of a finished load, never one being written
+        BaseLoadReport report = scanner.GetLoadReport();
+        EXPECT_TRUE(report.signatures == 1 || report.signatures == 2) << report.signatures;
+    }
+    done = true;
+    reloading.join();
+
+    // A base that fails to load leaves the previous one in use
+    ASSERT_TRUE(scanner.LoadMalwareBase("reload_b.csv"));
+    EXPECT_FALSE(scanner.LoadMalwareBase("reload_missing.csv"));
+    std::vector<std::string> verdicts;
+    options.onDetection = [&](const std::string&, const std::string&, std::string_view verdict) {
+        verdicts.emplace_back(verdict);
+    };
+    options.threadCount = 1;
+    ScanResult result = scanner.ScanFiles({"test_dir/file1.txt"}, "", options);
+    EXPECT_EQ(result.maliciousFiles, 1);
+    EXPECT_EQ(verdicts, std::vector<std::string>{"NewVerdict"});
+
+    fs::remove("reload_a.csv");
+    fs::remove("reload_b.csv");
+}
+
+namespace {
+
+// Archive builders for the member scanning tests
+
+std::string TarFile(const std::string& name, const std::string& content, char type = '0') {
+    if (name.size() >= 100) {
+        // GNU long name entry in front
+        return TarFile("././@LongLink", name + '\0', 'L') + TarFile(name.substr(0, 99), content, type);
+    }
+    std::string header(512, '\0');
+    header.replace(0, name.size(), name);
+    header.replace(100, 7, "0000644");
+    char size[12];
+    std::snprintf(size, sizeof(size), "%011o", static_cast<unsigned>(content.size()));
+    header.replace(124, 11, size);
+    header.replace(136, 11, "00000000000");
+    header[156] = type;
+    header.replace(257, 6, std::string("ustar\0", 6));
+    header.replace(263, 2, "00");
+    header.replace(148, 8, "        ");
+    unsigned sum = 0;
+    for (char c : header) {
+        sum += static_cast<unsigned char>(c);
+    }
+    char checksum[8];
+    std::snprintf(checksum, sizeof(checksum), "%06o", sum);
+    header.replace(148, 7, std::string(checksum, 7));
+    std::string padded = content;
+    padded.resize((content.size() + 511) / 512 * 512, '\0');
+    return header + padded;
+}
+
+std::string Tar(const std::vector<std::pair<std::string, std::string>>& files) {
+    std::string tar;
+    for (const auto& file : files) {
+        tar += TarFile(file.first, file.second);
+    }
+    return tar + std::string(1024, '\0');
+}
+
+// windowBits 16 + 15 - gzip framing, -15 - raw deflate as in zip
+std::string Deflate(const std::string& data, int windowBits) {
+    z_stream stream{};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()) + 32, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+void Put16(std::string& out, uint32_t value) {
+    out += static_cast<char>(value & 0xff);
+    out += static_cast<char>(value >> 8 & 0xff);
+}
+
+void Put32(std::string& out, uint32_t value) {
+    Put16(out, value & 0xffff);
+    Put16(out, value >> 16);
+}
+
+struct ZipEntry {
+    std::string name;
+    std::string content;
+    bool deflated;   // with a data descriptor, as written by streaming tools
+};
+
+std::string Zip(const std::vector<ZipEntry>& entries) {
+    std::string zip, central;
+    for (const auto& entry : entries) {
+        uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(entry.content.data()),
+                             static_cast<uInt>(entry.content.size()));
+        std::string data = entry.deflated ? Deflate(entry.content, -MAX_WBITS) : entry.content;
+        uint32_t offset = static_cast<uint32_t>(zip.size());
+        uint16_t flags = entry.deflated ? 8 : 0;
+        uint16_t method = entry.deflated ? 8 : 0;
+
+        Put32(zip, 0x04034b50);
+        Put16(zip, 20);
+        Put16(zip, flags);
+        Put16(zip, method);
+        Put32(zip, 0);
+        Put32(zip, entry.deflated ? 0 : crc);
+        Put32(zip, entry.deflated ? 0 : static_cast<uint32_t>(data.size()));
+        Put32(zip, entry.deflated ? 0 : static_cast<uint32_t>(entry.content.size()));
+        Put16(zip, static_cast<uint32_t>(entry.name.size()));
+        Put16(zip, 0);
+        zip += entry.name + data;
+        if (entry.deflated) {
+            Put32(zip, 0x08074b50);
+            Put32(zip, crc);
+            Put32(zip, static_cast<uint32_t>(data.size()));
+            Put32(zip, static_cast<uint32_t>(entry.content.size()));
+        }
+
+        Put32(central, 0x02014b50);
+        Put16(central, 20);
+        Put16(central, 20);
+        Put16(central, flags);
+        Put16(central, method);
+        Put32(central, 0);
+        Put32(central, crc);
+        Put32(central, static_cast<uint32_t>(data.size()));
+        Put32(central, static_cast<uint32_t>(entry.content.size()));
+        Put16(central, static_cast<uint32_t>(entry.name.size()));
+        Put32(central, 0); // extra and comment lengths
+        Put32(central, 0); // disk, internal attributes
+        Put32(central, 0); // external attributes
+        Put32(central, offset);
+        central += entry.name;
+    }
+    uint32_t centralOffset = static_cast<uint32_t>(zip.size());
+    zip += central;
+    Put32(zip, 0x06054b50);
+    Put32(zip, 0);
+    Put16(zip, static_cast<uint32_t>(entries.size()));
+    Put16(zip, static_cast<uint32_t>(entries.size()));
+    Put32(zip, static_cast<uint32_t>(central.size()));
+    Put32(zip, centralOffset);
+    Put16(zip, 0);
+    return zip;
+}
+
+void WriteFile(const std::string& path, const std::string& content) {
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+} // namespace
+
+TEST_F(MalwareScannerTest, ArchiveMembersScannedInOnePass) {
+    const std::string tar = Tar({{"inner/evil.txt", "Hello World"}, {"clean.txt", "Another file"}});
+    WriteFile("test_dir/pack.tar.gz", Deflate(tar, 16 + MAX_WBITS));
+    const std::string zip = Zip({{"a/evil.bin", "Hello World", true},
+                                 {"b.txt", "nothing here", false},
+                                 {"nested.tar", Tar({{"evil.txt", "Hello World"}}), false}});
+    WriteFile("test_dir/pack.zip", zip);
+    WriteFile("test_dir/cut.zip", zip.substr(0, 45)); // ends inside the first member
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    std::mutex mutex;
+    std::vector<std::string> found;
+    ScanOptions options;
+    options.threadCount = 2;
+    options.onDetection = [&](const std::string& path, const std::string&, std::string_view) {
+        std::lock_guard<std::mutex> lock(mutex);
+        found.push_back(path);
+    };
+
+    ScanResult whole = scanner.ScanDirectory("test_dir", "", options);
+    EXPECT_EQ(whole.maliciousFiles, 1);
+    EXPECT_EQ(whole.archiveMembers, 0);
+
+    // One level: zip members and the tar inside the gzip, not what that holds
+    found.clear();
+    options.archiveDepth = 1;
+    ScanResult shallow = scanner.ScanDirectory("test_dir", "", options);
+    EXPECT_EQ(shallow.totalFiles, 6);
+    EXPECT_EQ(shallow.maliciousFiles, 2);
+    EXPECT_EQ(shallow.archiveMembers, 4);
+    EXPECT_EQ(shallow.damagedArchives, 1);
+
+    found.clear();
+    options.archiveDepth = 2;
+    ScanResult deep = scanner.ScanDirectory("test_dir", "", options);
+    EXPECT_EQ(deep.maliciousFiles, 4);
+    EXPECT_EQ(deep.archiveMembers, 7);
+    EXPECT_EQ(deep.skippedMembers, 0);
+    EXPECT_EQ(deep.damagedArchives, 1);
+    EXPECT_EQ(deep.errorCount, 0);
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, (std::vector<std::string>{"test_dir/file1.txt",
+                                               "test_dir/pack.tar.gz!pack.tar!inner/evil.txt",
+                                               "test_dir/pack.zip!a/evil.bin",
+                                               "test_dir/pack.zip!nested.tar!evil.txt"}));
+}
+
+TEST(ArchiveReaderTest, MembersAcrossChunkBoundaries) {
+    const std::string tar = Tar({{std::string(120, 'd') + "/long.txt", "Hello World"}, {"empty", ""}});
+    const std::string zip = Zip({{"z/deflated", std::string(200000, 'x'), true},
+                                 {"z/stored", "Another file", false},
+                                 {"inner.tar.gz", Deflate(tar, 16 + MAX_WBITS), false}});
+
+    // Member names and MD5s, the zip fed in pieces of `step` bytes
+    auto read = [&](size_t step) {
+        std::vector<std::string> members;
+        ArchiveReader reader(DigestBit(DigestType::MD5), 3, "test.zip");
+        auto member = [&](const std::string& name, const FileDigests& digests) {
+            members.push_back(name + " " + digests.ToHex(DigestType::MD5));
+        };
+        for (size_t pos = 0; pos < zip.size(); pos += step) {
+            size_t size = std::min(step, zip.size() - pos);
+            reader.Feed(reinterpret_cast<const uint8_t*>(zip.data()) + pos, size, member);
+        }
+        reader.Finish(member);
+        EXPECT_EQ(reader.GetFormat(), ArchiveReader::Format::Zip);
+        EXPECT_EQ(reader.DamagedArchives(), 0);
+        EXPECT_EQ(reader.Members(), members.size());
+        return members;
+    };
+
+    std::vector<std::string> whole = read(zip.size());
+    ASSERT_EQ(whole.size(), 6);
+    EXPECT_EQ(whole[2], "inner.tar.gz!inner.tar!" + std::string(120, 'd') +
+                        "/long.txt b10a8db164e0754105b7a99be72e3fe5");
+    EXPECT_EQ(whole[3], "inner.tar.gz!inner.tar!empty d41d8cd98f00b204e9800998ecf8427e");
+    EXPECT_EQ(read(1), whole);
+    EXPECT_EQ(read(7), whole);
+    EXPECT_EQ(read(4096), whole);
+}
+
+TEST_F(MalwareScannerTest, PatternSignaturesMatchContent) {
+    // "licious c" from file2, and a line that is too short to be a pattern
+    std::ofstream("test_patterns.csv") << "6c6963696f75732063;PatternHit\n"
+                                       << "4865;TooShort\n";
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    ASSERT_TRUE(scanner.LoadPatternBase("test_patterns.csv"));
+    EXPECT_EQ(scanner.GetPatternReport().signatures, 1);
+    EXPECT_EQ(scanner.GetPatternReport().malformedLines, 1);
+
+    std::map<std::string, std::string> found;
+    std::mutex mutex;
+    ScanOptions options;
+    options.threadCount = 2;
+    options.onDetection = [&](const std::string& path, const std::string& hash, std::string_view verdict) {
+        std::lock_guard<std::mutex> lock(mutex);
+        found[path] = hash + " " + std::string(verdict);
+    };
+    ScanResult result = scanner.ScanDirectory("test_dir", "", options);
+    EXPECT_EQ(result.totalFiles, 3);
+    EXPECT_EQ(result.maliciousFiles, 2);
+    EXPECT_EQ(found["test_dir/file1.txt"], "b10a8db164e0754105b7a99be72e3fe5 TestMalware");
+    EXPECT_EQ(found["test_dir/file2.txt"], "pattern@2 PatternHit");
+    fs::remove("test_patterns.csv");
+}
+
+TEST(PatternMatcherTest, FirstMatchAcrossBuffers) {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> data(256 << 10);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    const std::vector<std::string> sparse = {"\xde\xad\xbe\xef\x01", "\xde\xad\xbe\xef", "\xad\xbe\xef\x01\x02"};
+    std::vector<std::string> dense = sparse;
+    for (int i = 0; i < 200; ++i) {
+        std::string pattern(6, '\0');
+        for (auto& c : pattern) {
+            c = static_cast<char>(rng());
+        }
+        dense.push_back(pattern);
+    }
+    const std::string planted = "\xde\xad\xbe\xef\x01\x02";
+    std::copy(planted.begin(), planted.end(), data.begin() + 200000);
+
+    for (const auto& patterns : {sparse, dense}) {
+        PatternMatcherBuilder builder;
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            builder.Add(reinterpret_cast<const uint8_t*>(patterns[i].data()), patterns[i].size(),
+                        "p" + std::to_string(i));
+        }
+        std::shared_ptr<PatternMatcher> matcher = builder.Build();
+        ASSERT_TRUE(matcher);
+        if (patterns.size() > 64) {
+            EXPECT_TRUE(matcher->HasPrefilter()); // the byte-pair filter needs no SIMD
+        }
+
+        // Earliest end wins, then the pattern listed first
+        uint32_t expected = PatternMatcher::NO_MATCH;
+        size_t expectedStart = 0;
+        for (size_t end = 1; end <= data.size() && expected == PatternMatcher::NO_MATCH; ++end) {
+            for (size_t i = 0; i < patterns.size(); ++i) {
+                size_t length = patterns[i].size();
+                if (length <= end && std::memcmp(data.data() + end - length, patterns[i].data(), length) == 0) {
+                    expected = static_cast<uint32_t>(i);
+                    expectedStart = end - length;
+                    break;
+                }
+            }
+        }
+        ASSERT_NE(expected, PatternMatcher::NO_MATCH);
+
+        for (size_t step : {size_t(1), size_t(5), size_t(4096), data.size()}) {
+            PatternMatcher::Cursor cursor;
+            for (size_t pos = 0; pos < data.size(); pos += step) {
+                matcher->Scan(cursor, data.data() + pos, std::min(step, data.size() - pos));
+            }
+            EXPECT_EQ(cursor.match, expected) << "step " << step;
+            EXPECT_EQ(cursor.matchOffset, expectedStart) << "step " << step;
+        }
+    }
+}
+
+#ifdef __linux__
+TEST_F(MalwareScannerTest, WatchScansWrittenFiles) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    std::mutex mutex;
+    std::vector<std::string> found;
+    ScanOptions options;
+    options.threadCount = 2;
+    options.onDetection = [&](const std::string& filePath, const std::string&, std::string_view) {
+        std::lock_guard<std::mutex> lock(mutex);
+        found.push_back(filePath);
+    };
+    WatchOptions watchOptions;
+    watchOptions.settleMs = 50;
+    std::atomic<bool> stop{false};
+    ScanResult result;
+    std::thread watching([&] {
+        result = scanner.Watch("test_dir", "", options, watchOptions, stop);
+    });
+
+    // The watch may not be set up yet, so the file is written again until it is seen
+    const std::string written = "test_dir/later/written.txt";
+    bool seen = false;
+    for (int attempt = 0; attempt < 100 && !seen; ++attempt) {
+        if (attempt % 10 == 0) {
+            fs::create_directories("test_dir/later");
+            std::ofstream(written) << "Hello World";
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::lock_guard<std::mutex> lock(mutex);
+        seen = !found.empty();
+    }
+    stop = true;
+    watching.join();
+
+    ASSERT_TRUE(seen);
+    for (const auto& path : found) {
+        EXPECT_EQ(path, written); // files present before the watch are not scanned
+    }
+    EXPECT_EQ(result.maliciousFiles, found.size());
+    EXPECT_EQ(result.errorCount, 0);
+}
+#endif
+
+#ifndef _WIN32
+TEST_F(MalwareScannerTest, DaemonServesConcurrentRequests) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 2;
+    ScanServer server(scanner, options);
+    const std::string socketPath = (fs::temp_directory_path() / "scanner_test.sock").string();
+    ASSERT_TRUE(server.Listen(socketPath));
+    std::thread serving([&] { server.Run(); });
+
+    std::ostringstream directory, files;
+    std::thread client([&] {
+        EXPECT_TRUE(SendScanRequest(socketPath, "SCAN test_dir\n", directory));
+    });
+    EXPECT_TRUE(SendScanRequest(socketPath, "FILES\ntest_dir/file1.txt\ntest_dir/file2.txt\n\n", files));
+    client.join();
+
+    EXPECT_NE(directory.str().find("FOUND\ttest_dir/file1.txt\tb10a8db164e0754105b7a99be72e3fe5\tTestMalware\n"),
+              std::string::npos);
+    EXPECT_NE(directory.str().find("DONE\tfiles=3\tmalicious=1\terrors=0\t"), std::string::npos);
+    EXPECT_NE(files.str().find("DONE\tfiles=2\tmalicious=1\terrors=0\t"), std::string::npos);
+
+    std::ostringstream missing;
+    EXPECT_FALSE(SendScanRequest(socketPath, "SCAN test_dir/none\n", missing));
+    EXPECT_EQ(missing.str().rfind("ERROR\t", 0), 0);
+
+    server.Stop();
+    serving.join();
+    EXPECT_FALSE(fs::exists(socketPath));
+}
+
+TEST_F(MalwareScannerTest, DaemonFinishesChunkedFilesOfYieldedSlots) {
+    // Small requests make the directory scan yield slots on the shared pool
+    // while continuations of large files sit on the yielded slots' deques
+    std::ofstream base("test_base.csv", std::ios::binary | std::ios::app);
+    base << "\n";
+    std::vector<std::string> found;
+    for (int i = 0; i < 6; ++i) {
+        std::string content(200000 + i * 1000, static_cast<char>('k' + i));
+        std::string path = "test_dir/big" + std::to_string(i) + ".bin";
+        std::ofstream(path, std::ios::binary).write(content.data(), content.size());
+        MD5 md5;
+        md5.Update(content.data(), content.size());
+        std::string digest = MD5::ToHex(md5.Final());
+        base << digest << ";BigMalware\n";
+        found.push_back("FOUND\t" + path + "\t" + digest + "\tBigMalware\n");
+    }
+    base.close();
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+
+    ScanOptions options;
+    options.threadCount = 4;
+    options.chunkSize = 4096;
+    options.smallFileBatch = 0;
+    ScanServer server(scanner, options);
+    const std::string socketPath = (fs::temp_directory_path() / "scanner_test_chunks.sock").string();
+    ASSERT_TRUE(server.Listen(socketPath));
+    std::thread serving([&] { server.Run(); });
+
+    for (int round = 0; round < 10; ++round) {
+        std::ostringstream directory;
+        std::atomic<bool> scanned{false};
+        std::thread client([&] {
+            EXPECT_TRUE(SendScanRequest(socketPath, "SCAN test_dir\n", directory));
+            scanned = true;
+        });
+        while (!scanned) {
+            std::ostringstream files;
+            EXPECT_TRUE(SendScanRequest(socketPath, "FILES\ntest_dir/file2.txt\n\n", files));
+        }
+        client.join();
+        for (const auto& line : found) {
+            EXPECT_NE(directory.str().find(line), std::string::npos) << "round " << round << ": " << line;
+        }
+        EXPECT_NE(directory.str().find("DONE\tfiles=9\tmalicious=7\terrors=0\t"), std::string::npos)
+            << "round " << round;
+    }
+
+    server.Stop();
+    serving.join();
+}
+
+TEST_F(MalwareScannerTest, CoordinatorMergesShardsFromWorkers) {
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    ScanOptions options;
+    options.threadCount = 1;
+    ScanServer first(scanner, options), second(scanner, options);
+    const std::string firstPath = (fs::temp_directory_path() / "scanner_test_a.sock").string();
+    const std::string secondPath = (fs::temp_directory_path() / "scanner_test_b.sock").string();
+    ASSERT_TRUE(first.Listen(firstPath));
+    ASSERT_TRUE(second.Listen(secondPath));
+    std::thread servingFirst([&] { first.Run(); });
+    std::thread servingSecond([&] { second.Run(); });
+
+    // A worker that cannot be reached; whatever it takes goes to the others
+    std::vector<std::unique_ptr<ShardTransport>> workers;
+    workers.push_back(std::make_unique<SocketTransport>(firstPath));
+    workers.push_back(std::make_unique<SocketTransport>(secondPath));
+    workers.push_back(std::make_unique<SocketTransport>((fs::temp_directory_path() / "scanner_none.sock").string()));
+    // and one that takes requests but never answers, until its shard times out
+    const std::string hungPath = (fs::temp_directory_path() / "scanner_test_hung.sock").string();
+    fs::remove(hungPath);
+    int hung = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, hungPath.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(bind(hung, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(hung, 1), 0);
+    workers.push_back(std::make_unique<SocketTransport>(hungPath));
+    CoordinatorOptions coordinatorOptions;
+    coordinatorOptions.filesPerShard = 1;
+    coordinatorOptions.shardTimeoutMs = 300;
+    ScanCoordinator coordinator(std::move(workers), coordinatorOptions);
+    ScanResult result = coordinator.Scan("test_dir", "test_log.log");
+
+    EXPECT_EQ(result.totalFiles, 3);
+    EXPECT_EQ(result.maliciousFiles, 1);
+    EXPECT_EQ(result.errorCount, 0);
+    size_t shards = 0;
+    for (const auto& worker : coordinator.Workers()) {
+        shards += worker.shards;
+    }
+    EXPECT_EQ(shards, 3);
+    std::ifstream log("test_log.log");
+    std::string content((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+    size_t entry = content.find("File: test_dir/file1.txt");
+    EXPECT_NE(entry, std::string::npos);
+    EXPECT_EQ(content.find("File: ", entry + 1), std::string::npos);
+
+    first.Stop();
+    second.Stop();
+    servingFirst.join();
+    servingSecond.join();
+    close(hung);
+    fs::remove(hungPath);
+}
+#endif
+
+TEST(ScanFilterTest, RulesCompileIntoOneMatcher) {
+    ScanFilter filter;
+    std::string error;
+    ASSERT_TRUE(filter.Compile({"# build output", "exclude node_modules/", "exclude /build",
+                                "exclude **/cache/*.tmp", "", "exclude-ext LOG"}, error)) << error;
+    EXPECT_FALSE(filter.Empty());
+    EXPECT_FALSE(filter.PathIndependent());
+
+    ScanFilter::State src, child;
+    ASSERT_TRUE(filter.EnterDirectory(filter.Root(), "src", src));
+    EXPECT_FALSE(filter.EnterDirectory(filter.Root(), "node_modules", child));
+    EXPECT_FALSE(filter.EnterDirectory(src, "node_modules", child));
+    EXPECT_TRUE(filter.MatchFile(src, "node_modules")); // directories only
+    EXPECT_FALSE(filter.EnterDirectory(filter.Root(), "build", child));
+    EXPECT_TRUE(filter.EnterDirectory(src, "build", child)); // anchored at the root
+    EXPECT_FALSE(filter.MatchFile(src, "trace.log"));
+    EXPECT_TRUE(filter.MatchFile(src, "main.cpp"));
+    EXPECT_FALSE(filter.MatchPath("a/b/cache/x.tmp"));
+    EXPECT_TRUE(filter.MatchPath("a/b/cache/sub/x.tmp"));
+    EXPECT_FALSE(filter.MatchPath("src/node_modules/pkg/index.js"));
+    // Unanchored globs match whole names only
+    EXPECT_TRUE(filter.EnterDirectory(src, "my_node_modules", child));
+    EXPECT_TRUE(filter.MatchPath("a/b/precache/x.tmp"));
+
+    ScanFilter names;
+    ASSERT_TRUE(names.Compile({"exclude cache", "exclude a/**/b", "exclude x**/y"}, error)) << error;
+    EXPECT_FALSE(names.MatchPath("src/cache"));
+    EXPECT_TRUE(names.MatchPath("src/precache"));
+    EXPECT_TRUE(names.MatchPath("cache.txt"));
+    EXPECT_FALSE(names.MatchPath("a/b"));
+    EXPECT_FALSE(names.MatchPath("a/c/d/b"));
+    EXPECT_TRUE(names.MatchPath("a/xb"));
+    EXPECT_TRUE(names.MatchPath("a/c/xb"));
+    EXPECT_FALSE(names.MatchPath("xz/y"));
+    EXPECT_TRUE(names.MatchPath("x/z/y"));
+
+    ScanFilter include;
+    ASSERT_TRUE(include.Compile({"include src/", "include-ext md"}, error)) << error;
+    EXPECT_TRUE(include.MatchPath("src/a/b.c"));
+    EXPECT_TRUE(include.MatchPath("docs/readme.MD"));
+    EXPECT_FALSE(include.MatchPath("docs/b.c"));
+
+    ScanFilter limits;
+    ASSERT_TRUE(limits.Compile({"exclude *.tmp", "min-size 1K", "max-age 2"}, error)) << error;
+    EXPECT_TRUE(limits.PathIndependent());
+    EXPECT_TRUE(limits.NeedsStat());
+    const int64_t day = 86400LL * 1000000000LL, now = 100 * day;
+    EXPECT_FALSE(limits.MatchLimits(512, now, now));
+    EXPECT_FALSE(limits.MatchLimits(2048, now - 3 * day, now));
+    EXPECT_TRUE(limits.MatchLimits(2048, now - day, now));
+
+    ScanFilter bad;
+    EXPECT_FALSE(bad.Compile({"exclude *.tmp", "skip *.bak"}, error));
+    EXPECT_NE(error.find("line 2"), std::string::npos) << error;
+}
+
+TEST_F(MalwareScannerTest, FilteredEntriesAreNotScanned) {
+    std::ofstream("test_dir/subdir/notes.md", std::ios::binary) << "Hello World";
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_base.csv"));
+    for (bool parallel : {true, false}) {
+        auto filter = std::make_shared<ScanFilter>();
+        std::string error;
+        ASSERT_TRUE(filter->Compile({"exclude subdir/", "exclude file2.txt"}, error)) << error;
+        ScanOptions options;
+        options.threadCount = 2;
+        options.parallelTraversal = parallel;
+        options.filter = filter;
+        ScanResult result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+        EXPECT_EQ(result.totalFiles, 1) << parallel;
+        EXPECT_EQ(result.maliciousFiles, 1) << parallel;
+        EXPECT_EQ(result.filteredFiles, 1) << parallel;
+        EXPECT_EQ(result.filteredDirectories, 1) << parallel;
+
+        // Only files with the included extension, wherever they are
+        ASSERT_TRUE(filter->Compile({"include-ext md"}, error)) << error;
+        result = scanner.ScanDirectory("test_dir", "test_log.log", options);
+        EXPECT_EQ(result.totalFiles, 1) << parallel;
+        EXPECT_EQ(result.maliciousFiles, 1) << parallel;
+        EXPECT_EQ(result.filteredFiles, 3) << parallel;
+    }
+}
+
+TEST(BaseLoaderTest, ParallelChunksAndMalformedLines) {
+    // ~3 MB so that the loader really splits the file between threads
+    std::ofstream base("test_parallel_base.csv", std::ios::binary);
+    base << "\xEF\xBB\xBF";
+    const size_t lines = 90000;
+    for (size_t i = 0; i < lines; ++i) {
+        if (i == 10) {
+            base << "not a signature\r\n";
+        } else if (i == 70000) {
+            base << "zz0a8db164e0754105b7a99be72e3fe5;Bad\n";
+        } else if (i == lines - 1) {
+            base << "B10A8DB164E0754105B7A99BE72E3FE5;Last\n";
+        } else {
+            char hash[33];
+            std::snprintf(hash, sizeof(hash), "%032zx", i);
+            base << hash << ";Verdict" << (i % 7) << "\r\n";
+        }
+    }
+    base << "b10a8db164e0754105b7a99be72e3fe5;\n";
+    base.close();
+
+    MalwareScanner scanner;
+    ASSERT_TRUE(scanner.LoadMalwareBase("test_parallel_base.csv", 4));
+    const BaseLoadReport& report = scanner.GetLoadReport();
+    EXPECT_EQ(report.lines, lines + 1);
+    EXPECT_EQ(report.signatures, lines - 2);
+    EXPECT_EQ(report.malformedLines, 3);
+    ASSERT_EQ(report.malformedSamples.size(), 3);
+    EXPECT_EQ(report.malformedSamples[0], "line 11: missing ';' separator");
+    EXPECT_EQ(report.malformedSamples[1], "line 70001: hash is not 32, 40 or 64 hex digits");
+    EXPECT_EQ(report.malformedSamples[2], "line 90001: empty verdict");
+
+    fs::create_directories("test_parallel_dir");
+    std::ofstream file("test_parallel_dir/hello.txt", std::ios::binary);
+    file.write("Hello World", 11);
+    file.close();
+    ScanResult result = scanner.ScanDirectory("test_parallel_dir", "test_parallel.log", 1);
+    EXPECT_EQ(result.maliciousFiles, 1);
+
+    std::ifstream log("test_parallel.log");
+    std::string content((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+    EXPECT_NE(content.find("Verdict: Last"), std::string::npos);
+
+    fs::remove_all("test_parallel_dir");
+    fs::remove("test_parallel_base.csv");
+    fs::remove("test_parallel.log");
+}
+
+TEST(MD5Test, KnownVectors) {
+    EXPECT_EQ(MD5::ToHex(MD5().Final()), "d41d8cd98f00b204e9800998ecf8427e");
+
+    MD5 md5;
+    md5.Update("Hello World", 11);
+    EXPECT_EQ(MD5::ToHex(md5.Final()), "b10a8db164e0754105b7a99be72e3fe5");
+
+    const std::string digits = "12345678901234567890123456789012345678901234567890123456789012345678901234567890";
+    md5.Update(digits.data(), 7);
+    md5.Update(digits.data() + 7, digits.size() - 7);
+    EXPECT_EQ(MD5::ToHex(md5.Final()), "57edf4a22be3c955ac49da2e2107b67a");
+}
+
+TEST(SHATest, KnownVectorsOnEveryEngine) {
+    const std::string abc = "abc";
+    const std::string twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    std::string million(1000000, 'a');
+    for (SHAEngine engine : {SHAEngine::Scalar, SHAEngine::SHANI}) {
+        SHA1 sha1(engine);
+        EXPECT_EQ(DigestToHex(sha1.Final().data(), 20), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+        sha1.Update(abc.data(), abc.size());
+        EXPECT_EQ(DigestToHex(sha1.Final().data(), 20), "a9993e364706816aba3e25717850c26c9cd0d89d");
+        sha1.Update(twoBlocks.data(), twoBlocks.size());
+        EXPECT_EQ(DigestToHex(sha1.Final().data(), 20), "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+        SHA256 sha256(engine);
+        EXPECT_EQ(DigestToHex(sha256.Final().data(), 32),
+                  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        sha256.Update(abc.data(), abc.size());
+        EXPECT_EQ(DigestToHex(sha256.Final().data(), 32),
+                  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        sha256.Update(twoBlocks.data(), twoBlocks.size());
+        EXPECT_EQ(DigestToHex(sha256.Final().data(), 32),
+                  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+        // Odd split sizes exercise the block buffering
+        for (size_t offset = 0; offset < million.size(); offset += 9973) {
+            size_t size = std::min<size_t>(9973, million.size() - offset);
+            sha1.Update(million.data() + offset, size);
+            sha256.Update(million.data() + offset, size);
+        }
+        EXPECT_EQ(DigestToHex(sha1.Final().data(), 20), "34aa973cd4c4daa4f61eeb2bdbad27316534016f")
+            << SHAEngineName(engine);
+        EXPECT_EQ(DigestToHex(sha256.Final().data(), 32),
+                  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0")
+            << SHAEngineName(engine);
+    }
+}
+
+TEST(MD5Test, MultiBufferMatchesScalar) {
+    std::mt19937 rng(42);
+    const size_t streams = 21;
+    std::vector<std::vector<uint8_t>> inputs(streams);
+    for (size_t i = 0; i < streams; ++i) {
+        inputs[i].resize(rng() % 5000);
+        for (auto& byte : inputs[i]) {
+            byte = static_cast<uint8_t>(rng());
+        }
+    }
+
+    for (MD5Engine engine : {MD5Engine::Scalar, MD5Engine::AVX2, MD5Engine::AVX512}) {
+        std::vector<MD5> contexts(streams);
+        std::vector<size_t> offsets(streams, 0);
+
+        // Feed uneven slices so lanes drift in and out of lockstep
+        for (size_t round = 0; round < 8; ++round) {
+            std::vector<MD5*> ctx;
+            std::vector<const uint8_t*> data;
+            std::vector<size_t> sizes;
+            for (size_t i = 0; i < streams; ++i) {
+                size_t take = std::min(inputs[i].size() - offsets[i], size_t(rng() % 1500));
+                ctx.push_back(&contexts[i]);
+                data.push_back(inputs[i].data() + offsets[i]);
+                sizes.push_back(take);
+                offsets[i] += take;
+            }
+            MD5UpdateMany(ctx.data(), data.data(), sizes.data(), ctx.size(), engine);
+        }
+
+        for (size_t i = 0; i < streams; ++i) {
+            contexts[i].Update(inputs[i].data() + offsets[i], inputs[i].size() - offsets[i]);
+            MD5 reference;
+            reference.Update(inputs[i].data(), inputs[i].size());
+            EXPECT_EQ(contexts[i].Final(), reference.Final()) << MD5EngineName(engine) << " stream " << i;
+        }
+    }
+}
+
+TEST(MD5Test, CalculateMD5File) {
+    std::ofstream file("md5_test_file.bin", std::ios::binary);
+    std::string content(200000, 'x');
+    file.write(content.data(), content.size());
+    file.close();
+
+    MD5 md5;
+    md5.Update(content.data(), content.size());
+    EXPECT_EQ(CalculateMD5("md5_test_file.bin"), MD5::ToHex(md5.Final()));
+    EXPECT_EQ(CalculateMD5("missing_md5_test_file.bin"), "");
+
+    fs::remove("md5_test_file.bin");
+}